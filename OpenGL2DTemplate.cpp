@@ -1,52 +1,856 @@
-﻿
-// Space Explorer - Final single-file version 
+﻿// Space Explorer - Final single-file version
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 #include <GL/glut.h>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
 #include <cmath>
+#include <cfloat>
 #include <cstdio>
 #include <cstring>
+#include <cstdint>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
 #include <ctime>
 #include <cstdlib>
 #include <algorithm>
+#include <functional>
+#include <future>
+#include <new>
+#include <utility>
+#include <type_traits>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+#ifdef _WIN32
 #include <mmsystem.h>
 #pragma comment(lib, "winmm.lib")   // links the Multimedia API
+#else
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#include <sys/stat.h>
+
+// single producer / single consumer ring; push fails (and counts a drop) when full
+template <class T, size_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+public:
+    bool push(const T& v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) { drops.fetch_add(1, std::memory_order_relaxed); return false; }
+        items[h & (N - 1)] = v;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& out) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        out = items[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    std::atomic<unsigned> drops{ 0 };
+private:
+    T items[N];
+    alignas(64) std::atomic<size_t> head{ 0 };
+    alignas(64) std::atomic<size_t> tail{ 0 };
+};
+
+// -------------------------------
+// Startup timing: named phases in ms since the process started (taken as
+// this file's first static initialiser), and the time from the 'R' press
+// to the first gameplay tick of each round. Slow setup runs on background
+// threads. Each piece has a future, and the game checks it is ready before
+// using what that piece builds.
+// -------------------------------
+static inline long long nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const long long processStartUs = nowUs();
+
+struct StartupTrace {
+    static const int CAP = 24;
+    struct Phase { const char* name; float ms; bool background; };
+    Phase phases[CAP];
+    int count = 0;
+    std::mutex lock;
+
+    void mark(const char* name, bool background = false) {
+        std::lock_guard<std::mutex> hold(lock);
+        if (count < CAP) phases[count++] = { name, (nowUs() - processStartUs) * 0.001f, background };
+    }
+    void print() {
+        std::lock_guard<std::mutex> hold(lock);
+        for (int i = 0; i < count; i++)
+            printf("  %8.2f ms  %s%s\n", phases[i].ms, phases[i].name, phases[i].background ? " (background)" : "");
+    }
+};
+StartupTrace startup;
+
+template <class T>
+static inline bool isReady(const std::shared_future<T>& f) {
+    return f.valid() && f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+// -------------------------------
+// Asset archive: the audio files packed into one file by --pack-assets.
+// A header and an index of named entries are followed by the entries, each
+// starting on a page. Every entry carries a CRC-32 of its original bytes.
+// WAVs may be stored compressed (PAK_PCM16, below). The game maps the
+// archive at startup. An entry is checked, and decompressed if need be,
+// the first time it is asked for; stored entries are then read in place.
+// -------------------------------
+const char* assetArchivePath = "assets.pak";
+const uint32_t PAK_MAGIC = 0x4B504553; // "SEPK"
+const uint32_t PAK_VERSION = 1;
+const uint32_t PAK_ALIGN = 4096;
+enum PakMethod : uint8_t { PAK_STORE, PAK_PCM16 };
+
+struct PakHeader { uint32_t magic, version, count, reserved; };
+struct PakEntry {
+    char name[48];
+    uint64_t offset;
+    uint32_t size, rawSize, crc; // stored size, original size, CRC-32 of the original
+    uint8_t method, pad[3];
+};
+
+uint32_t crc32(const uint8_t* p, size_t n) {
+    static uint32_t table[256];
+    static bool built = false;
+    if (!built) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        built = true;
+    }
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; i++) c = table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// PAK_PCM16: the bytes as little-endian 16-bit stereo samples, each
+// predicted from its channel's last two (2a - b). Residuals are zigzagged
+// and bit-packed in blocks of 32 samples, after one byte holding the
+// block's width. An odd last byte follows as is. A WAV's header becomes a
+// few noisy samples.
+const int PCM16_BLOCK = 32;
+
+void pcm16Encode(const uint8_t* raw, size_t n, std::vector<uint8_t>& out) {
+    out.clear();
+    size_t samples = n / 2;
+    int32_t hist[2][2] = {};
+    uint32_t zz[PCM16_BLOCK];
+    for (size_t at = 0; at < samples; at += PCM16_BLOCK) {
+        int k = (int)(std::min)((size_t)PCM16_BLOCK, samples - at);
+        uint32_t all = 0;
+        for (int i = 0; i < k; i++) {
+            int32_t* h = hist[(at + i) & 1];
+            int32_t x = (int16_t)(raw[2 * (at + i)] | raw[2 * (at + i) + 1] << 8);
+            int32_t r = x - (2 * h[0] - h[1]);
+            h[1] = h[0]; h[0] = x;
+            zz[i] = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+            all |= zz[i];
+        }
+        int bits = 0;
+        while (all >> bits) bits++;
+        out.push_back((uint8_t)bits);
+        uint64_t acc = 0;
+        int have = 0;
+        for (int i = 0; i < k; i++) {
+            acc |= (uint64_t)zz[i] << have;
+            for (have += bits; have >= 8; have -= 8) { out.push_back((uint8_t)acc); acc >>= 8; }
+        }
+        if (have) out.push_back((uint8_t)acc);
+    }
+    if (n & 1) out.push_back(raw[n - 1]);
+}
+
+bool pcm16Decode(const uint8_t* src, size_t n, uint8_t* raw, size_t rawSize) {
+    const uint8_t* end = src + n;
+    size_t samples = rawSize / 2;
+    int32_t hist[2][2] = {};
+    for (size_t at = 0; at < samples; at += PCM16_BLOCK) {
+        int k = (int)(std::min)((size_t)PCM16_BLOCK, samples - at);
+        if (src == end) return false;
+        int bits = *src++;
+        if (bits > 18 || (size_t)(end - src) < ((size_t)k * bits + 7) / 8) return false;
+        uint64_t acc = 0;
+        int have = 0;
+        for (int i = 0; i < k; i++) {
+            for (; have < bits; have += 8) acc |= (uint64_t)*src++ << have;
+            uint32_t z = (uint32_t)(acc & ((1u << bits) - 1));
+            acc >>= bits; have -= bits;
+            int32_t* h = hist[(at + i) & 1];
+            int32_t x = 2 * h[0] - h[1] + (int32_t)((z >> 1) ^ (0u - (z & 1)));
+            h[1] = h[0]; h[0] = x;
+            raw[2 * (at + i)] = (uint8_t)x; raw[2 * (at + i) + 1] = (uint8_t)(x >> 8);
+        }
+    }
+    if (rawSize & 1) { if (src == end) return false; raw[rawSize - 1] = *src++; }
+    return src == end;
+}
+
+struct AssetArchive {
+    const uint8_t* base = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#else
+    int fd = -1;
+#endif
+    const PakEntry* entries = NULL;
+    uint32_t count = 0;
+    std::vector<std::vector<uint8_t>> decoded; // per entry, for compressed ones
+    std::vector<uint8_t> checked;              // 0 not yet, 1 good, 2 corrupt
+    std::mutex lock;
+    unsigned decodes = 0;
+    double decodeMs = 0.0;
+
+    bool open(const char* path);
+    void close();
+    // the entry's original bytes, checked (and decompressed) on first use;
+    // NULL when it's missing or corrupt
+    const uint8_t* get(const char* name, size_t& n);
+};
+AssetArchive assets;
+
+bool AssetArchive::open(const char* path) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER len;
+    GetFileSizeEx(file, &len);
+    size = (size_t)len.QuadPart;
+    if (size < sizeof(PakHeader) || !(mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL))) { close(); return false; }
+    base = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    if ((fd = ::open(path, O_RDONLY)) < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(PakHeader)) { close(); return false; }
+    size = (size_t)st.st_size;
+    void* m = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    base = m == MAP_FAILED ? NULL : (const uint8_t*)m;
+#endif
+    if (!base) { close(); return false; }
+    const PakHeader* h = (const PakHeader*)base;
+    count = h->count;
+    entries = (const PakEntry*)(base + sizeof(PakHeader));
+    bool ok = h->magic == PAK_MAGIC && h->version == PAK_VERSION &&
+        sizeof(PakHeader) + (uint64_t)count * sizeof(PakEntry) <= size;
+    for (uint32_t i = 0; ok && i < count; i++)
+        ok = entries[i].offset <= size && size - entries[i].offset >= entries[i].size &&
+            memchr(entries[i].name, 0, sizeof(entries[i].name));
+    if (!ok) { close(); return false; }
+    decoded.assign(count, std::vector<uint8_t>());
+    checked.assign(count, 0);
+    return true;
+}
+
+void AssetArchive::close() {
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL; file = INVALID_HANDLE_VALUE;
+#else
+    if (base) munmap((void*)base, size);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    base = NULL; size = 0; entries = NULL; count = 0;
+    decoded.clear(); checked.clear();
+}
+
+const uint8_t* AssetArchive::get(const char* name, size_t& n) {
+    if (!base) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        const PakEntry& e = entries[i];
+        if (strcmp(e.name, name)) continue;
+        std::lock_guard<std::mutex> hold(lock);
+        if (!checked[i]) {
+            auto t0 = std::chrono::steady_clock::now();
+            const uint8_t* data = base + e.offset;
+            bool ok = e.method == PAK_STORE ? e.size == e.rawSize : e.method == PAK_PCM16;
+            if (ok && e.method == PAK_PCM16) {
+                decoded[i].resize(e.rawSize);
+                ok = pcm16Decode(data, e.size, decoded[i].data(), e.rawSize);
+                data = decoded[i].data();
+                decodes++;
+            }
+            ok = ok && crc32(data, e.rawSize) == e.crc;
+            if (!ok) { printf("Assets: %s is corrupt in the archive\n", name); std::vector<uint8_t>().swap(decoded[i]); }
+            checked[i] = ok ? 1 : 2;
+            decodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        if (checked[i] != 1) return NULL;
+        n = e.rawSize;
+        return e.method == PAK_STORE ? base + e.offset : decoded[i].data();
+    }
+    return NULL;
+}
+
+// an asset read like a file: from the archive when it holds it, else the loose file
+struct AssetFile {
+    FILE* f = NULL;
+    const uint8_t* mem = NULL;
+    size_t size = 0, pos = 0;
+
+    bool open(const char* name) {
+        close();
+        if ((mem = assets.get(name, size))) { pos = 0; return true; }
+        return (f = fopen(name, "rb")) != NULL;
+    }
+    void close() { if (f) fclose(f); f = NULL; mem = NULL; }
+    size_t read(void* dst, size_t elem, size_t n) {
+        if (f) return fread(dst, elem, n, f);
+        n = (std::min)(n, (size - pos) / elem);
+        memcpy(dst, mem + pos, n * elem);
+        pos += n * elem;
+        return n;
+    }
+    long tell() { return f ? ftell(f) : (long)pos; }
+    void seek(long at) {
+        if (f) fseek(f, at, SEEK_SET);
+        else pos = (std::min)((size_t)at, size);
+    }
+};
 
 // -------------------------------------------------------------
 //  SOUND CONTROL  (background music + one-shot sound effects)
 // -------------------------------------------------------------
-void playBackgroundMusic() {
-    // plays and loops background.mp3 forever
-    mciSendString(L"open \"background.mp3\" type mpegvideo alias bgm", NULL, 0, NULL);
-    mciSendString(L"play bgm repeat", NULL, 0, NULL);
-    // set volume (0–1000, lower = quieter)
-    mciSendString(L"setaudio bgm volume to 300", NULL, 0, NULL);
-}
-
-void stopBackgroundMusic() {
-    // stops and closes the music file
-    mciSendString(L"stop bgm", NULL, 0, NULL);
-    mciSendString(L"close bgm", NULL, 0, NULL);
-}
-
-void playSoundEffect(const char* file) {
-    wchar_t cmd[256];
-    printf("Playing sound: %s\n", file);
-
-    swprintf(cmd, 256, L"open \"%hs\" type waveaudio alias se", file);
-    MCIERROR err = mciSendString(cmd, NULL, 0, NULL);
-    if (err != 0) {
-        wchar_t buf[256];
-        mciGetErrorString(err, buf, 256);
-        MessageBox(NULL, buf, L"Sound Error", MB_OK);
+// The music is streamed: a decoder thread reads the track a chunk at a time
+// into a fixed ring of 16-bit stereo frames, and the mixer, called by the
+// output thread, drains it. Memory is the ring's size however long the
+// track is. The decoder rewinds the file in the middle of a chunk, so the
+// loop has no gap, and volume changes are ramps applied frame by frame.
+// Only PCM WAV is decoded: background.wav is the game's track, converted
+// once from background.mp3, so the same stream plays on every platform.
+const int AUDIO_RATE = 44100;
+const int AUDIO_PERIOD = 512;   // frames per mix call (11.6 ms)
+const int MUSIC_RING = 1 << 15; // frames (0.74 s, 128 KB)
+const int MUSIC_CHUNK = 2048;   // frames per decoder read
+const char* musicPath = "background.wav";
+const float musicVolume = 0.3f; // the old MCI "volume to 300" of 1000
+const float musicFadeInMs = 250.0f, musicFadeOutMs = 400.0f;
+
+// a 16-bit PCM WAV read a piece at a time (mono is widened to stereo)
+struct WavStream {
+    AssetFile file;
+    int channels = 0, rate = 0;
+    long dataAt = 0;
+    uint32_t frames = 0, pos = 0;
+
+    bool open(const char* path) {
+        close();
+        if (!file.open(path)) return false;
+        char id[4];
+        uint32_t size;
+        bool fmt = false;
+        if (file.read(id, 1, 4) != 4 || memcmp(id, "RIFF", 4) || file.read(&size, 4, 1) != 1 ||
+            file.read(id, 1, 4) != 4 || memcmp(id, "WAVE", 4)) { close(); return false; }
+        while (file.read(id, 1, 4) == 4 && file.read(&size, 4, 1) == 1) {
+            long next = file.tell() + size + (size & 1);
+            if (!memcmp(id, "fmt ", 4) && size >= 16) {
+                uint16_t tag, ch, bits;
+                uint32_t hz;
+                if (file.read(&tag, 2, 1) != 1 || file.read(&ch, 2, 1) != 1 || file.read(&hz, 4, 1) != 1) break;
+                file.seek(file.tell() + 6); // byte rate, block align
+                if (file.read(&bits, 2, 1) != 1) break;
+                // PCM, or WAVE_FORMAT_EXTENSIBLE holding PCM
+                fmt = (tag == 1 || tag == 0xFFFE) && bits == 16 && (ch == 1 || ch == 2);
+                channels = ch; rate = (int)hz;
+            }
+            else if (!memcmp(id, "data", 4) && fmt) {
+                dataAt = file.tell();
+                frames = size / (2 * channels);
+                pos = 0;
+                return rate > 0;
+            }
+            file.seek(next);
+        }
+        close();
+        return false;
+    }
+    void close() { file.close(); }
+    void rewind() { file.seek(dataAt); pos = 0; }
+    // up to n stereo frames; fewer at the end of the data
+    int read(int16_t* out, int n) {
+        n = (int)(std::min)((uint32_t)n, frames - pos);
+        n = (int)file.read(out + (channels == 1 ? n : 0), 2 * channels, n);
+        if (channels == 1)
+            for (int i = 0; i < n; i++) out[2 * i] = out[2 * i + 1] = out[n + i];
+        pos += n;
+        return n;
+    }
+};
+
+// a WAV track at AUDIO_RATE: linear resampling, carried across reads and
+// across the loop point so the seam is interpolated like any other frame
+struct MusicDecoder {
+    WavStream wav;
+    bool loop = true;
+    int16_t buf[MUSIC_CHUNK * 2];
+    int bufN = 0, bufI = 0;
+    int16_t a[2] = {}, b[2] = {};
+    uint32_t frac = 0, step = 1u << 16; // source frames per output frame, 16.16
+
+    bool open(const char* path, bool looping) {
+        if (!wav.open(path) || !wav.frames) return false;
+        loop = looping;
+        step = (uint32_t)(((uint64_t)wav.rate << 16) / AUDIO_RATE);
+        restart();
+        return true;
+    }
+    void restart() {
+        wav.rewind();
+        bufN = bufI = 0;
+        frac = 0;
+        next(a); next(b);
+    }
+    bool next(int16_t* f) {
+        if (bufI == bufN) {
+            bufN = wav.read(buf, MUSIC_CHUNK);
+            if (!bufN && loop) { wav.rewind(); bufN = wav.read(buf, MUSIC_CHUNK); }
+            bufI = 0;
+            if (!bufN) return false;
+        }
+        f[0] = buf[2 * bufI]; f[1] = buf[2 * bufI + 1];
+        bufI++;
+        return true;
+    }
+    // up to n output frames; fewer only at the end of a track that doesn't loop
+    int fill(int16_t* out, int n) {
+        for (int i = 0; i < n; i++) {
+            for (; frac >= 1u << 16; frac -= 1u << 16) {
+                a[0] = b[0]; a[1] = b[1];
+                if (!next(b)) return i;
+            }
+            int t = (int)(frac >> 1); // 15 bits, so the product fits an int
+            out[2 * i] = (int16_t)(a[0] + (((b[0] - a[0]) * t) >> 15));
+            out[2 * i + 1] = (int16_t)(a[1] + (((b[1] - a[1]) * t) >> 15));
+            frac += step;
+        }
+        return n;
+    }
+};
+
+// decoder thread -> ring -> mixer. Only the decoder writes `written` and
+// only the mixer writes `consumed`; a restart moves `flushTo` instead of
+// touching the mixer's position.
+struct MusicStream {
+    MusicDecoder dec;                           // decoder thread only
+    std::vector<int16_t> ring;                  // MUSIC_RING stereo frames
+    std::atomic<uint64_t> written{ 0 }, consumed{ 0 }, flushTo{ 0 };
+    std::atomic<bool> restart{ false }, ended{ false }, quit{ false };
+    // commands: target gain and ramp, published by bumping seq
+    std::atomic<float> target{ 0.0f }, rampMs{ 0.0f };
+    std::atomic<uint32_t> seq{ 0 };
+    std::atomic<long long> playUs{ 0 };
+    // mixer side
+    float gain = 0.0f, goal = 0.0f, step = 0.0f;
+    uint32_t seenSeq = 0;
+    bool timing = false;
+    // stats
+    std::atomic<float> startupMs{ -1.0f };
+    std::atomic<uint64_t> underruns{ 0 };       // frames of silence while it should have played
+    bool ok = false;
+    std::thread decoder;
+};
+MusicStream music;
+
+void musicDecoderMain(MusicStream& ms) {
+    while (!ms.quit.load(std::memory_order_acquire)) {
+        if (ms.restart.load(std::memory_order_acquire)) {
+            ms.dec.restart();
+            ms.ended.store(false, std::memory_order_relaxed);
+            ms.flushTo.store(ms.written.load(std::memory_order_relaxed), std::memory_order_release);
+            ms.restart.store(false, std::memory_order_release);
+        }
+        uint64_t w = ms.written.load(std::memory_order_relaxed);
+        uint64_t rd = (std::max)(ms.consumed.load(std::memory_order_acquire), ms.flushTo.load(std::memory_order_relaxed));
+        uint64_t room = MUSIC_RING - (w - rd);
+        if (room < MUSIC_CHUNK || ms.ended.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        // one contiguous piece of the ring
+        uint32_t at = (uint32_t)(w & (MUSIC_RING - 1));
+        int want = (std::min)(MUSIC_CHUNK, MUSIC_RING - (int)at);
+        int got = ms.dec.fill(&ms.ring[2 * at], want);
+        if (got < want) ms.ended.store(true, std::memory_order_relaxed);
+        ms.written.store(w + got, std::memory_order_release);
+    }
+}
+
+bool musicOpen(MusicStream& ms, const char* path, bool loop) {
+    if (!ms.dec.open(path, loop)) return false;
+    ms.ring.assign((size_t)MUSIC_RING * 2, 0);
+    ms.restart.store(true);
+    ms.quit.store(false);
+    ms.decoder = std::thread(musicDecoderMain, std::ref(ms));
+    return ms.ok = true;
+}
+
+void musicClose(MusicStream& ms) {
+    ms.quit.store(true, std::memory_order_release);
+    if (ms.decoder.joinable()) ms.decoder.join();
+    ms.dec.wav.close();
+    ms.ok = false;
+}
+
+// any thread; from silence the track starts again from the top
+void musicPlay(MusicStream& ms, float volume, float rampMs) {
+    ms.playUs.store(nowUs(), std::memory_order_relaxed);
+    ms.target.store(volume, std::memory_order_relaxed);
+    ms.rampMs.store(rampMs, std::memory_order_relaxed);
+    ms.seq.fetch_add(1, std::memory_order_release);
+}
+
+void musicStop(MusicStream& ms, float rampMs) { musicPlay(ms, 0.0f, rampMs); }
+
+// adds n frames of the music into out (float stereo)
+void musicMix(MusicStream& ms, float* out, int n) {
+    uint32_t s = ms.seq.load(std::memory_order_acquire);
+    if (s != ms.seenSeq) {
+        ms.seenSeq = s;
+        bool silent = ms.gain == 0.0f && ms.goal == 0.0f;
+        ms.goal = ms.target.load(std::memory_order_relaxed);
+        float frames = (std::max)(1.0f, ms.rampMs.load(std::memory_order_relaxed) * (AUDIO_RATE / 1000.0f));
+        ms.step = (ms.goal - ms.gain) / frames;
+        if (silent && ms.goal > 0.0f) {
+            ms.restart.store(true, std::memory_order_release);
+            ms.timing = true;
+        }
+    }
+    if (ms.gain == 0.0f && ms.goal == 0.0f) return;
+    if (ms.restart.load(std::memory_order_acquire)) return; // the decoder hasn't rewound yet
+
+    uint64_t rd = (std::max)(ms.consumed.load(std::memory_order_relaxed), ms.flushTo.load(std::memory_order_acquire));
+    int m = (int)(std::min)((uint64_t)n, ms.written.load(std::memory_order_acquire) - rd);
+    const float scale = 1.0f / 32768.0f;
+    for (int i = 0; i < n; i++) {
+        if (ms.gain != ms.goal) {
+            ms.gain += ms.step;
+            if ((ms.step > 0.0f) == (ms.gain > ms.goal)) ms.gain = ms.goal;
+        }
+        if (i >= m) continue;
+        const int16_t* f = &ms.ring[2 * ((rd + i) & (MUSIC_RING - 1))];
+        out[2 * i] += f[0] * scale * ms.gain;
+        out[2 * i + 1] += f[1] * scale * ms.gain;
+    }
+    ms.consumed.store(rd + m, std::memory_order_release);
+    if (m < n && !ms.ended.load(std::memory_order_relaxed)) ms.underruns.fetch_add(n - m, std::memory_order_relaxed);
+    if (ms.timing && m > 0) {
+        ms.timing = false;
+        ms.startupMs.store((nowUs() - ms.playUs.load(std::memory_order_relaxed)) * 0.001f, std::memory_order_relaxed);
+    }
+}
+
+// -------------------------------
+// Sound effects: whole clips in memory, played on a fixed set of voices.
+// Triggers come from the simulation thread through a queue that the mixer
+// drains each period. A repeat inside its sound's coalescing window is
+// dropped at the trigger. A sound over its instance cap restarts its
+// oldest voice. With every voice busy, a trigger takes the voice of the
+// lowest priority at or below its own, oldest first, or is dropped. A
+// period mixes at most audioVoices voices and starts at most SOUND_QUEUE
+// triggers, however many events fire.
+// -------------------------------
+enum SoundId : uint8_t { SND_HIT, SND_COLLECT, SND_WIN, SND_LOSE, SND_COUNT };
+
+struct SoundDef {
+    const char* file;
+    uint8_t priority, maxInstances;
+    float coalesceMs, volume;
+};
+const SoundDef soundDefs[SND_COUNT] = {
+    { "hit.wav",     2, 3, 60.0f, 1.0f },
+    { "collect.wav", 1, 4, 40.0f, 0.8f },
+    { "win.wav",     3, 1,  0.0f, 1.0f },
+    { "lose.wav",    3, 1,  0.0f, 1.0f },
+};
+const int MAX_VOICES = 32;
+const size_t SOUND_QUEUE = 64;
+int audioVoices = 6; // polyphony (--voices), at most MAX_VOICES
+
+struct AudioClip {
+    const int16_t* samples = NULL; // stereo at AUDIO_RATE: in the archive, or in pcm
+    std::vector<int16_t> pcm;
+    uint32_t frames = 0;
+};
+
+struct Voice {
+    const AudioClip* clip;
+    uint32_t pos, age;
+    float gain;
+    uint8_t id, priority;
+    bool on;
+};
+
+struct SoundMixer {
+    AudioClip clips[SND_COUNT];
+    SpscRing<uint8_t, SOUND_QUEUE> triggers;
+    long long lastUs[SND_COUNT] = {}; // trigger side
+    Voice voices[MAX_VOICES] = {};    // mixer side
+    uint32_t started = 0;
+    // stats
+    std::atomic<unsigned long long> played{ 0 }, coalesced{ 0 }, capped{ 0 }, stolen{ 0 }, dropped{ 0 };
+    std::atomic<unsigned long long> playedBy[SND_COUNT] = {};
+    std::atomic<int> active{ 0 }, peak{ 0 };
+};
+SoundMixer sfx;
+
+bool loadClip(AudioClip& c, const char* path) {
+    static MusicDecoder dec; // not thread safe: clips load before the output thread starts
+    if (!dec.open(path, false)) return false;
+    std::vector<int16_t>().swap(c.pcm);
+    const AssetFile& src = dec.wav.file;
+    if (src.mem && dec.wav.rate == AUDIO_RATE && dec.wav.channels == 2 && !(dec.wav.dataAt & 1)) {
+        // already in the mixer's format: play it where it lies
+        c.samples = (const int16_t*)(src.mem + dec.wav.dataAt);
+        c.frames = dec.wav.frames;
+    }
+    else {
+        int16_t chunk[MUSIC_CHUNK * 2];
+        c.pcm.reserve(((uint64_t)dec.wav.frames * AUDIO_RATE / dec.wav.rate + 1) * 2);
+        for (int n; (n = dec.fill(chunk, MUSIC_CHUNK)) > 0;) c.pcm.insert(c.pcm.end(), chunk, chunk + 2 * n);
+        c.samples = c.pcm.data();
+        c.frames = (uint32_t)(c.pcm.size() / 2);
+    }
+    dec.wav.close();
+    return c.frames > 0;
+}
+
+// trigger side (one thread); `nowUs` is the clock the coalescing windows use
+void playSound(SoundMixer& sm, SoundId id, long long nowUs) {
+    if (nowUs - sm.lastUs[id] < (long long)(soundDefs[id].coalesceMs * 1000.0f)) {
+        sm.coalesced.fetch_add(1, std::memory_order_relaxed);
         return;
     }
-    mciSendString(L"play se from 0 wait", NULL, 0, NULL);  // waits for clip to finish
-    mciSendString(L"close se", NULL, 0, NULL);
+    sm.lastUs[id] = nowUs;
+    if (!sm.triggers.push(id)) sm.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void startVoice(SoundMixer& sm, SoundId id) {
+    const SoundDef& d = soundDefs[id];
+    if (!sm.clips[id].frames) return;
+    Voice *slot = NULL, *oldest = NULL, *victim = NULL;
+    int same = 0;
+    for (int i = 0; i < audioVoices; i++) {
+        Voice& v = sm.voices[i];
+        if (!v.on) { if (!slot) slot = &v; continue; }
+        if (v.id == id && (same++, !oldest || v.age < oldest->age)) oldest = &v;
+        if (v.priority <= d.priority &&
+            (!victim || v.priority < victim->priority || (v.priority == victim->priority && v.age < victim->age))) victim = &v;
+    }
+    if (same >= d.maxInstances) { slot = oldest; sm.capped.fetch_add(1, std::memory_order_relaxed); }
+    else if (!slot) {
+        if (!victim) { sm.dropped.fetch_add(1, std::memory_order_relaxed); return; }
+        slot = victim;
+        sm.stolen.fetch_add(1, std::memory_order_relaxed);
+    }
+    *slot = { &sm.clips[id], 0, sm.started++, d.volume, id, d.priority, true };
+    sm.played.fetch_add(1, std::memory_order_relaxed);
+    sm.playedBy[id].fetch_add(1, std::memory_order_relaxed);
+}
+
+// adds n frames of the playing effects into out (float stereo)
+void sfxMix(SoundMixer& sm, float* out, int n) {
+    uint8_t id;
+    while (sm.triggers.pop(id)) startVoice(sm, (SoundId)id);
+    int mixed = 0;
+    for (int i = 0; i < audioVoices; i++) {
+        Voice& v = sm.voices[i];
+        if (!v.on) continue;
+        int k = (int)(std::min)((uint32_t)n, v.clip->frames - v.pos);
+        const int16_t* src = v.clip->samples + 2 * v.pos;
+        float g = v.gain * (1.0f / 32768.0f);
+        for (int j = 0; j < 2 * k; j++) out[j] += src[j] * g;
+        v.pos += k;
+        v.on = v.pos < v.clip->frames;
+        mixed++;
+    }
+    sm.active.store(mixed, std::memory_order_relaxed);
+    if (mixed > sm.peak.load(std::memory_order_relaxed)) sm.peak.store(mixed, std::memory_order_relaxed);
+}
+
+static inline void audioToPcm(const float* mix, int16_t* out, int samples) {
+    for (int i = 0; i < samples; i++) out[i] = (int16_t)(std::max)(-32768.0f, (std::min)(32767.0f, mix[i] * 32768.0f));
+}
+
+// the final mix, 16-bit stereo
+void audioMix(int16_t* out, int n) {
+    float mix[AUDIO_PERIOD * 2];
+    for (int at = 0; at < n; at += AUDIO_PERIOD) {
+        int k = (std::min)(AUDIO_PERIOD, n - at);
+        memset(mix, 0, sizeof(float) * 2 * k);
+        if (music.ok) musicMix(music, mix, k);
+        sfxMix(sfx, mix, k);
+        audioToPcm(mix, out + 2 * at, 2 * k);
+    }
+}
+
+// the output thread: waveOut on Windows, ALSA (loaded at run time, so the
+// build needs no audio headers) elsewhere, and a paced null device when
+// neither opens, so the music still advances in step with real time
+struct AudioOut {
+    std::thread thread;
+    std::atomic<bool> quit{ false };
+    const char* device = "none";
+    std::atomic<unsigned long long> periods{ 0 };
+    std::atomic<double> mixUs{ 0.0 }; // total time in audioMix
+};
+AudioOut audioOut;
+
+static void audioPeriod(AudioOut& ao, int16_t* buf) {
+    long long t0 = nowUs();
+    audioMix(buf, AUDIO_PERIOD);
+    ao.mixUs.store(ao.mixUs.load(std::memory_order_relaxed) + (nowUs() - t0), std::memory_order_relaxed);
+    ao.periods.fetch_add(1, std::memory_order_relaxed);
+}
+
+#ifdef _WIN32
+static bool audioOutWaveOut(AudioOut& ao) {
+    WAVEFORMATEX fmt = { WAVE_FORMAT_PCM, 2, AUDIO_RATE, AUDIO_RATE * 4, 4, 16, 0 };
+    HWAVEOUT wo;
+    if (waveOutOpen(&wo, WAVE_MAPPER, &fmt, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR) return false;
+    ao.device = "waveOut";
+    startup.mark("audio device open", true);
+    const int BUFS = 4;
+    static int16_t bufs[BUFS][AUDIO_PERIOD * 2];
+    WAVEHDR hdr[BUFS] = {};
+    for (int i = 0; i < BUFS; i++) {
+        hdr[i].lpData = (LPSTR)bufs[i];
+        hdr[i].dwBufferLength = sizeof(bufs[i]);
+        waveOutPrepareHeader(wo, &hdr[i], sizeof(WAVEHDR));
+        hdr[i].dwFlags |= WHDR_DONE;
+    }
+    while (!ao.quit.load(std::memory_order_acquire)) {
+        for (int i = 0; i < BUFS; i++)
+            if (hdr[i].dwFlags & WHDR_DONE) {
+                audioPeriod(ao, bufs[i]);
+                waveOutWrite(wo, &hdr[i], sizeof(WAVEHDR));
+            }
+        Sleep(2);
+    }
+    waveOutReset(wo);
+    for (int i = 0; i < BUFS; i++) waveOutUnprepareHeader(wo, &hdr[i], sizeof(WAVEHDR));
+    waveOutClose(wo);
+    return true;
+}
+#else
+static bool audioOutAlsa(AudioOut& ao) {
+    void* lib = dlopen("libasound.so.2", RTLD_NOW);
+    if (!lib) return false;
+    typedef int (*OpenFn)(void**, const char*, int, int);
+    typedef int (*ParamsFn)(void*, int, int, unsigned, unsigned, int, unsigned);
+    typedef long (*WriteFn)(void*, const void*, unsigned long);
+    typedef int (*RecoverFn)(void*, int, int);
+    typedef int (*CloseFn)(void*);
+    OpenFn open = (OpenFn)dlsym(lib, "snd_pcm_open");
+    ParamsFn params = (ParamsFn)dlsym(lib, "snd_pcm_set_params");
+    WriteFn write = (WriteFn)dlsym(lib, "snd_pcm_writei");
+    RecoverFn recover = (RecoverFn)dlsym(lib, "snd_pcm_recover");
+    CloseFn close = (CloseFn)dlsym(lib, "snd_pcm_close");
+    void* pcm = NULL;
+    // playback, S16_LE, interleaved read/write access, 50 ms of latency
+    if (!open || !params || !write || !recover || !close || open(&pcm, "default", 0, 0) < 0) { dlclose(lib); return false; }
+    if (params(pcm, 2, 3, 2, AUDIO_RATE, 1, 50000) < 0) { close(pcm); dlclose(lib); return false; }
+    ao.device = "ALSA";
+    startup.mark("audio device open", true);
+    int16_t buf[AUDIO_PERIOD * 2];
+    while (!ao.quit.load(std::memory_order_acquire)) {
+        audioPeriod(ao, buf);
+        long r = write(pcm, buf, AUDIO_PERIOD); // blocks while the device is full
+        if (r < 0) recover(pcm, (int)r, 1);
+    }
+    close(pcm);
+    dlclose(lib);
+    return true;
+}
+#endif
+
+static void audioOutNull(AudioOut& ao) {
+    startup.mark("no audio device, mixing to nothing", true);
+    int16_t buf[AUDIO_PERIOD * 2];
+    auto next = std::chrono::steady_clock::now();
+    const auto period = std::chrono::microseconds(1000000LL * AUDIO_PERIOD / AUDIO_RATE);
+    while (!ao.quit.load(std::memory_order_acquire)) {
+        audioPeriod(ao, buf);
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void audioOutMain(AudioOut& ao) {
+#ifdef _WIN32
+    if (audioOutWaveOut(ao)) return;
+#else
+    if (audioOutAlsa(ao)) return;
+#endif
+    audioOutNull(ao);
+}
+
+// the whole audio side, run by startAudioAsync off the main thread: the
+// game only reads `music`, `sfx` and `assets` once audioInit is ready
+void startAudio() {
+    if (assets.open(assetArchivePath)) {
+        printf("Assets: %s, %u entries\n", assetArchivePath, assets.count);
+        startup.mark("asset archive mapped", true);
+    }
+    if (musicOpen(music, musicPath, true)) startup.mark("music stream open", true);
+    else printf("Music: cannot open %s (16-bit PCM WAV)\n", musicPath);
+    audioVoices = (std::max)(1, (std::min)(audioVoices, MAX_VOICES));
+    for (int i = 0; i < SND_COUNT; i++)
+        if (!loadClip(sfx.clips[i], soundDefs[i].file)) printf("Sound: cannot load %s (16-bit PCM WAV)\n", soundDefs[i].file);
+    startup.mark("effects decoded", true);
+    audioOut.thread = std::thread(audioOutMain, std::ref(audioOut));
+}
 
+std::shared_future<void> audioInit;
+
+void startAudioAsync() { audioInit = std::async(std::launch::async, startAudio).share(); }
+static inline bool audioReady() { return isReady(audioInit); }
+
+void stopAudio() {
+    if (audioInit.valid()) audioInit.wait();
+    audioOut.quit.store(true, std::memory_order_release);
+    if (audioOut.thread.joinable()) audioOut.thread.join();
+    if (music.ok) musicClose(music);
+    assets.close();
 }
 
+// music commands are atomics the mixer takes whenever it comes up, so a
+// round never waits for the audio to start
+void playBackgroundMusic() { musicPlay(music, musicVolume, musicFadeInMs); }
+
+void stopBackgroundMusic() { musicStop(music, musicFadeOutMs); }
+
+// effects fired before the audio is up are dropped, not played late
+void playSoundEffect(SoundId id) { if (audioReady()) playSound(sfx, id, nowUs()); }
+
 
 
 
@@ -56,10 +860,140 @@ void playSoundEffect(const char* file) {
 // -------------------------------
 struct Vec2 { float x, y; };
 
+// -------------------------------
+// Heap allocation counter: every operator new goes through here, so the
+// --alloc-check mode and the in-game report can prove that running ticks
+// and frames do not allocate. The whole family is replaced (array,
+// nothrow, aligned and sized forms) so no allocation slips past the count
+// and every delete frees with the allocator its new used.
+// -------------------------------
+std::atomic<unsigned long long> heapAllocs{ 0 };
+
+#if defined(__GNUC__)
+#define HEAP_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define HEAP_NOINLINE __declspec(noinline)
+#else
+#define HEAP_NOINLINE
+#endif
+
+// out of line so the compiler never pairs an inlined new with a bare free()
+HEAP_NOINLINE static void* heapAlloc(size_t n, size_t align) noexcept {
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    if (!n) n = 1;
+    if (align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__) return malloc(n);
+#ifdef _WIN32
+    return _aligned_malloc(n, align);
+#else
+    void* p = nullptr;
+    return posix_memalign(&p, align, n) ? nullptr : p;
+#endif
+}
+HEAP_NOINLINE static void heapFree(void* p, size_t align) noexcept {
+#ifdef _WIN32
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__) { _aligned_free(p); return; }
+#else
+    (void)align;
+#endif
+    free(p);
+}
+static void* heapAllocOrThrow(size_t n, size_t align) {
+    if (void* p = heapAlloc(n, align)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t n) { return heapAllocOrThrow(n, 0); }
+void* operator new[](size_t n) { return heapAllocOrThrow(n, 0); }
+void* operator new(size_t n, std::align_val_t a) { return heapAllocOrThrow(n, (size_t)a); }
+void* operator new[](size_t n, std::align_val_t a) { return heapAllocOrThrow(n, (size_t)a); }
+void* operator new(size_t n, const std::nothrow_t&) noexcept { return heapAlloc(n, 0); }
+void* operator new[](size_t n, const std::nothrow_t&) noexcept { return heapAlloc(n, 0); }
+void* operator new(size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return heapAlloc(n, (size_t)a); }
+void* operator new[](size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return heapAlloc(n, (size_t)a); }
+
+void operator delete(void* p) noexcept { heapFree(p, 0); }
+void operator delete[](void* p) noexcept { heapFree(p, 0); }
+void operator delete(void* p, size_t) noexcept { heapFree(p, 0); }
+void operator delete[](void* p, size_t) noexcept { heapFree(p, 0); }
+void operator delete(void* p, std::align_val_t a) noexcept { heapFree(p, (size_t)a); }
+void operator delete[](void* p, std::align_val_t a) noexcept { heapFree(p, (size_t)a); }
+void operator delete(void* p, size_t, std::align_val_t a) noexcept { heapFree(p, (size_t)a); }
+void operator delete[](void* p, size_t, std::align_val_t a) noexcept { heapFree(p, (size_t)a); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { heapFree(p, 0); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { heapFree(p, 0); }
+void operator delete(void* p, std::align_val_t a, const std::nothrow_t&) noexcept { heapFree(p, (size_t)a); }
+void operator delete[](void* p, std::align_val_t a, const std::nothrow_t&) noexcept { heapFree(p, (size_t)a); }
+
 static inline float dist(const Vec2& a, const Vec2& b) {
     float dx = a.x - b.x, dy = a.y - b.y; return sqrtf(dx * dx + dy * dy);
 }
 
+// -------------------------------
+// Simulation numbers: the core of a tick (movement, target curve,
+// collisions, timer carry) computes in `Real`. Building with SIM_FIXED
+// makes Real a 16.16 fixed-point number with integer sqrt, so the same
+// inputs give bit-identical states whatever the compiler, flags or FPU.
+// State stays in float fields. The conversions are deterministic but not
+// exact: float -> fixed truncates below 2^-16, and fixed -> float rounds to
+// float's 24-bit mantissa, which drops fraction bits above 256 px.
+// -------------------------------
+#ifdef SIM_FIXED
+struct Fixed {
+    // 16 fraction bits in 64: large worlds (past 32768 px) don't fit Q16.16 in 32 bits
+    static const int FRAC = 16;
+    int64_t raw = 0;
+    Fixed() {}
+    Fixed(int v) : raw((int64_t)v * (1 << FRAC)) {}
+    explicit Fixed(float f) : raw((int64_t)(f * (float)(1 << FRAC))) {}
+    static Fixed fromRaw(int64_t r) { Fixed f; f.raw = r; return f; }
+};
+static inline Fixed operator+(Fixed a, Fixed b) { return Fixed::fromRaw(a.raw + b.raw); }
+static inline Fixed operator-(Fixed a, Fixed b) { return Fixed::fromRaw(a.raw - b.raw); }
+static inline Fixed operator-(Fixed a) { return Fixed::fromRaw(-a.raw); }
+static inline Fixed operator*(Fixed a, Fixed b) { return Fixed::fromRaw((a.raw * b.raw) >> Fixed::FRAC); }
+static inline Fixed operator/(Fixed a, Fixed b) { return Fixed::fromRaw((a.raw * (1 << Fixed::FRAC)) / b.raw); }
+static inline Fixed& operator+=(Fixed& a, Fixed b) { a.raw += b.raw; return a; }
+static inline Fixed& operator-=(Fixed& a, Fixed b) { a.raw -= b.raw; return a; }
+static inline bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+static inline bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+static inline bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+static inline bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+
+typedef Fixed Real;
+static inline float toFloat(Real r) { return (float)r.raw * (1.0f / (1 << Fixed::FRAC)); }
+static inline uint32_t wholePart(Real r) { return (uint32_t)(r.raw >> Fixed::FRAC); } // r >= 0
+// bit-by-bit integer square root of raw << FRAC
+static inline Real realSqrt(Real r) {
+    if (r.raw <= 0) return Real(0);
+    uint64_t v = (uint64_t)r.raw << Fixed::FRAC, root = 0, bit = 1ull << 62;
+    while (bit > v) bit >>= 2;
+    while (bit) {
+        if (v >= root + bit) { v -= root + bit; root = (root >> 1) + bit; }
+        else root >>= 1;
+        bit >>= 2;
+    }
+    return Fixed::fromRaw((int64_t)root);
+}
+const char* const SIM_MATH = "fixed 16.16";
+#else
+typedef float Real;
+static inline float toFloat(Real r) { return r; }
+static inline uint32_t wholePart(Real r) { return (uint32_t)r; }
+static inline Real realSqrt(Real r) { return sqrtf(r); }
+const char* const SIM_MATH = "float";
+#endif
+
+struct RVec { Real x, y; };
+static inline RVec toReal(const Vec2& v) { return { Real(v.x), Real(v.y) }; }
+static inline Vec2 toVec2(const RVec& v) { return { toFloat(v.x), toFloat(v.y) }; }
+
+// |a - b| <= r without the sqrt; the box test first keeps fixed-point squares small
+static inline bool within(const RVec& a, const RVec& b, Real r) {
+    Real dx = a.x - b.x, dy = a.y - b.y;
+    if (dx > r || dx < -r || dy > r || dy < -r) return false;
+    return dx * dx + dy * dy <= r * r;
+}
+
 // -------------------------------
 // Print on screen (instructor function equivalent)
 // -------------------------------
@@ -70,8 +1004,16 @@ void print_on_screen(int x, int y, const char* s) {
 }
 
 // -------------------------------
-// Bezier (safe float version)
+// Bezier (safe float version; bezierPointReal is the simulation's)
 // -------------------------------
+RVec bezierPointReal(Real t, const int p0[2], const int p1[2], const int p2[2], const int p3[2]) {
+    Real u = Real(1) - t;
+    Real tt = t * t, uu = u * u;
+    Real a = uu * u, b = Real(3) * uu * t, c = Real(3) * u * tt, d = tt * t;
+    return { a * Real(p0[0]) + b * Real(p1[0]) + c * Real(p2[0]) + d * Real(p3[0]),
+             a * Real(p0[1]) + b * Real(p1[1]) + c * Real(p2[1]) + d * Real(p3[1]) };
+}
+
 void bezier_point_float(float t, const int p0[2], const int p1[2], const int p2[2], const int p3[2], float out[2]) {
     float u = 1.0f - t;
     float tt = t * t;
@@ -100,623 +1042,5333 @@ const int GAME_Y1 = WIN_H - TOP_H;
 // -------------------------------
 // Game state
 // -------------------------------
-bool running = false;
-bool showEnd = false;
-bool playerWon = false;
+const int totalTime = 120;     // total seconds
+const float playerRadius = 18.0f;
+const float baseSpeed = 200.0f; // px / sec
+const float obstacleRadius = 20.0f;
+const float collectibleRadius = 12.0f;
+const float powerUpRadius = 14.0f;
+const int collectScore = 5;
+
+// objects (takenRound: round in which a pickup was collected, 0 = never)
+struct Obstacle { Vec2 p; float r; };
+struct Collectible { Vec2 p; float r; uint32_t takenRound; float rot; };
+struct PowerUp { Vec2 p; float r; int type; uint32_t takenRound; float phase; };
 
-int totalTime = 120;     // total seconds
-int remainingTime = totalTime;
-int playerScore = 0;
-int playerLives = 5;
+// -------------------------------
+// Entity storage: one arena per kind, sized when a level is loaded or
+// built, with generation-counted handles. clear() is an O(1) rewind and
+// copying into an existing pool reuses its memory.
+// -------------------------------
+struct EntityHandle { uint32_t index, gen; };
 
-Vec2 playerPos, playerDir = { 1.0f, 0.0f };
-float playerRadius = 18.0f;
-float baseSpeed = 200.0f; // px / sec
+template <class T>
+class EntityPool {
+public:
+    EntityPool() {}
+    EntityPool(const EntityPool& o) { *this = o; }
+    EntityPool& operator=(const EntityPool& o) {
+        if (this == &o) return *this;
+        reserve(o.count);
+        std::copy(o.items.begin(), o.items.begin() + o.count, items.begin());
+        std::copy(o.gens.begin(), o.gens.begin() + o.count, gens.begin());
+        count = o.count;
+        nextGen = (std::max)(nextGen, o.nextGen);
+        return *this;
+    }
 
-// powerups
-bool speedActive = false; float speedTimer = 0.0f;
-bool doubleActive = false; float doubleTimer = 0.0f;
+    void reserve(size_t n) {
+        if (n > items.size()) { items.resize(n); gens.resize(n); }
+    }
+    // grows only when placing past capacity (editor / level load, never during a tick)
+    EntityHandle add(const T& v) {
+        if (count == items.size()) reserve(items.empty() ? 256 : items.size() * 2);
+        items[count] = v;
+        gens[count] = ++nextGen;
+        EntityHandle h = { (uint32_t)count, gens[count] };
+        count++;
+        return h;
+    }
+    // shifts the tail up one slot; handles into the tail go stale
+    EntityHandle insert(size_t at, const T& v) {
+        add(v);
+        std::rotate(items.begin() + at, items.begin() + count - 1, items.begin() + count);
+        std::rotate(gens.begin() + at, gens.begin() + count - 1, gens.begin() + count);
+        return handle(at);
+    }
+    // n at once, with one shift of the tail
+    void insert(size_t at, const T* v, size_t n) {
+        for (size_t i = 0; i < n; i++) add(v[i]);
+        std::rotate(items.begin() + at, items.begin() + count - n, items.begin() + count);
+        std::rotate(gens.begin() + at, gens.begin() + count - n, gens.begin() + count);
+    }
+    // the last entity moves into slot i; handles to both die
+    void swapRemove(size_t i) {
+        items[i] = items[count - 1];
+        gens[i] = ++nextGen;
+        count--;
+    }
+    // keeps the order: the tail shifts down one slot and its handles go stale
+    void erase(size_t at) { eraseIf([at](size_t i) { return i == at; }); }
+    // erase() for every slot `dead(i)` names, in one pass
+    template <class Fn>
+    void eraseIf(Fn dead) {
+        size_t to = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (dead(i)) continue;
+            if (to != i) { items[to] = items[i]; gens[to] = ++nextGen; }
+            to++;
+        }
+        count = to;
+    }
+    void swap(EntityPool& o) {
+        items.swap(o.items); gens.swap(o.gens);
+        std::swap(count, o.count); std::swap(nextGen, o.nextGen);
+    }
+    T* get(EntityHandle h) { return h.index < count && gens[h.index] == h.gen ? &items[h.index] : NULL; }
+    EntityHandle handle(size_t i) const { return { (uint32_t)i, gens[i] }; }
+    // old handles die: their slot is either past the end or re-stamped by add()
+    void clear() { count = 0; }
+    void pop() { count--; }
 
-// invulnerability after hitting obstacle
-float invulnTimer = 0.0f; // seconds
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t capacity() const { return items.size(); }
+    T& operator[](size_t i) { return items[i]; }
+    const T& operator[](size_t i) const { return items[i]; }
+    T* begin() { return items.data(); }
+    T* end() { return items.data() + count; }
+    const T* begin() const { return items.data(); }
+    const T* end() const { return items.data() + count; }
 
-// timing
-int prevTimeMs = 0;
-float accumSec = 0.0f;
+private:
+    std::vector<T> items;
+    std::vector<uint32_t> gens;
+    size_t count = 0;
+    uint32_t nextGen = 0;
+};
 
-// placement mode
-enum PlaceMode { NONE_MODE = 0, OBSTACLE_MODE, COLLECT_MODE, POWER1_MODE, POWER2_MODE };
-PlaceMode currentMode = NONE_MODE;
+// -------------------------------
+// Gameplay events: collisions and state changes are recorded as compact
+// events into a per-tick buffer; subscribers drain them in one batch each
+// -------------------------------
+enum GameEventType : uint8_t { EV_HIT, EV_COLLECT, EV_POWERUP, EV_ROUND_END, EV_EXPIRE, EV_TYPE_COUNT };
 
-// objects
-struct Obstacle { Vec2 p; float r; };
-struct Collectible { Vec2 p; float r; bool active; float rot; };
-struct PowerUp { Vec2 p; float r; int type; bool active; float phase; };
+struct GameEvent {
+    uint8_t type;    // GameEventType
+    uint8_t arg;     // power-up type / 1 if the round was won / TimerKind
+    uint16_t pad;
+    uint32_t entity; // index in its pool
+    uint32_t before; // pickups: takenRound before this event (lets rewind undo it)
+    Vec2 at;
+};
 
-std::vector<Obstacle> obstacles;
-std::vector<Collectible> collectibles;
-std::vector<PowerUp> powerups;
+// SUB_SCORE runs inside stepGame (headless too); the rest only in the game
+enum { SUB_SCORE, SUB_AUDIO, SUB_EFFECTS, SUB_TELEMETRY, SUB_REPLAY, SUB_MINIMAP, SUB_COUNT };
 
-// bezier target (integers for compatibility with instructor code)
-int bz_p0[2], bz_p1[2], bz_p2[2], bz_p3[2];
-float bezT = 0.0f;
-float bezSpeed = 0.12f; // t units per second
-Vec2 targetPos;
+struct EventBus {
+    static const int CAP = 256;
+    GameEvent events[CAP];
+    int count = 0;
+    unsigned long long emitted = 0, dropped = 0;
+    // drain cost per subscriber
+    double subMs[SUB_COUNT] = {};
+    unsigned long long subEvents[SUB_COUNT] = {}, subBatches[SUB_COUNT] = {};
 
-// keyboard state
-bool keyLeft = false, keyRight = false, keyUp = false, keyDown = false;
+    void emit(uint8_t type, uint8_t arg, uint32_t entity, Vec2 at, uint32_t before = 0) {
+        if (count == CAP) { dropped++; return; }
+        events[count++] = { type, arg, 0, entity, before, at };
+        emitted++;
+    }
+};
 
 // -------------------------------
-// Utility drawing helpers
+// Timers: hierarchical timing wheel, 4 levels x 64 slots at 1 ms
+// resolution (~4.6 h range). Schedule, reschedule and cancel are O(1);
+// advancing visits one slot per elapsed ms plus amortised cascades, no
+// matter how many timers are pending.
 // -------------------------------
-void drawCircle(const Vec2& c, float r, int seg = 32) {
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex2f(c.x, c.y);
-    for (int i = 0; i <= seg; i++) {
-        float a = (float)i / seg * 2.0f * 3.14159265358979323846f;
-        glVertex2f(c.x + cosf(a) * r, c.y + sinf(a) * r);
+struct TimerId { int32_t index = -1; uint32_t gen = 0; };
+
+class TimerWheel {
+public:
+    static const int BITS = 6, SLOTS = 1 << BITS, LEVELS = 4;
+
+    TimerWheel() { clear(); }
+    // drop every timer and restart the clock; node memory is kept
+    void clear() {
+        for (auto& level : heads) for (auto& h : level) h = -1;
+        occupied0 = 0;
+        for (auto& n : nodes) n.gen++; // outstanding ids go stale
+        freeHead = -1;
+        for (int i = (int)nodes.size() - 1; i >= 0; i--) { nodes[i].armed = false; nodes[i].next = freeHead; freeHead = i; }
+        now = 0;
+        live = 0;
     }
-    glEnd();
-}
+    void reserve(size_t n) { nodes.reserve(n); }
+    uint32_t time() const { return now; }
+    size_t size() const { return live; }
 
-void drawStringCentered(int x, int y, const char* s) {
-    print_on_screen(x - (int)strlen(s) * 6, y, s);
-}
+    TimerId schedule(uint32_t delayMs, uint8_t kind, uint32_t arg) {
+        int32_t i;
+        if (freeHead >= 0) { i = freeHead; freeHead = nodes[i].next; }
+        else { i = (int32_t)nodes.size(); nodes.push_back(Node()); }
+        Node& n = nodes[i];
+        n.due = now + (std::max)(1u, delayMs);
+        n.kind = kind; n.arg = arg; n.armed = true;
+        link(i);
+        live++;
+        return { i, n.gen };
+    }
+    bool active(TimerId id) const {
+        return id.index >= 0 && id.index < (int32_t)nodes.size() && nodes[id.index].gen == id.gen && nodes[id.index].armed;
+    }
+    uint32_t remaining(TimerId id) const { return active(id) ? nodes[id.index].due - now : 0; }
+    bool cancel(TimerId id) {
+        if (!active(id)) return false;
+        unlink(id.index);
+        release(id.index);
+        return true;
+    }
+    bool reschedule(TimerId id, uint32_t delayMs) {
+        if (!active(id)) return false;
+        unlink(id.index);
+        nodes[id.index].due = now + (std::max)(1u, delayMs);
+        link(id.index);
+        return true;
+    }
 
-// -----------------------------------------------
-// Keep player within the playable area boundaries
-// -----------------------------------------------
-Vec2 clampToArea(Vec2 p) {
-    float pad = playerRadius + 2.0f;
-    if (p.x < pad) p.x = pad;
-    if (p.x > WIN_W - pad) p.x = WIN_W - pad;
-    if (p.y < GAME_Y0 + pad) p.y = GAME_Y0 + pad;
-    if (p.y > GAME_Y1 - pad) p.y = GAME_Y1 - pad;
-    return p;
-}
+    // move the clock forward; onExpire(kind, arg) may schedule new timers
+    template <class Fn>
+    void advance(uint32_t ms, Fn onExpire) {
+        while (ms) {
+            // skip straight over empty level-0 slots up to (not across) the next wrap
+            uint32_t pos = now & (SLOTS - 1);
+            uint32_t skip = (std::min)(ms, (uint32_t)(SLOTS - 1 - pos));
+            if (skip) {
+                uint64_t span = ((1ull << skip) - 1) << (pos + 1);
+                if (!(occupied0 & span)) { now += skip; ms -= skip; continue; }
+            }
+            ms--;
+            now++;
+            if ((now & (SLOTS - 1)) == 0) {
+                // a lower wheel wrapped: pull the next slot of each higher wheel down, top first
+                int l = 1;
+                while (l < LEVELS - 1 && ((now >> (BITS * l)) & (SLOTS - 1)) == 0) l++;
+                for (; l >= 1; l--) cascade(l, (now >> (BITS * l)) & (SLOTS - 1));
+            }
+            int32_t i = heads[0][now & (SLOTS - 1)];
+            heads[0][now & (SLOTS - 1)] = -1;
+            occupied0 &= ~(1ull << (now & (SLOTS - 1)));
+            while (i >= 0) {
+                int32_t next = nodes[i].next;
+                uint8_t kind = nodes[i].kind; uint32_t arg = nodes[i].arg;
+                release(i);
+                onExpire(kind, arg);
+                i = next;
+            }
+        }
+    }
+
+private:
+    struct Node {
+        uint32_t due = 0, gen = 0, arg = 0;
+        int32_t next = -1, prev = -1;
+        uint8_t kind = 0, level = 0, slot = 0;
+        bool armed = false;
+    };
+    std::vector<Node> nodes;
+    int32_t heads[LEVELS][SLOTS];
+    uint64_t occupied0 = 0; // bit s: level-0 slot s holds timers
+    int32_t freeHead = -1;
+    uint32_t now = 0;
+    size_t live = 0;
+
+    void link(int32_t i) {
+        Node& n = nodes[i];
+        uint32_t delta = n.due - now;
+        int l = 0;
+        while (l < LEVELS - 1 && delta >= (1u << (BITS * (l + 1)))) l++;
+        n.level = (uint8_t)l;
+        n.slot = (uint8_t)((n.due >> (BITS * l)) & (SLOTS - 1));
+        n.prev = -1;
+        n.next = heads[l][n.slot];
+        if (n.next >= 0) nodes[n.next].prev = i;
+        heads[l][n.slot] = i;
+        if (l == 0) occupied0 |= 1ull << n.slot;
+    }
+    void unlink(int32_t i) {
+        Node& n = nodes[i];
+        if (n.prev >= 0) nodes[n.prev].next = n.next; else heads[n.level][n.slot] = n.next;
+        if (n.next >= 0) nodes[n.next].prev = n.prev;
+        if (n.level == 0 && heads[0][n.slot] < 0) occupied0 &= ~(1ull << n.slot);
+    }
+    void release(int32_t i) {
+        Node& n = nodes[i];
+        n.armed = false;
+        n.gen++;
+        n.next = freeHead;
+        freeHead = i;
+        live--;
+    }
+    void cascade(int l, uint32_t slot) {
+        int32_t i = heads[l][slot];
+        heads[l][slot] = -1;
+        while (i >= 0) {
+            int32_t next = nodes[i].next;
+            link(i);
+            i = next;
+        }
+    }
+};
+
+// timed gameplay effects; repeated pickups either refresh or stack
+enum TimerKind : uint8_t {
+    TIMER_ROUND, TIMER_INVULN, TIMER_SPEED, TIMER_DOUBLE, TIMER_SHIELD, TIMER_MAGNET, TIMER_FREEZE, TIMER_KIND_COUNT
+};
+enum TimerStacking : uint8_t { TIMER_REFRESH, TIMER_STACK };
+struct TimedEffectDef { uint32_t durationMs; TimerStacking stacking; uint32_t capMs; };
+
+const TimedEffectDef timedEffects[TIMER_KIND_COUNT] = {
+    { totalTime * 1000, TIMER_REFRESH, 0 }, // round countdown
+    { 700, TIMER_REFRESH, 0 },              // small invulnerability after a hit
+    { 6000, TIMER_STACK, 18000 },           // speed boosts add up, to 18 s
+    { 8000, TIMER_REFRESH, 0 },             // double score restarts at 8 s
+    { 10000, TIMER_REFRESH, 0 },            // shield holds one hit for 10 s
+    { 8000, TIMER_REFRESH, 0 },             // magnet pulls collectibles in for 8 s
+    { 3000, TIMER_STACK, 9000 },            // time freeze stops the target, to 9 s
+};
 
 // -------------------------------
-// Overlap / placement helper
+// Power-up definitions: one row per type, indexed by the level file's type
+// number. The collision and draw loops are instantiated per type from this
+// table, so a new power-up is a row here (plus its timer and flag), not a
+// branch in the loops.
 // -------------------------------
-bool overlapsExisting(const Vec2& p, float r) {
-    for (auto& ob : obstacles) if (dist(p, ob.p) < r + ob.r + 6.0f) return true;
-    for (auto& c : collectibles) if (dist(p, c.p) < r + c.r + 6.0f) return true;
-    for (auto& pu : powerups) if (dist(p, pu.p) < r + pu.r + 6.0f) return true;
-    // avoid target and player
-    if (dist(p, targetPos) < r + 20.0f + 6.0f) return true;
-    if (dist(p, playerPos) < r + playerRadius + 6.0f) return true;
-    return false;
+enum PowerUpType : uint8_t { PU_SPEED = 1, PU_DOUBLE, PU_SHIELD, PU_MAGNET, PU_FREEZE, PU_TYPE_END };
+enum PowerUpShape : uint8_t { SHAPE_ORB, SHAPE_PENTAGON, SHAPE_RING, SHAPE_HORSESHOE, SHAPE_FLAKE };
+
+struct PowerUpDef {
+    const char* name;
+    TimerKind timer;     // effect started on pickup
+    PowerUpShape shape;
+    uint32_t color;      // body, 0xRRGGBB
+    uint32_t sparkle;    // ambient particles
+    uint32_t burst;      // pickup burst
+    float strength;      // speed / score multiplier, magnet reach in px
+};
+
+constexpr PowerUpDef powerUpDefs[PU_TYPE_END] = {
+    { "", TIMER_ROUND, SHAPE_ORB, 0, 0, 0, 0.0f }, // type 0 is unused
+    { "Speed", TIMER_SPEED, SHAPE_ORB, 0x2E8CFF, 0x9AD8FF, 0x40C8FF, 1.8f },
+    { "Double", TIMER_DOUBLE, SHAPE_PENTAGON, 0x1FF247, 0xA0FFB0, 0x40FF70, 2.0f },
+    { "Shield", TIMER_SHIELD, SHAPE_RING, 0xF0F0FF, 0xFFFFFF, 0xC8D8FF, 1.0f },
+    { "Magnet", TIMER_MAGNET, SHAPE_HORSESHOE, 0xFF3A5A, 0xFF9AB0, 0xFF4070, 80.0f },
+    { "Freeze", TIMER_FREEZE, SHAPE_FLAKE, 0x7FF4FF, 0xD0FFFF, 0x90F0FF, 1.0f },
+};
+
+// calls fn(std::integral_constant<int, T>()) for every power-up type T
+template <class Fn, int... I>
+inline void forEachPowerUpType(Fn&& fn, std::integer_sequence<int, I...>) {
+    int expand[] = { 0, (fn(std::integral_constant<int, I + 1>()), 0)... };
+    (void)expand;
+}
+template <class Fn>
+inline void forEachPowerUpType(Fn&& fn) {
+    forEachPowerUpType(fn, std::make_integer_sequence<int, PU_TYPE_END - 1>());
 }
 
 // -------------------------------
-// Draw HUD panels
+// Spatial index: a uniform grid of buckets over the world, stored flat
+// (bucket b holds items[start[b] .. start[b + 1])). Level entities never
+// move, so it is rebuilt when the level changes and only read in play.
+// Entities appended to the pool (painting) merge in without a rebuild.
 // -------------------------------
-void drawTopPanel() {
-    // panel background
-    glColor3f(0.08f, 0.09f, 0.12f);
-    glBegin(GL_QUADS);
-    glVertex2f(0, WIN_H); glVertex2f(WIN_W, WIN_H);
-    glVertex2f(WIN_W, GAME_Y1); glVertex2f(0, GAME_Y1);
-    glEnd();
-
-    // Time (big, white)
-    char buf[64];
-    sprintf(buf, "TIME: %d s", remainingTime);
-    glColor3f(1.0f, 0.95f, 0.6f);
-    print_on_screen(20, WIN_H - 60, buf);
+const float GRID_CELL = 128.0f; // px
 
-    // Score
-    sprintf(buf, "SCORE: %d", playerScore);
-    glColor3f(0.8f, 0.9f, 1.0f);
-    print_on_screen(240, WIN_H - 60, buf);
+struct SpatialGrid {
+    int cols = 0, rows = 0;
+    float maxR = 0.0f; // queries widen by the largest radius
+    std::vector<uint32_t> start, items;
+    std::vector<uint32_t> fill; // append() scratch
 
-    // Lives as hearts (white outline + red fill)
-    float startX = WIN_W - 220;
-    for (int i = 0; i < playerLives; i++) {
-        float cx = startX + i * 36, cy = WIN_H - 60;
-        // red heart (two circles + triangle)
-        glColor3f(1.0f, 0.15f, 0.25f);
-        drawCircle({ cx - 6, cy + 6 }, 7, 16);
-        drawCircle({ cx + 6, cy + 6 }, 7, 16);
-        glBegin(GL_TRIANGLES);
-        glVertex2f(cx - 12, cy + 4); glVertex2f(cx + 12, cy + 4); glVertex2f(cx, cy - 8);
-        glEnd();
-        // outline
-        glColor3f(0.0f, 0.0f, 0.0f);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(cx - 12, cy + 4); glVertex2f(cx + 12, cy + 4); glVertex2f(cx, cy - 8);
-        glEnd();
+    // entities [first, last) of a pool; items hold pool indices
+    template <class T>
+    void build(const EntityPool<T>& pool, size_t first, size_t last, float worldW, float worldH) {
+        cols = (std::max)(1, (int)ceilf(worldW / GRID_CELL));
+        rows = (std::max)(1, (int)ceilf(worldH / GRID_CELL));
+        start.assign((size_t)cols * rows + 1, 0);
+        items.resize(last - first);
+        maxR = 0.0f;
+        for (size_t i = first; i < last; i++) {
+            start[bucket(pool[i].p)]++;
+            maxR = (std::max)(maxR, pool[i].r);
+        }
+        // counts become bucket ends; filling backwards walks each end down to its start
+        for (size_t b = 1; b < start.size(); b++) start[b] += start[b - 1];
+        for (size_t i = last; i-- > first;) items[--start[bucket(pool[i].p)]] = (uint32_t)i;
     }
-}
+    // entities [from, to) appended to the pool since the build: one pass
+    // moves every bucket up by the new entities below it, from the top
+    // down, and the new ones fill the gaps. The result equals a rebuild
+    template <class T>
+    void append(const EntityPool<T>& pool, size_t from, size_t to) {
+        size_t buckets = start.size() - 1;
+        fill.assign(buckets + 1, 0);
+        for (size_t i = from; i < to; i++) {
+            fill[bucket(pool[i].p) + 1]++;
+            maxR = (std::max)(maxR, pool[i].r);
+        }
+        for (size_t b = 1; b <= buckets; b++) fill[b] += fill[b - 1]; // new entities in buckets before b
+        items.resize(items.size() + (to - from));
+        uint32_t above = fill[buckets];
+        for (size_t b = buckets; b-- > 0;) {
+            uint32_t lo = start[b], hi = start[b + 1], below = fill[b];
+            std::copy_backward(items.begin() + lo, items.begin() + hi, items.begin() + hi + below);
+            start[b + 1] = hi + above;
+            fill[b] = hi + below; // where bucket b's new entities go
+            above = below;
+        }
+        for (size_t i = from; i < to; i++) items[fill[bucket(pool[i].p)]++] = (uint32_t)i;
+    }
+    void clear() { cols = rows = 0; start.clear(); items.clear(); }
 
-void drawBottomPanel() {
-    glColor3f(0.06f, 0.06f, 0.08f);
-    glBegin(GL_QUADS);
-    glVertex2f(0, BOTTOM_H); glVertex2f(WIN_W, BOTTOM_H);
-    glVertex2f(WIN_W, 0); glVertex2f(0, 0);
+    // truncation is fine: anything left of / below the world clamps to bucket 0 anyway
+    int col(float x) const { return (std::max)(0, (std::min)(cols - 1, (int)(x * (1.0f / GRID_CELL)))); }
+    int row(float y) const { return (std::max)(0, (std::min)(rows - 1, (int)((y - GAME_Y0) * (1.0f / GRID_CELL)))); }
+    int bucket(const Vec2& p) const { return row(p.y) * cols + col(p.x); }
+
+    // fn(index) for every entity whose bucket can touch [x0,x1]x[y0,y1]
+    template <class Fn>
+    void query(float x0, float y0, float x1, float y1, Fn fn) const {
+        if (items.empty()) return;
+        int c0 = col(x0 - maxR), c1 = col(x1 + maxR), r0 = row(y0 - maxR), r1 = row(y1 + maxR);
+        for (int r = r0; r <= r1; r++) {
+            const uint32_t* b = start.data() + r * cols;
+            for (uint32_t k = b[c0]; k < b[c1 + 1]; k++) fn(items[k]); // a row's buckets are contiguous
+        }
+    }
+};
+
+// -------------------------------
+// Sweep-and-prune index: entities sorted by the low edge of their extent
+// along one axis, the one their centres spread over most (x for rows and
+// open levels, y for a column). A query binary-searches the first entry
+// that can reach the box and scans until the low edges pass it. Updates
+// re-read the extents and restore the order with an insertion sort:
+// linear while the order barely changes (placements appended, entities
+// nudged between ticks).
+// -------------------------------
+struct SweepIndex {
+    struct Entry { float lo, hi, o0, o1; uint32_t index; }; // [lo,hi] on the sweep axis, [o0,o1] on the other
+    std::vector<Entry> entries;
+    int axis = 0;               // 0 sweeps x, 1 sweeps y
+    float maxW = 0.0f;          // widest extent: queries start that far before their box
+    size_t first = 0, last = 0; // pool range covered
+
+    // ties break on the pool index, so every standard library gives the same order
+    static bool before(const Entry& a, const Entry& b) { return a.lo < b.lo || (a.lo == b.lo && a.index < b.index); }
+
+    // entities [first, last) of a pool; a range that only grew at its end keeps its order
+    template <class T>
+    void build(const EntityPool<T>& pool, size_t from, size_t to) {
+        bool grown = !entries.empty() && from == first && to >= last;
+        if (!grown) { entries.clear(); last = from; }
+        for (size_t i = last; i < to; i++) entries.push_back({ 0.0f, 0.0f, 0.0f, 0.0f, (uint32_t)i });
+        first = from; last = to;
+        refresh(pool, grown);
+    }
+
+    // re-read every extent, then sort (or fix up a nearly sorted order)
+    template <class T>
+    void refresh(const EntityPool<T>& pool, bool nearlySorted = true) {
+        if (!nearlySorted) {
+            // sweep the axis with the larger spread; only a full sort may switch it
+            double sx = 0, sy = 0, sxx = 0, syy = 0, n = (double)(std::max)((size_t)1, entries.size());
+            for (auto& e : entries) {
+                const Vec2& c = pool[e.index].p;
+                sx += c.x; sy += c.y; sxx += (double)c.x * c.x; syy += (double)c.y * c.y;
+            }
+            axis = syy / n - (sy / n) * (sy / n) > sxx / n - (sx / n) * (sx / n) ? 1 : 0;
+        }
+        maxW = 0.0f;
+        for (auto& e : entries) {
+            const T& v = pool[e.index];
+            float a = axis ? v.p.y : v.p.x, b = axis ? v.p.x : v.p.y;
+            e.lo = a - v.r; e.hi = a + v.r; e.o0 = b - v.r; e.o1 = b + v.r;
+            maxW = (std::max)(maxW, 2.0f * v.r);
+        }
+        // the insertion sort gives up once it has done more moves than a full sort would cost
+        size_t budget = nearlySorted ? entries.size() * 8 : 0;
+        for (size_t i = 1; i < entries.size() && budget; i++) {
+            Entry e = entries[i];
+            size_t j = i;
+            for (; j > 0 && budget && before(e, entries[j - 1]); j--, budget--) entries[j] = entries[j - 1];
+            entries[j] = e;
+        }
+        if (!budget) std::sort(entries.begin(), entries.end(), before);
+    }
+    void clear() { entries.clear(); first = last = 0; }
+
+    // fn(index) for every entity whose extent overlaps [x0,x1]x[y0,y1]
+    template <class Fn>
+    void query(float x0, float y0, float x1, float y1, Fn fn) const {
+        float a0 = axis ? y0 : x0, a1 = axis ? y1 : x1, b0 = axis ? x0 : y0, b1 = axis ? x1 : y1;
+        auto it = std::lower_bound(entries.begin(), entries.end(), a0 - maxW, [](const Entry& e, float v) { return e.lo < v; });
+        for (; it != entries.end() && it->lo <= a1; ++it)
+            if (it->hi >= a0 && it->o1 >= b0 && it->o0 <= b1) fn(it->index);
+    }
+};
+
+// -------------------------------
+// Bounding-volume hierarchy: boxes split top-down with a binned surface-
+// area heuristic (perimeter in 2D), falling back to a median split when
+// the centres do not spread or the tree gets deep. Nodes are stored flat in
+// depth-first order: a node's left child follows it, `right` names the
+// other, and a leaf owns items[first .. first + count). Items keep their
+// circle, so leaves test without touching the pool. Static like the grid;
+// besides boxes it answers swept circles and rays.
+// -------------------------------
+struct Bvh {
+    struct Node { float x0, y0, x1, y1; uint32_t right, first, count; }; // count 0: interior
+    struct Item { float x, y, r; uint32_t index; };
+    static const int LEAF = 4, BINS = 12, SAH_DEPTH = 32, STACK = 64; // median splits below SAH_DEPTH add ~log2(n / LEAF)
+    std::vector<Node> nodes;
+    std::vector<Item> items;
+    int depth = 0;
+
+    // entities [first, last) of a pool; items hold pool indices
+    template <class T>
+    void build(const EntityPool<T>& pool, size_t first, size_t last) {
+        items.resize(last - first);
+        for (size_t i = first; i < last; i++) items[i - first] = { pool[i].p.x, pool[i].p.y, pool[i].r, (uint32_t)i };
+        nodes.clear();
+        nodes.reserve(items.size() * 3 / 4 + 1); // leaves average about 3 items
+        depth = 0;
+        if (!items.empty()) split(0, items.size(), 0);
+    }
+    void clear() { nodes.clear(); items.clear(); depth = 0; }
+
+    void split(size_t lo, size_t hi, int level) {
+        uint32_t at = (uint32_t)nodes.size();
+        Node n = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0, (uint32_t)lo, 0 };
+        float c0[2] = { FLT_MAX, FLT_MAX }, c1[2] = { -FLT_MAX, -FLT_MAX };
+        for (size_t k = lo; k < hi; k++) {
+            const Item& it = items[k];
+            n.x0 = (std::min)(n.x0, it.x - it.r); n.x1 = (std::max)(n.x1, it.x + it.r);
+            n.y0 = (std::min)(n.y0, it.y - it.r); n.y1 = (std::max)(n.y1, it.y + it.r);
+            c0[0] = (std::min)(c0[0], it.x); c1[0] = (std::max)(c1[0], it.x);
+            c0[1] = (std::min)(c0[1], it.y); c1[1] = (std::max)(c1[1], it.y);
+        }
+        depth = (std::max)(depth, level);
+        size_t mid = hi - lo > LEAF ? partition(lo, hi, level, c0, c1) : lo;
+        if (mid == lo || mid == hi) n.count = (uint32_t)(hi - lo);
+        nodes.push_back(n);
+        if (n.count) return;
+        split(lo, mid, level + 1);
+        nodes[at].right = (uint32_t)nodes.size();
+        split(mid, hi, level + 1);
+    }
+
+    // reorders items[lo, hi) into two halves and returns where the second starts
+    size_t partition(size_t lo, size_t hi, int level, const float c0[2], const float c1[2]) {
+        int axis = c1[1] - c0[1] > c1[0] - c0[0] ? 1 : 0;
+        if (level < SAH_DEPTH && c1[axis] > c0[axis]) {
+            // cost of a split after bin b: count x half-perimeter of each side
+            float bestCost = FLT_MAX, bestPlane = 0.0f;
+            int bestAxis = -1;
+            for (int a = 0; a < 2; a++) {
+                if (c1[a] <= c0[a]) continue;
+                float scale = BINS / (c1[a] - c0[a]);
+                struct Bin { float x0, y0, x1, y1; uint32_t count; } bins[BINS];
+                for (auto& b : bins) b = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0 };
+                for (size_t k = lo; k < hi; k++) {
+                    const Item& it = items[k];
+                    Bin& b = bins[(std::min)(BINS - 1, (int)(((a ? it.y : it.x) - c0[a]) * scale))];
+                    b.x0 = (std::min)(b.x0, it.x - it.r); b.x1 = (std::max)(b.x1, it.x + it.r);
+                    b.y0 = (std::min)(b.y0, it.y - it.r); b.y1 = (std::max)(b.y1, it.y + it.r);
+                    b.count++;
+                }
+                float leftCost[BINS];
+                Bin acc = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0 };
+                for (int b = 0; b < BINS - 1; b++) {
+                    acc.x0 = (std::min)(acc.x0, bins[b].x0); acc.x1 = (std::max)(acc.x1, bins[b].x1);
+                    acc.y0 = (std::min)(acc.y0, bins[b].y0); acc.y1 = (std::max)(acc.y1, bins[b].y1);
+                    acc.count += bins[b].count;
+                    leftCost[b] = acc.count ? acc.count * (acc.x1 - acc.x0 + acc.y1 - acc.y0) : FLT_MAX;
+                }
+                acc = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0 };
+                for (int b = BINS - 1; b > 0; b--) {
+                    acc.x0 = (std::min)(acc.x0, bins[b].x0); acc.x1 = (std::max)(acc.x1, bins[b].x1);
+                    acc.y0 = (std::min)(acc.y0, bins[b].y0); acc.y1 = (std::max)(acc.y1, bins[b].y1);
+                    acc.count += bins[b].count;
+                    if (!acc.count || leftCost[b - 1] == FLT_MAX) continue;
+                    float cost = leftCost[b - 1] + acc.count * (acc.x1 - acc.x0 + acc.y1 - acc.y0);
+                    if (cost < bestCost) { bestCost = cost; bestAxis = a; bestPlane = c0[a] + b / scale; }
+                }
+            }
+            if (bestAxis >= 0) {
+                // the same bin arithmetic as above, so nothing lands on the wrong side of the plane
+                float scale = BINS / (c1[bestAxis] - c0[bestAxis]);
+                int plane = (int)lroundf((bestPlane - c0[bestAxis]) * scale);
+                Item* m = std::partition(items.data() + lo, items.data() + hi, [&](const Item& it) {
+                    return (std::min)(BINS - 1, (int)(((bestAxis ? it.y : it.x) - c0[bestAxis]) * scale)) < plane;
+                });
+                size_t mid = (size_t)(m - items.data());
+                if (mid > lo && mid < hi) return mid;
+            }
+        }
+        // median split: always balanced, also for coincident centres
+        size_t mid = lo + (hi - lo) / 2;
+        std::nth_element(items.data() + lo, items.data() + mid, items.data() + hi, [axis](const Item& a, const Item& b) {
+            return axis ? a.y < b.y : a.x < b.x;
+        });
+        return mid;
+    }
+
+    // fn(index) for every entity whose bounding box overlaps [x0,x1]x[y0,y1]
+    template <class Fn>
+    void query(float x0, float y0, float x1, float y1, Fn fn) const {
+        if (nodes.empty()) return;
+        uint32_t stack[STACK];
+        int sp = 0;
+        uint32_t i = 0;
+        for (;;) {
+            const Node& n = nodes[i];
+            if (n.x0 <= x1 && n.x1 >= x0 && n.y0 <= y1 && n.y1 >= y0) {
+                if (!n.count) { stack[sp++] = n.right; i++; continue; }
+                for (uint32_t k = n.first; k < n.first + n.count; k++) {
+                    const Item& it = items[k];
+                    if (it.x - it.r <= x1 && it.x + it.r >= x0 && it.y - it.r <= y1 && it.y + it.r >= y0) fn(it.index);
+                }
+            }
+            if (!sp) return;
+            i = stack[--sp];
+        }
+    }
+
+    // a circle of radius r moving from a to b: the first entity it touches,
+    // as a fraction t of the way along (0 if it starts overlapping one).
+    // r = 0 casts a ray; `any` stops at the first hit found, not the nearest.
+    bool sweep(Vec2 a, Vec2 b, float r, float& tHit, uint32_t& hit, bool any = false) const {
+        tHit = 1.0f;
+        if (nodes.empty()) return false;
+        float dx = b.x - a.x, dy = b.y - a.y, dd = dx * dx + dy * dy;
+        // slab test against a node grown by r; axes the segment does not move along only check containment
+        auto enter = [&](const Node& n) {
+            float t0 = 0.0f, t1 = tHit;
+            if (fabsf(dx) > 1e-12f) {
+                float u = (n.x0 - r - a.x) / dx, v = (n.x1 + r - a.x) / dx;
+                t0 = (std::max)(t0, (std::min)(u, v)); t1 = (std::min)(t1, (std::max)(u, v));
+            }
+            else if (a.x < n.x0 - r || a.x > n.x1 + r) return FLT_MAX;
+            if (fabsf(dy) > 1e-12f) {
+                float u = (n.y0 - r - a.y) / dy, v = (n.y1 + r - a.y) / dy;
+                t0 = (std::max)(t0, (std::min)(u, v)); t1 = (std::min)(t1, (std::max)(u, v));
+            }
+            else if (a.y < n.y0 - r || a.y > n.y1 + r) return FLT_MAX;
+            return t0 <= t1 ? t0 : FLT_MAX;
+        };
+        uint32_t stack[STACK];
+        int sp = 0;
+        uint32_t i = 0;
+        bool found = false;
+        if (enter(nodes[0]) == FLT_MAX) return false;
+        for (;;) {
+            const Node& n = nodes[i];
+            if (!n.count) {
+                // nearer child first; the farther one waits unless the hit already beats it
+                uint32_t l = i + 1, rr = n.right;
+                float tl = enter(nodes[l]), tr = enter(nodes[rr]);
+                if (tr < tl) { std::swap(l, rr); std::swap(tl, tr); }
+                if (tl != FLT_MAX) {
+                    if (tr != FLT_MAX) stack[sp++] = rr;
+                    i = l;
+                    continue;
+                }
+            }
+            else {
+                for (uint32_t k = n.first; k < n.first + n.count; k++) {
+                    // |a + t d - c| = r + R, smallest root in [0, tHit]
+                    const Item& it = items[k];
+                    float mx = a.x - it.x, my = a.y - it.y, rad = r + it.r;
+                    float c = mx * mx + my * my - rad * rad, t;
+                    if (c <= 0.0f) t = 0.0f;
+                    else {
+                        float bb = mx * dx + my * dy, disc = bb * bb - dd * c;
+                        if (bb >= 0.0f || disc < 0.0f) continue;
+                        t = (-bb - sqrtf(disc)) / dd;
+                    }
+                    if (t < tHit || (!found && t <= tHit)) { tHit = t; hit = it.index; found = true; }
+                }
+                if (found && any) return true;
+            }
+            // popped nodes are re-tested against the (possibly nearer) hit
+            for (;;) {
+                if (!sp) return found;
+                i = stack[--sp];
+                if (enter(nodes[i]) != FLT_MAX) break;
+            }
+        }
+    }
+    // no entity within r of the segment a-b
+    bool lineOfSight(Vec2 a, Vec2 b, float r) const {
+        float t; uint32_t hit;
+        return !sweep(a, b, r, t, hit, true);
+    }
+};
+
+// which structure answers the level's queries; switchable at runtime (I)
+enum IndexKind { INDEX_GRID, INDEX_SWEEP, INDEX_BVH, INDEX_KIND_COUNT };
+const char* const indexKindNames[INDEX_KIND_COUNT] = { "grid", "sweep-and-prune", "BVH" };
+
+struct EntityIndex {
+    IndexKind kind = INDEX_GRID;
+    SpatialGrid grid;
+    SweepIndex sweep;
+    Bvh bvh;
+
+    template <class T>
+    void build(IndexKind k, const EntityPool<T>& pool, size_t first, size_t last, float worldW, float worldH) {
+        kind = k;
+        if (kind != INDEX_GRID) grid.clear();
+        if (kind != INDEX_SWEEP) sweep.clear();
+        if (kind != INDEX_BVH) bvh.clear();
+        if (kind == INDEX_SWEEP) sweep.build(pool, first, last);
+        else if (kind == INDEX_BVH) bvh.build(pool, first, last);
+        else grid.build(pool, first, last, worldW, worldH);
+    }
+    // after pool entities [last, to) were appended to a built [first, last)
+    template <class T>
+    void append(const EntityPool<T>& pool, size_t first, size_t last, size_t to, float worldW, float worldH) {
+        if (kind == INDEX_GRID && !grid.start.empty()) grid.append(pool, last, to);
+        else build(kind, pool, first, to, worldW, worldH); // the sweep keeps its order; a BVH rebuilds
+    }
+    // an insert before the range moved its entities `by` slots up the pool
+    void shift(uint32_t by) {
+        for (uint32_t& i : grid.items) i += by;
+        for (auto& e : sweep.entries) e.index += by;
+        if (!sweep.entries.empty()) { sweep.first += by; sweep.last += by; }
+        for (auto& it : bvh.items) it.index += by;
+    }
+    template <class Fn>
+    void query(float x0, float y0, float x1, float y1, Fn fn) const {
+        if (kind == INDEX_SWEEP) sweep.query(x0, y0, x1, y1, fn);
+        else if (kind == INDEX_BVH) bvh.query(x0, y0, x1, y1, fn);
+        else grid.query(x0, y0, x1, y1, fn);
+    }
+};
+
+// -------------------------------
+// Pickup queries: nearest K, radius and box over the live collectibles
+// and power-ups, from one KD-tree of both (median split on the wider
+// side, leaves of up to 8). Results go into the caller's buffer. A taken
+// pickup stays in its leaf as a tombstone that queries skip; each node
+// counts its live pickups so emptied subtrees are pruned. Once enough
+// tombstones pile up, the dirty leaves are compacted: live pickups move
+// to the front and queries stop scanning the rest. Anything that revives
+// pickups (a new round, a rewind, a quick-load, a reload) only bumps the
+// tree's epoch, in O(1). Counts are stamped with their epoch and redone
+// lazily: a query recounts a stale leaf the first time it reaches it, and
+// a parent is summed again once both children are current. Stale nodes
+// are never pruned, and a pickup taken in a stale leaf is left to that
+// leaf's recount. A round pays for the recount a leaf at a time, in the
+// queries that need it, instead of in the reset.
+// -------------------------------
+const unsigned PICK_COLLECTIBLES = 1u;                             // bit 0
+const unsigned PICK_POWERUPS = (1u << PU_TYPE_END) - 2u;           // bit t: power-up type t
+const unsigned PICK_ALL = PICK_COLLECTIBLES | PICK_POWERUPS;
+
+struct PickupHit { Vec2 p; float d2; uint32_t index; int kind; }; // kind 0: collectible, else power-up type
+
+struct GameState;
+
+struct PickupIndex {
+    struct Item { float x, y; uint32_t index; int kind; };
+    // a node covers items[first .. first + total); leaves only scan the first `scan`
+    struct Node { float x0, y0, x1, y1; uint32_t right, parent, first, total, scan, live, kinds, epoch; };
+    static const int LEAF = 8, STACK = 64;
+    std::vector<Node> nodes;
+    std::vector<Item> items;
+    std::vector<uint32_t> collectLeaf, powerLeaf; // pool index -> leaf
+    std::vector<uint32_t> dirty;                  // leaves holding tombstones
+    uint32_t round = 0;                           // the game round `epoch` began in
+    uint32_t epoch = 1;                           // counts stamped with another epoch are stale
+    uint32_t tombstones = 0, compactions = 0;
+    bool autoCompact = true;
+
+    void build(const GameState& g);
+    void taken(const GameState& g, int kind, uint32_t index);
+    void recount(const GameState& g);
+    void compact(const GameState& g);
+    // pickups may have come back: every count goes stale, O(1)
+    void invalidate() { epoch++; dirty.clear(); tombstones = 0; }
+    // n power-ups were inserted into the pool at `at`; they stay out of the tree until the next build
+    void inserted(uint32_t at, uint32_t n) {
+        for (Item& it : items) if (it.kind && it.index >= at) it.index += n;
+        if (!nodes.empty()) powerLeaf.insert(powerLeaf.begin() + at, n, UINT32_MAX);
+    }
+
+    // queries recount the stale leaves they reach, so they are not const
+    int nearest(const GameState& g, Vec2 p, int k, PickupHit* out, float maxDist = FLT_MAX, unsigned kinds = PICK_ALL);
+    int radius(const GameState& g, Vec2 p, float r, PickupHit* out, int cap, unsigned kinds = PICK_ALL);
+    int box(const GameState& g, float x0, float y0, float x1, float y1, PickupHit* out, int cap, unsigned kinds = PICK_ALL);
+
+private:
+    void split(uint32_t parent, uint32_t lo, uint32_t hi);
+    bool live(const GameState& g, const Item& it) const;
+    // a new game round makes every count stale
+    void sync(const GameState& g);
+    bool current(const Node& n) const { return n.epoch == epoch; }
+    void recountLeaf(const GameState& g, uint32_t leaf);
+    template <class Fn> void visit(const GameState& g, float x0, float y0, float x1, float y1, unsigned kinds, Fn fn);
+};
+
+struct LevelIndex {
+    IndexKind kind = INDEX_GRID;
+    EntityIndex obstacles, collectibles;
+    EntityIndex powerups[PU_TYPE_END]; // one per type run
+    Bvh obstacleTree; // swept circles and rays, unless `obstacles` is a BVH already
+    PickupIndex pickups;
+
+    const Bvh& solid() const { return obstacles.kind == INDEX_BVH ? obstacles.bvh : obstacleTree; }
+};
+
+// Everything the simulation reads or writes lives here, so the headless
+// batch evaluator can run many independent copies side by side.
+struct GameState {
+    bool running = false;
+    bool showEnd = false;
+    bool playerWon = false;
+
+    int remainingMs = totalTime * 1000;
+    int playerScore = 0;
+    int playerLives = 5;
+
+    Vec2 playerPos = { 0.0f, 0.0f }, playerDir = { 1.0f, 0.0f };
+
+    // powerups
+    bool speedActive = false;
+    bool doubleActive = false;
+    bool shieldActive = false;
+    bool magnetActive = false;
+    bool freezeActive = false;
+
+    // invulnerability after hitting obstacle
+    bool invulnerable = false;
+
+    // round countdown and effect durations
+    TimerWheel timers;
+    TimerId effectTimers[TIMER_KIND_COUNT];
+    float timerCarryMs = 0.0f; // sub-ms remainder of the sim clock
+
+    EntityPool<Obstacle> obstacles;
+    EntityPool<Collectible> collectibles;
+    EntityPool<PowerUp> powerups; // sorted by type: [powerupRun[t], powerupRun[t + 1]) is type t
+    uint32_t powerupRun[PU_TYPE_END + 1] = {};
+    LevelIndex index;
+    // the world spans x in [0, worldW], y in [GAME_Y0, GAME_Y0 + worldH]; the camera scrolls over it
+    float worldW = (float)WIN_W, worldH = (float)(GAME_Y1 - GAME_Y0);
+    uint32_t round = 1; // bumping it revives every pickup (O(1) restart)
+
+    // bezier target (integers for compatibility with instructor code)
+    int bz_p0[2], bz_p1[2], bz_p2[2], bz_p3[2];
+    float bezT = 0.0f;
+    bool bezReverse = false;
+    Vec2 targetPos = { 0.0f, 0.0f };
+
+    // keyboard state (written by GLUT callbacks or by a bot)
+    bool keyLeft = false, keyRight = false, keyUp = false, keyDown = false;
+    // sub-tick input: sum of (unit direction x seconds held) over the tick,
+    // used instead of the key bools when sampledInput is set
+    bool sampledInput = false;
+    Vec2 inputMove = { 0.0f, 0.0f };
+
+    bool audio = true; // headless copies stay silent
+    bool effects = true; // ...and emit no particles
+
+    uint32_t tick = 0; // ticks into the round
+    EventBus bus;      // this tick's events
+};
+
+GameState game;
+
+template <class T>
+static inline bool isLive(const GameState& g, const T& pickup) { return pickup.takenRound != g.round; }
+
+static inline float speedFactor(const GameState& g) { return g.speedActive ? powerUpDefs[PU_SPEED].strength : 1.0f; }
+
+static inline int clampPowerUpType(int type) { return type >= 1 && type < PU_TYPE_END ? type : PU_DOUBLE; }
+
+// editor placement: insert at the end of its type's run
+void addPowerUp(GameState& g, const PowerUp& pu) {
+    g.powerups.insert(g.powerupRun[pu.type + 1], pu);
+    for (int t = pu.type + 1; t <= PU_TYPE_END; t++) g.powerupRun[t]++;
+}
+
+// several of one type at the end of its run
+void addPowerUps(GameState& g, int type, const PowerUp* v, size_t n) {
+    if (!n) return;
+    g.powerups.insert(g.powerupRun[type + 1], v, n);
+    for (int t = type + 1; t <= PU_TYPE_END; t++) g.powerupRun[t] += (uint32_t)n;
+}
+
+// bulk loads append in any order and regroup once
+void groupPowerUps(GameState& g) {
+    std::stable_sort(g.powerups.begin(), g.powerups.end(), [](const PowerUp& a, const PowerUp& b) { return a.type < b.type; });
+    uint32_t n = 0;
+    for (int t = 0; t <= PU_TYPE_END; t++) {
+        g.powerupRun[t] = n;
+        while (t < PU_TYPE_END && n < g.powerups.size() && g.powerups[n].type == t) n++;
+    }
+}
+
+enum { LEVEL_OBSTACLES = 1, LEVEL_COLLECTIBLES = 2, LEVEL_POWERUPS = 4, LEVEL_ALL = 7 };
+
+// the obstacle tree and the pickup tree, for the pools `parts` names
+void indexTrees(GameState& g, unsigned parts) {
+    if (parts & LEVEL_OBSTACLES) {
+        if (g.index.kind == INDEX_BVH) g.index.obstacleTree.clear();
+        else g.index.obstacleTree.build(g.obstacles, 0, g.obstacles.size());
+    }
+    if (parts & (LEVEL_COLLECTIBLES | LEVEL_POWERUPS)) g.index.pickups.build(g);
+}
+
+// rebuild the spatial index after the level changed (load, generate, placement);
+// `parts` names the pools that changed, the rest keep their index
+void indexLevel(GameState& g, unsigned parts = LEVEL_ALL) {
+    IndexKind k = g.index.kind;
+    if (parts & LEVEL_OBSTACLES) g.index.obstacles.build(k, g.obstacles, 0, g.obstacles.size(), g.worldW, g.worldH);
+    if (parts & LEVEL_COLLECTIBLES) g.index.collectibles.build(k, g.collectibles, 0, g.collectibles.size(), g.worldW, g.worldH);
+    if (parts & LEVEL_POWERUPS)
+        for (int t = 1; t < PU_TYPE_END; t++)
+            g.index.powerups[t].build(k, g.powerups, g.powerupRun[t], g.powerupRun[t + 1], g.worldW, g.worldH);
+    indexTrees(g, parts);
+}
+
+// hands over the index parts indexLevel(parts) builds, for a level whose
+// entities are the same in the same order
+void swapIndexParts(LevelIndex& a, LevelIndex& b, unsigned parts) {
+    if (parts & LEVEL_OBSTACLES) { std::swap(a.obstacles, b.obstacles); std::swap(a.obstacleTree, b.obstacleTree); }
+    if (parts & LEVEL_COLLECTIBLES) std::swap(a.collectibles, b.collectibles);
+    if (parts & LEVEL_POWERUPS) for (int t = 1; t < PU_TYPE_END; t++) std::swap(a.powerups[t], b.powerups[t]);
+    if (parts & (LEVEL_COLLECTIBLES | LEVEL_POWERUPS)) std::swap(a.pickups, b.pickups);
+}
+
+// -------------------------------
+// Pickup queries (PickupIndex, declared with the spatial indexes)
+// -------------------------------
+bool PickupIndex::live(const GameState& g, const Item& it) const {
+    return (it.kind ? g.powerups[it.index].takenRound : g.collectibles[it.index].takenRound) != g.round;
+}
+
+void PickupIndex::sync(const GameState& g) {
+    if (round != g.round) { round = g.round; invalidate(); }
+}
+
+void PickupIndex::build(const GameState& g) {
+    items.clear();
+    items.reserve(g.collectibles.size() + g.powerups.size());
+    for (size_t i = 0; i < g.collectibles.size(); i++) items.push_back({ g.collectibles[i].p.x, g.collectibles[i].p.y, (uint32_t)i, 0 });
+    for (size_t i = 0; i < g.powerups.size(); i++) items.push_back({ g.powerups[i].p.x, g.powerups[i].p.y, (uint32_t)i, g.powerups[i].type });
+    collectLeaf.assign(g.collectibles.size(), 0);
+    powerLeaf.assign(g.powerups.size(), 0);
+    nodes.clear();
+    nodes.reserve(items.size() / (LEAF / 2) + 1);
+    if (!items.empty()) split(UINT32_MAX, 0, (uint32_t)items.size());
+    dirty.clear();
+    dirty.reserve(nodes.size()); // a leaf is listed at most once, so compaction never allocates
+    recount(g);
+}
+
+void PickupIndex::split(uint32_t parent, uint32_t lo, uint32_t hi) {
+    uint32_t at = (uint32_t)nodes.size();
+    Node n = { FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, 0, parent, lo, hi - lo, 0, 0, 0, 0 };
+    for (uint32_t k = lo; k < hi; k++) {
+        const Item& it = items[k];
+        n.x0 = (std::min)(n.x0, it.x); n.x1 = (std::max)(n.x1, it.x);
+        n.y0 = (std::min)(n.y0, it.y); n.y1 = (std::max)(n.y1, it.y);
+        n.kinds |= 1u << it.kind;
+    }
+    nodes.push_back(n);
+    if (hi - lo <= (uint32_t)LEAF) {
+        for (uint32_t k = lo; k < hi; k++) (items[k].kind ? powerLeaf : collectLeaf)[items[k].index] = at;
+        return;
+    }
+    bool byY = n.y1 - n.y0 > n.x1 - n.x0;
+    uint32_t mid = lo + (hi - lo) / 2;
+    std::nth_element(items.begin() + lo, items.begin() + mid, items.begin() + hi, [byY](const Item& a, const Item& b) {
+        return byY ? a.y < b.y : a.x < b.x;
+    });
+    split(at, lo, mid);
+    nodes[at].right = (uint32_t)nodes.size();
+    split(at, mid, hi);
+}
+
+// the whole tree at once, after a build: leaves back to their full range,
+// then live pickups first; O(pickups)
+void PickupIndex::recount(const GameState& g) {
+    round = g.round;
+    invalidate();
+    for (size_t i = nodes.size(); i-- > 0;) {
+        Node& n = nodes[i];
+        if (n.total <= (uint32_t)LEAF) {
+            Item* end = std::partition(items.data() + n.first, items.data() + n.first + n.total, [&](const Item& it) { return live(g, it); });
+            n.scan = n.live = (uint32_t)(end - items.data() - n.first);
+        }
+        else n.live = nodes[i + 1].live + nodes[n.right].live; // children come later in depth-first order
+        n.epoch = epoch;
+    }
+}
+
+// one stale leaf, then each parent whose other child is current too
+void PickupIndex::recountLeaf(const GameState& g, uint32_t leaf) {
+    Node& n = nodes[leaf];
+    Item* end = std::partition(items.data() + n.first, items.data() + n.first + n.total, [&](const Item& it) { return live(g, it); });
+    n.scan = n.live = (uint32_t)(end - items.data() - n.first);
+    n.epoch = epoch;
+    for (uint32_t i = n.parent; i != UINT32_MAX; i = nodes[i].parent) {
+        Node& p = nodes[i];
+        const Node &a = nodes[i + 1], &b = nodes[p.right];
+        if (!current(a) || !current(b)) return;
+        p.live = a.live + b.live;
+        p.epoch = epoch;
+    }
+}
+
+// called right after a pickup's takenRound is set
+void PickupIndex::taken(const GameState& g, int kind, uint32_t index) {
+    const std::vector<uint32_t>& leaves = kind ? powerLeaf : collectLeaf;
+    if (nodes.empty() || index >= leaves.size() || leaves[index] == UINT32_MAX) return; // painted since the build
+    sync(g);
+    uint32_t leaf = leaves[index];
+    if (!current(nodes[leaf])) return; // the leaf's recount sees it taken
+    if (nodes[leaf].scan == nodes[leaf].live) dirty.push_back(leaf);
+    // a current node's ancestors up to the first stale one are current too
+    for (uint32_t i = leaf; i != UINT32_MAX && current(nodes[i]); i = nodes[i].parent) nodes[i].live--;
+    // compact once the tombstones outnumber an eighth of what is still live
+    uint32_t left = current(nodes[0]) ? nodes[0].live : nodes[0].total;
+    if (++tombstones > 32 + left / 8 && autoCompact) compact(g);
+}
+
+void PickupIndex::compact(const GameState& g) {
+    for (uint32_t leaf : dirty) {
+        Node& n = nodes[leaf];
+        std::partition(items.data() + n.first, items.data() + n.first + n.scan, [&](const Item& it) { return live(g, it); });
+        n.scan = n.live;
+    }
+    dirty.clear();
+    tombstones = 0;
+    compactions++;
+}
+
+// fn(item) for every live pickup of `kinds` in leaves touching the box
+template <class Fn>
+void PickupIndex::visit(const GameState& g, float x0, float y0, float x1, float y1, unsigned kinds, Fn fn) {
+    if (nodes.empty()) return;
+    sync(g);
+    uint32_t stack[STACK];
+    int sp = 0;
+    uint32_t i = 0;
+    for (;;) {
+        const Node& n = nodes[i];
+        if ((n.kinds & kinds) && (!current(n) || n.live) && n.x0 <= x1 && n.x1 >= x0 && n.y0 <= y1 && n.y1 >= y0) {
+            if (n.total > (uint32_t)LEAF) { stack[sp++] = n.right; i++; continue; }
+            if (!current(n)) recountLeaf(g, i);
+            uint32_t end = n.first + n.scan;
+            for (uint32_t k = n.first; k < end; k++)
+                if ((kinds >> items[k].kind & 1u) && live(g, items[k])) fn(items[k]);
+        }
+        if (!sp) return;
+        i = stack[--sp];
+    }
+}
+
+// the k nearest, closest first (ties on kind, then index); only those closer than maxDist
+int PickupIndex::nearest(const GameState& g, Vec2 p, int k, PickupHit* out, float maxDist, unsigned kinds) {
+    if (nodes.empty() || k <= 0) return 0;
+    sync(g);
+    int found = 0;
+    float worst = maxDist == FLT_MAX ? FLT_MAX : maxDist * maxDist; // out[k - 1].d2 once full
+    auto boxD2 = [&p](const Node& n) {
+        float dx = (std::max)((std::max)(n.x0 - p.x, p.x - n.x1), 0.0f), dy = (std::max)((std::max)(n.y0 - p.y, p.y - n.y1), 0.0f);
+        return dx * dx + dy * dy;
+    };
+    auto before = [](float d2, const Item& it, const PickupHit& h) {
+        return d2 < h.d2 || (d2 == h.d2 && (it.kind < h.kind || (it.kind == h.kind && it.index < h.index)));
+    };
+    struct Pending { uint32_t node; float d2; } stack[STACK];
+    int sp = 0;
+    Pending cur = { 0, boxD2(nodes[0]) };
+    for (;;) {
+        const Node& n = nodes[cur.node];
+        if (cur.d2 < worst && (n.kinds & kinds) && (!current(n) || n.live)) {
+            if (n.total > (uint32_t)LEAF) {
+                // nearer child first
+                Pending a = { cur.node + 1, boxD2(nodes[cur.node + 1]) }, b = { n.right, boxD2(nodes[n.right]) };
+                if (b.d2 < a.d2) std::swap(a, b);
+                stack[sp++] = b;
+                cur = a;
+                continue;
+            }
+            if (!current(n)) recountLeaf(g, cur.node);
+            uint32_t end = n.first + n.scan;
+            for (uint32_t j = n.first; j < end; j++) {
+                const Item& it = items[j];
+                if (!(kinds >> it.kind & 1u) || !live(g, it)) continue;
+                float dx = it.x - p.x, dy = it.y - p.y, d2 = dx * dx + dy * dy;
+                if (d2 >= worst && (found == k || d2 > worst || maxDist == FLT_MAX)) continue;
+                if (found == k && !before(d2, it, out[k - 1])) continue;
+                // insertion into the sorted buffer
+                int at = found < k ? found++ : k - 1;
+                while (at > 0 && before(d2, it, out[at - 1])) { out[at] = out[at - 1]; at--; }
+                out[at] = { { it.x, it.y }, d2, it.index, it.kind };
+                if (found == k) worst = (std::min)(worst, out[k - 1].d2);
+            }
+        }
+        if (!sp) return found;
+        cur = stack[--sp];
+    }
+}
+
+// every live pickup within r of p (all of them are counted, the first `cap` written)
+int PickupIndex::radius(const GameState& g, Vec2 p, float r, PickupHit* out, int cap, unsigned kinds) {
+    int found = 0;
+    visit(g, p.x - r, p.y - r, p.x + r, p.y + r, kinds, [&](const Item& it) {
+        float dx = it.x - p.x, dy = it.y - p.y, d2 = dx * dx + dy * dy;
+        if (d2 > r * r) return;
+        if (found < cap) out[found] = { { it.x, it.y }, d2, it.index, it.kind };
+        found++;
+    });
+    return found;
+}
+
+// every live pickup whose centre lies in [x0,x1]x[y0,y1]
+int PickupIndex::box(const GameState& g, float x0, float y0, float x1, float y1, PickupHit* out, int cap, unsigned kinds) {
+    int found = 0;
+    visit(g, x0, y0, x1, y1, kinds, [&](const Item& it) {
+        if (found < cap) out[found] = { { it.x, it.y }, 0.0f, it.index, it.kind };
+        found++;
+    });
+    return found;
+}
+
+// empty one-screen world
+void clearLevel(GameState& g) {
+    g.obstacles.clear(); g.collectibles.clear(); g.powerups.clear();
+    std::fill(g.powerupRun, g.powerupRun + PU_TYPE_END + 1, 0u);
+    g.worldW = (float)WIN_W; g.worldH = (float)(GAME_Y1 - GAME_Y0);
+    indexLevel(g);
+}
+
+// timing
+int prevTimeMs = 0;
+
+// placement mode
+// power-up modes are POWER_MODE + type - 1
+enum PlaceMode { NONE_MODE = 0, OBSTACLE_MODE, COLLECT_MODE, POWER_MODE, PLACE_MODE_END = POWER_MODE + PU_TYPE_END - 1 };
+PlaceMode currentMode = NONE_MODE;
+
+// -------------------------------
+// Utility drawing helpers
+// -------------------------------
+void drawCircle(const Vec2& c, float r, int seg = 32) {
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex2f(c.x, c.y);
+    for (int i = 0; i <= seg; i++) {
+        float a = (float)i / seg * 2.0f * 3.14159265358979323846f;
+        glVertex2f(c.x + cosf(a) * r, c.y + sinf(a) * r);
+    }
     glEnd();
+}
 
-    // icons
-    float gap = 120.0f;
-    float x = 200.0f, y = 50.0f;
-    // Obstacle - red square icon
-    glColor3f(0.7f, 0.25f, 0.2f);
-    glBegin(GL_QUADS);
-    glVertex2f(x - 18, y - 18); glVertex2f(x + 18, y - 18); glVertex2f(x + 18, y + 18); glVertex2f(x - 18, y + 18);
+void drawStringCentered(int x, int y, const char* s) {
+    print_on_screen(x - (int)strlen(s) * 6, y, s);
+}
+
+static inline void glColorHex(uint32_t c) { glColor3ub((GLubyte)(c >> 16), (GLubyte)(c >> 8), (GLubyte)c); }
+
+// -------------------------------
+// Blend state: every blended draw asks the tracker for its mode and the
+// tracker only calls GL when the mode changes. Glows and the end-screen
+// dimming go through a queue that draws one pass grouped by mode, so a pass
+// of any number of glows costs a handful of state changes.
+// -------------------------------
+enum BlendMode : uint8_t { BLEND_MODE_OPAQUE, BLEND_MODE_ADD, BLEND_MODE_ALPHA, BLEND_MODE_COUNT };
+
+struct GlStateTracker {
+    BlendMode mode = BLEND_MODE_OPAQUE;
+    uint32_t changes = 0, blended = 0;         // GL state calls and blended draws this frame
+    uint32_t lastChanges = 0, lastBlended = 0; // the same for the previous frame
+
+    void set(BlendMode m) {
+        if (m == mode) return;
+        if (m == BLEND_MODE_OPAQUE) { glDisable(GL_BLEND); changes++; }
+        else {
+            if (mode == BLEND_MODE_OPAQUE) { glEnable(GL_BLEND); changes++; }
+            glBlendFunc(GL_SRC_ALPHA, m == BLEND_MODE_ADD ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+            changes++;
+        }
+        mode = m;
+    }
+    // the mode for one draw call
+    void use(BlendMode m) { set(m); blended += m != BLEND_MODE_OPAQUE; }
+    void endFrame() { lastChanges = changes; lastBlended = blended; changes = blended = 0; }
+};
+GlStateTracker glState;
+
+// PASS_GLOW goes under the world's bodies, PASS_OVERLAY over the panels
+enum BlendPass : uint8_t { PASS_GLOW, PASS_OVERLAY };
+
+struct BlendedDraw {
+    BlendPass pass;
+    BlendMode mode;
+    uint8_t segments; // 0: a quad from (x, y) to (w, h); else a circle at (x, y) of radius w
+    float x, y, w, h;
+    float rgba[4];
+};
+
+struct BlendQueue {
+    std::vector<BlendedDraw> items;
+
+    void circle(BlendPass pass, BlendMode mode, const Vec2& c, float r, int seg, float cr, float cg, float cb, float ca) {
+        items.push_back({ pass, mode, (uint8_t)seg, c.x, c.y, r, r, { cr, cg, cb, ca } });
+    }
+    void quad(BlendPass pass, BlendMode mode, float x0, float y0, float x1, float y1, float cr, float cg, float cb, float ca) {
+        items.push_back({ pass, mode, 0, x0, y0, x1, y1, { cr, cg, cb, ca } });
+    }
+    // draws the pass's items grouped by mode (queue order within a mode) and drops them
+    void flush(GlStateTracker& st, BlendPass pass) {
+        for (int m = BLEND_MODE_OPAQUE; m < BLEND_MODE_COUNT; m++)
+            for (const BlendedDraw& d : items) {
+                if (d.pass != pass || d.mode != m) continue;
+                st.use(d.mode);
+                glColor4fv(d.rgba);
+                if (d.segments) drawCircle({ d.x, d.y }, d.w, d.segments);
+                else {
+                    glBegin(GL_QUADS);
+                    glVertex2f(d.x, d.y); glVertex2f(d.w, d.y);
+                    glVertex2f(d.w, d.h); glVertex2f(d.x, d.h);
+                    glEnd();
+                }
+            }
+        st.set(BLEND_MODE_OPAQUE);
+        size_t kept = 0;
+        for (const BlendedDraw& d : items)
+            if (d.pass != pass) items[kept++] = d;
+        items.resize(kept);
+    }
+};
+BlendQueue blendQueue;
+
+// -------------------------------
+// Power-up shapes, one specialisation per PowerUpShape
+// -------------------------------
+template <PowerUpShape S> void drawPowerUpShape(Vec2 c, float r, uint32_t color);
+
+template <> void drawPowerUpShape<SHAPE_ORB>(Vec2 c, float r, uint32_t color) {
+    glColorHex(color);
+    drawCircle(c, r);
+    // small white lines
+    glColor3f(1, 1, 1);
+    glBegin(GL_LINES);
+    glVertex2f(c.x - r * 0.43f, c.y - r * 0.14f); glVertex2f(c.x + r * 0.43f, c.y + r * 0.14f);
+    glVertex2f(c.x - r * 0.43f, c.y + r * 0.14f); glVertex2f(c.x + r * 0.43f, c.y - r * 0.14f);
     glEnd();
-    // Collectible - golden triangle
-    glColor3f(1.0f, 0.92f, 0.16f);
-    glBegin(GL_TRIANGLES);
-    glVertex2f(x + gap, y + 16); glVertex2f(x + gap - 12, y - 12); glVertex2f(x + gap + 12, y - 12);
+}
+
+template <> void drawPowerUpShape<SHAPE_PENTAGON>(Vec2 c, float r, uint32_t color) {
+    const float px[5] = { 0.0f, 0.7f, 0.4f, -0.4f, -0.7f }, py[5] = { 1.0f, 0.2f, -0.8f, -0.8f, 0.2f };
+    glColorHex(color);
+    glBegin(GL_POLYGON);
+    for (int i = 0; i < 5; i++) glVertex2f(c.x + r * px[i], c.y + r * py[i]);
+    glEnd();
+    glColor3f(0, 0, 0);
+    glBegin(GL_LINE_LOOP);
+    for (int i = 0; i < 5; i++) glVertex2f(c.x + r * px[i], c.y + r * py[i]);
     glEnd();
-    // Power1 - blue pulsing
-    glColor3f(0.12f, 0.55f, 1.0f); drawCircle({ x + 2 * gap,y }, 15);
-    // Power2 - green pulsing
-    glColor3f(0.14f, 0.95f, 0.28f); drawCircle({ x + 3 * gap,y }, 15);
+}
 
-    // labels
+template <> void drawPowerUpShape<SHAPE_RING>(Vec2 c, float r, uint32_t color) {
+    glColorHex(color);
+    drawCircle(c, r);
+    glColor3f(0.15f, 0.2f, 0.45f);
+    drawCircle(c, r * 0.62f, 24);
+    glColorHex(color);
+    drawCircle(c, r * 0.25f, 12);
+}
+
+template <> void drawPowerUpShape<SHAPE_HORSESHOE>(Vec2 c, float r, uint32_t color) {
+    // U opening upwards: half annulus below, two legs with white tips above
+    float cy = c.y + r * 0.2f, in = r * 0.45f;
+    glColorHex(color);
+    glBegin(GL_TRIANGLE_STRIP);
+    for (int i = 0; i <= 12; i++) {
+        float a = 3.14159265f * (1.0f + i / 12.0f);
+        glVertex2f(c.x + cosf(a) * r, cy + sinf(a) * r);
+        glVertex2f(c.x + cosf(a) * in, cy + sinf(a) * in);
+    }
+    glEnd();
+    float top = c.y + r, tip = c.y + r * 0.7f;
+    glBegin(GL_QUADS);
+    glVertex2f(c.x - r, cy); glVertex2f(c.x - in, cy); glVertex2f(c.x - in, tip); glVertex2f(c.x - r, tip);
+    glVertex2f(c.x + in, cy); glVertex2f(c.x + r, cy); glVertex2f(c.x + r, tip); glVertex2f(c.x + in, tip);
     glColor3f(1, 1, 1);
-    print_on_screen((int)(x - 34), 12, "Obstacle");
-    print_on_screen((int)(x + gap - 40), 12, "Collectible");
-    print_on_screen((int)(x + 2 * gap - 28), 12, "Speed");
-    print_on_screen((int)(x + 3 * gap - 44), 12, "Double");
+    glVertex2f(c.x - r, tip); glVertex2f(c.x - in, tip); glVertex2f(c.x - in, top); glVertex2f(c.x - r, top);
+    glVertex2f(c.x + in, tip); glVertex2f(c.x + r, tip); glVertex2f(c.x + r, top); glVertex2f(c.x + in, top);
+    glEnd();
+}
+
+template <> void drawPowerUpShape<SHAPE_FLAKE>(Vec2 c, float r, uint32_t color) {
+    glColorHex(color);
+    glLineWidth(2.0f);
+    glBegin(GL_LINES);
+    for (int i = 0; i < 3; i++) {
+        float a = i * 3.14159265f / 3.0f + 3.14159265f / 2.0f;
+        glVertex2f(c.x - cosf(a) * r, c.y - sinf(a) * r); glVertex2f(c.x + cosf(a) * r, c.y + sinf(a) * r);
+    }
+    glEnd();
+    glLineWidth(1.0f);
+    drawCircle(c, r * 0.35f, 6);
+}
+
+// -----------------------------------------------
+// Keep player within the playable area boundaries
+// -----------------------------------------------
+Vec2 clampToArea(const GameState& g, Vec2 p, float pad = playerRadius + 2.0f) {
+    if (p.x < pad) p.x = pad;
+    if (p.x > g.worldW - pad) p.x = g.worldW - pad;
+    if (p.y < GAME_Y0 + pad) p.y = GAME_Y0 + pad;
+    if (p.y > GAME_Y0 + g.worldH - pad) p.y = GAME_Y0 + g.worldH - pad;
+    return p;
+}
+
+// the same in simulation numbers
+RVec clampToWorld(const GameState& g, RVec p, Real pad) {
+    Real x1 = Real(g.worldW) - pad, y0 = Real(GAME_Y0) + pad, y1 = Real(GAME_Y0) + Real(g.worldH) - pad;
+    if (p.x < pad) p.x = pad;
+    if (p.x > x1) p.x = x1;
+    if (p.y < y0) p.y = y0;
+    if (p.y > y1) p.y = y1;
+    return p;
+}
+
+// -------------------------------
+// Camera: the game area shows a screen-sized window of the world centred
+// on the player and clamped to the world's edges
+// -------------------------------
+struct ViewRect { float x0, y0, x1, y1; };
+
+ViewRect cameraView(const GameState& g) {
+    float w = (float)WIN_W, h = (float)(GAME_Y1 - GAME_Y0);
+    float x0 = (std::max)(0.0f, (std::min)(g.worldW - w, g.playerPos.x - w * 0.5f));
+    float y0 = GAME_Y0 + (std::max)(0.0f, (std::min)(g.worldH - h, g.playerPos.y - GAME_Y0 - h * 0.5f));
+    return { x0, y0, x0 + w, y0 + h };
+}
+
+// map the camera rectangle onto the game area of the window
+void beginWorldView(const ViewRect& v) {
+    int w = glutGet(GLUT_WINDOW_WIDTH), h = glutGet(GLUT_WINDOW_HEIGHT);
+    glViewport(0, GAME_Y0 * h / WIN_H, w, (GAME_Y1 - GAME_Y0) * h / WIN_H);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(v.x0, v.x1, v.y0, v.y1, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// back to window coordinates for the panels
+void endWorldView() {
+    glViewport(0, 0, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, WIN_W, 0, WIN_H, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// -------------------------------
+// Overlap / placement helper
+// -------------------------------
+// keeps placed objects off the ship's start and the target
+static inline bool nearActors(const GameState& g, const Vec2& p, float r) {
+    return dist(p, g.targetPos) < r + 20.0f + 6.0f || dist(p, g.playerPos) < r + playerRadius + 6.0f;
+}
+
+bool overlapsExisting(const GameState& g, const Vec2& p, float r) {
+    bool hit = false;
+    float x0 = p.x - r - 6.0f, y0 = p.y - r - 6.0f, x1 = p.x + r + 6.0f, y1 = p.y + r + 6.0f;
+    g.index.obstacles.query(x0, y0, x1, y1, [&](uint32_t i) { hit |= dist(p, g.obstacles[i].p) < r + g.obstacles[i].r + 6.0f; });
+    g.index.collectibles.query(x0, y0, x1, y1, [&](uint32_t i) { hit |= dist(p, g.collectibles[i].p) < r + g.collectibles[i].r + 6.0f; });
+    for (int t = 1; t < PU_TYPE_END; t++)
+        g.index.powerups[t].query(x0, y0, x1, y1, [&](uint32_t i) { hit |= dist(p, g.powerups[i].p) < r + g.powerups[i].r + 6.0f; });
+    return hit || nearActors(g, p, r);
+}
+
+// -------------------------------
+// Level files (one object per line: "O x y r", "C x y r", "P x y r type",
+// optionally "W width height" for a world larger than the screen)
+// -------------------------------
+// files hold 0.1 px. Saving writes a value's tenths as rounded here, and
+// the hot reload diff keys entities by the same tenths, so a saved level
+// reads back with the keys it was written with
+static inline int32_t levelTenths(float v) { return (int32_t)lroundf(v * 10.0f); }
+
+static void writeCircle(FILE* f, char kind, const Vec2& p, float r) {
+    int32_t v[3] = { levelTenths(p.x), levelTenths(p.y), levelTenths(r) };
+    fputc(kind, f);
+    for (int32_t t : v) fprintf(f, " %s%d.%d", t < 0 ? "-" : "", abs(t) / 10, abs(t) % 10);
+}
+
+bool saveLevel(const GameState& g, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "W %.0f %.0f\n", g.worldW, g.worldH);
+    for (auto& ob : g.obstacles) { writeCircle(f, 'O', ob.p, ob.r); fputc('\n', f); }
+    for (auto& c : g.collectibles) { writeCircle(f, 'C', c.p, c.r); fputc('\n', f); }
+    for (auto& pu : g.powerups) { writeCircle(f, 'P', pu.p, pu.r); fprintf(f, " %d\n", pu.type); }
+    fclose(f);
+    return true;
+}
+
+// the objects only: the level index is left for the caller to build
+bool readLevel(GameState& g, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    clearLevel(g);
+    char line[128];
+    // first pass sizes the arenas so loading does one allocation per kind
+    size_t counts[3] = { 0, 0, 0 };
+    while (fgets(line, sizeof(line), f)) {
+        char kind = 0;
+        if (sscanf(line, " %c", &kind) != 1) continue;
+        if (kind == 'O') counts[0]++; else if (kind == 'C') counts[1]++; else if (kind == 'P') counts[2]++;
+    }
+    g.obstacles.reserve(counts[0]); g.collectibles.reserve(counts[1]); g.powerups.reserve(counts[2]);
+    rewind(f);
+    bool sized = false;
+    float extentX = 0.0f, extentY = 0.0f;
+    while (fgets(line, sizeof(line), f)) {
+        char kind = 0; float x, y, r; int type = 1;
+        int n = sscanf(line, " %c %f %f %f %d", &kind, &x, &y, &r, &type);
+        if (kind == 'W' && n >= 3) {
+            g.worldW = (std::max)((float)WIN_W, x); g.worldH = (std::max)((float)(GAME_Y1 - GAME_Y0), y);
+            sized = true;
+            continue;
+        }
+        if (n < 4) continue; // blank line / comment
+        if (kind == 'O') g.obstacles.add({ { x, y }, r });
+        else if (kind == 'C') g.collectibles.add({ { x, y }, r, 0, 0.0f });
+        else if (kind == 'P') g.powerups.add({ { x, y }, r, clampPowerUpType(type), 0, 0.0f });
+        else continue;
+        extentX = (std::max)(extentX, x + r); extentY = (std::max)(extentY, y + r - GAME_Y0);
+    }
+    fclose(f);
+    // older files have no size line: make the world big enough for what is in them
+    if (!sized) {
+        g.worldW = (std::max)((float)WIN_W, ceilf(extentX + 20.0f));
+        g.worldH = (std::max)((float)(GAME_Y1 - GAME_Y0), ceilf(extentY + 20.0f));
+    }
+    groupPowerUps(g);
+    return true;
+}
+
+bool loadLevel(GameState& g, const char* path) {
+    if (!readLevel(g, path)) return false;
+    indexLevel(g);
+    return true;
+}
+
+// the objects and the world size; neither index is touched
+void swapLevel(GameState& a, GameState& b) {
+    a.obstacles.swap(b.obstacles); a.collectibles.swap(b.collectibles); a.powerups.swap(b.powerups);
+    std::swap_ranges(a.powerupRun, a.powerupRun + PU_TYPE_END + 1, b.powerupRun);
+    std::swap(a.worldW, b.worldW); std::swap(a.worldH, b.worldH);
+}
+
+void copyLevel(GameState& to, const GameState& from) {
+    to.obstacles = from.obstacles; to.collectibles = from.collectibles; to.powerups = from.powerups;
+    std::copy(from.powerupRun, from.powerupRun + PU_TYPE_END + 1, to.powerupRun);
+    to.worldW = from.worldW; to.worldH = from.worldH;
+}
+
+// replaces g's level with st's, leaving st the old one. An st already
+// indexed the way g is hands its index over instead of g rebuilding one
+void adoptLevel(GameState& g, GameState& st, bool indexed) {
+    swapLevel(g, st);
+    if (indexed && st.index.kind == g.index.kind) std::swap(g.index, st.index);
+    else indexLevel(g);
+}
+
+// -------------------------------
+// Draw HUD panels
+// -------------------------------
+void drawTopPanel(const GameState& g) {
+    // panel background
+    glColor3f(0.08f, 0.09f, 0.12f);
+    glBegin(GL_QUADS);
+    glVertex2f(0, WIN_H); glVertex2f(WIN_W, WIN_H);
+    glVertex2f(WIN_W, GAME_Y1); glVertex2f(0, GAME_Y1);
+    glEnd();
+
+    // Time (big, white)
+    char buf[64];
+    sprintf(buf, "TIME: %.1f s", g.remainingMs * 0.001f);
+    glColor3f(1.0f, 0.95f, 0.6f);
+    print_on_screen(20, WIN_H - 60, buf);
+
+    // Score
+    sprintf(buf, "SCORE: %d", g.playerScore);
+    glColor3f(0.8f, 0.9f, 1.0f);
+    print_on_screen(240, WIN_H - 60, buf);
+
+    // Lives as hearts (white outline + red fill)
+    float startX = WIN_W - 220;
+    for (int i = 0; i < g.playerLives; i++) {
+        float cx = startX + i * 36, cy = WIN_H - 60;
+        // red heart (two circles + triangle)
+        glColor3f(1.0f, 0.15f, 0.25f);
+        drawCircle({ cx - 6, cy + 6 }, 7, 16);
+        drawCircle({ cx + 6, cy + 6 }, 7, 16);
+        glBegin(GL_TRIANGLES);
+        glVertex2f(cx - 12, cy + 4); glVertex2f(cx + 12, cy + 4); glVertex2f(cx, cy - 8);
+        glEnd();
+        // outline
+        glColor3f(0.0f, 0.0f, 0.0f);
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(cx - 12, cy + 4); glVertex2f(cx + 12, cy + 4); glVertex2f(cx, cy - 8);
+        glEnd();
+    }
+}
+
+// editor buttons, left to right in PlaceMode order
+const float panelIconX0 = 170.0f, panelIconGap = 120.0f;
+
+void drawBottomPanel() {
+    glColor3f(0.06f, 0.06f, 0.08f);
+    glBegin(GL_QUADS);
+    glVertex2f(0, BOTTOM_H); glVertex2f(WIN_W, BOTTOM_H);
+    glVertex2f(WIN_W, 0); glVertex2f(0, 0);
+    glEnd();
+
+    // icons
+    float gap = panelIconGap;
+    float x = panelIconX0, y = 50.0f;
+    // Obstacle - red square icon
+    glColor3f(0.7f, 0.25f, 0.2f);
+    glBegin(GL_QUADS);
+    glVertex2f(x - 18, y - 18); glVertex2f(x + 18, y - 18); glVertex2f(x + 18, y + 18); glVertex2f(x - 18, y + 18);
+    glEnd();
+    // Collectible - golden triangle
+    glColor3f(1.0f, 0.92f, 0.16f);
+    glBegin(GL_TRIANGLES);
+    glVertex2f(x + gap, y + 16); glVertex2f(x + gap - 12, y - 12); glVertex2f(x + gap + 12, y - 12);
+    glEnd();
+    // one icon per power-up type, in PlaceMode order
+    forEachPowerUpType([&](auto t) {
+        constexpr int T = decltype(t)::value;
+        drawPowerUpShape<powerUpDefs[T].shape>({ x + (T + 1) * gap, y }, 15, powerUpDefs[T].color);
+    });
+
+    // labels
+    glColor3f(1, 1, 1);
+    print_on_screen((int)(x - 34), 12, "Obstacle");
+    print_on_screen((int)(x + gap - 40), 12, "Collectible");
+    for (int t = 1; t < PU_TYPE_END; t++) drawStringCentered((int)(x + (t + 1) * gap), 12, powerUpDefs[t].name);
+}
+
+// -------------------------------
+// Draw game objects and visuals
+// -------------------------------
+void drawBackgroundStars() {
+    // subtle moving stars
+    glColor3f(0.85f, 0.85f, 1.0f);
+    int count = 80;
+    float time = (float)glutGet(GLUT_ELAPSED_TIME) * 0.001f;
+    for (int i = 0; i < count; i++) {
+        float x = fmodf(i * 37.1f + time * 30.0f, (float)WIN_W);
+        float y = GAME_Y0 + fmodf(i * 61.7f + time * 13.0f, (float)(GAME_Y1 - GAME_Y0));
+        glPointSize((i % 6 == 0) ? 2.8f : 1.6f);
+        glBegin(GL_POINTS); glVertex2f(x, y); glEnd();
+    }
+}
+
+void drawPlayer(const GameState& g) {
+    const Vec2& playerPos = g.playerPos;
+    const Vec2& playerDir = g.playerDir;
+
+    // main body (the glow is in the glow pass)
+    glColor3f(0.18f, 0.7f, 1.0f);
+    drawCircle(playerPos, playerRadius, 32);
+
+    // nose / triangle pointing to direction
+    glColor3f(0.95f, 0.6f, 0.2f);
+    Vec2 tip = { playerPos.x + playerDir.x * (playerRadius + 10), playerPos.y + playerDir.y * (playerRadius + 10) };
+    Vec2 left = { playerPos.x - playerDir.y * 8.0f, playerPos.y + playerDir.x * 8.0f };
+    Vec2 right = { playerPos.x + playerDir.y * 8.0f, playerPos.y - playerDir.x * 8.0f };
+    glBegin(GL_TRIANGLES);
+    glVertex2f(tip.x, tip.y);
+    glVertex2f(left.x, left.y);
+    glVertex2f(right.x, right.y);
+    glEnd();
+
+    // direction line
+    glColor3f(1, 1, 1);
+    glBegin(GL_LINES);
+    glVertex2f(playerPos.x, playerPos.y);
+    glVertex2f(playerPos.x + playerDir.x * (playerRadius + 20), playerPos.y + playerDir.y * (playerRadius + 20));
+    glEnd();
+    // Add glowing center point for fourth primitive
+    glPointSize(6);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_POINTS);
+    glVertex2f(playerPos.x, playerPos.y);
+    glEnd();
+}
+
+void drawTarget(const GameState& g) {
+    glColor3f(0.7f, 0.18f, 0.9f);
+    drawCircle(g.targetPos, 14, 32);
+    glColor3f(1.0f, 0.6f, 1.0f);
+    drawCircle(g.targetPos, 7, 24);
+}
+
+void drawObstacles(const GameState& g) {
+    for (auto& o : g.obstacles) {
+        glColor3f(0.6f, 0.28f, 0.12f);
+        glBegin(GL_QUADS);
+        glVertex2f(o.p.x - o.r, o.p.y - o.r);
+        glVertex2f(o.p.x + o.r, o.p.y - o.r);
+        glVertex2f(o.p.x + o.r, o.p.y + o.r);
+        glVertex2f(o.p.x - o.r, o.p.y + o.r);
+        glEnd();
+        glColor3f(0, 0, 0);
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(o.p.x - o.r, o.p.y - o.r);
+        glVertex2f(o.p.x + o.r, o.p.y - o.r);
+        glVertex2f(o.p.x + o.r, o.p.y + o.r);
+        glVertex2f(o.p.x - o.r, o.p.y + o.r);
+        glEnd();
+    }
+}
+
+// animSec drives the spin/bob so drawing never writes to the (snapshot) state
+void drawCollectibles(const GameState& g, float animSec) {
+    float spin = fmodf(animSec * 90.0f, 360.0f);
+    for (auto& c : g.collectibles) {
+        if (!isLive(g, c)) continue;
+        glPushMatrix();
+        glTranslatef(c.p.x, c.p.y, 0);
+        glRotatef(c.rot + spin, 0, 0, 1);
+        glColor3f(1.0f, 0.92f, 0.2f);
+        glBegin(GL_TRIANGLES);
+        glVertex2f(0, c.r); glVertex2f(-c.r * 0.6f, -c.r * 0.6f); glVertex2f(c.r * 0.6f, -c.r * 0.6f);
+        glEnd();
+
+        // Outline using a line loop (3rd primitive)
+        glColor3f(0.3f, 0.3f, 0.3f);
+        glBegin(GL_LINE_LOOP);
+        glVertex2f(0, c.r);
+        glVertex2f(-c.r * 0.6f, -c.r * 0.6f);
+        glVertex2f(c.r * 0.6f, -c.r * 0.6f);
+        glEnd();
+        glPopMatrix();
+    }
+}
+
+template <int T>
+void drawPowerUpsOfType(const GameState& g, float animSec) {
+    for (uint32_t i = g.powerupRun[T]; i < g.powerupRun[T + 1]; i++) {
+        const PowerUp& p = g.powerups[i];
+        if (!isLive(g, p)) continue;
+        float bob = sinf(p.phase + animSec * 3.0f) * 6.0f;
+        drawPowerUpShape<powerUpDefs[T].shape>({ p.p.x, p.p.y + bob }, p.r, powerUpDefs[T].color);
+    }
+}
+
+void drawPowerUps(const GameState& g, float animSec) {
+    forEachPowerUpType([&](auto t) { drawPowerUpsOfType<decltype(t)::value>(g, animSec); });
+}
+
+static inline uint32_t xorshift32(uint32_t& s) {
+    s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s;
+}
+static inline float rand01(uint32_t& s) { return (xorshift32(s) >> 8) * (1.0f / 16777216.0f); }
+
+// -------------------------------
+// Particles: structure-of-arrays pools, one per blend mode. Integration
+// runs four particles at a time (SSE), dead ones are swap-removed and each
+// pool is drawn with a single vertex-array call.
+// -------------------------------
+enum ParticleBlend { BLEND_ADD = 0, BLEND_ALPHA, BLEND_COUNT };
+
+struct ParticlePool {
+    size_t count = 0, cap = 0; // cap is a multiple of 4 so SIMD tails stay in bounds
+    std::vector<float> x, y, vx, vy, life, invLife;
+    std::vector<uint32_t> rgb;
+    // staging for the batched draw
+    std::vector<float> verts;
+    std::vector<uint8_t> colors;
+    float pointSize = 3.0f;
+};
+
+struct ParticleSystem {
+    ParticlePool pools[BLEND_COUNT];
+    uint32_t rng = 0x2545F491u;
+    float drag = 1.6f;              // velocity loss per second
+    float trailAccum = 0.0f, sparkleAccum = 0.0f;
+    unsigned long long dropped = 0; // spawns refused because a pool was full
+};
+
+ParticleSystem particles;
+bool particlesSimd = true; // --particle-bench compares against the scalar loop
+
+// bursts requested by the simulation thread, turned into particles on the render thread
+struct FxBurst { Vec2 at; int blend, n; float speed, life; uint32_t rgb; };
+SpscRing<FxBurst, 1024> simFx;
+
+void particlesReserve(ParticleSystem& ps, size_t perPool) {
+    perPool = (perPool + 3) & ~(size_t)3;
+    for (auto& p : ps.pools) {
+        if (p.cap >= perPool) continue;
+        for (auto* v : { &p.x, &p.y, &p.vx, &p.vy, &p.life, &p.invLife, }) v->resize(perPool);
+        p.rgb.resize(perPool);
+        p.verts.resize(perPool * 2);
+        p.colors.resize(perPool * 4);
+        p.cap = perPool;
+    }
+    ps.pools[BLEND_ALPHA].pointSize = 4.0f;
+}
+
+static inline void emitParticle(ParticleSystem& ps, int blend, float x, float y, float vx, float vy, float life, uint32_t rgb) {
+    ParticlePool& p = ps.pools[blend];
+    if (p.count >= p.cap) { ps.dropped++; return; }
+    size_t i = p.count++;
+    p.x[i] = x; p.y[i] = y; p.vx[i] = vx; p.vy[i] = vy;
+    p.life[i] = life; p.invLife[i] = 1.0f / life; p.rgb[i] = rgb;
+}
+
+// n particles flying out of `at` in all directions
+void emitBurst(ParticleSystem& ps, int blend, Vec2 at, int n, float speed, float life, uint32_t rgb) {
+    for (int k = 0; k < n; k++) {
+        float a = rand01(ps.rng) * 6.2831853f;
+        float v = speed * (0.3f + 0.7f * rand01(ps.rng));
+        emitParticle(ps, blend, at.x, at.y, cosf(a) * v, sinf(a) * v, life * (0.6f + 0.4f * rand01(ps.rng)), rgb);
+    }
+}
+
+// engine trail behind the ship and sparkles around live power-ups
+void emitAmbientParticles(ParticleSystem& ps, const GameState& g, float dt) {
+    if (!g.running) return;
+    bool thrust = g.keyLeft || g.keyRight || g.keyUp || g.keyDown;
+    ps.trailAccum += thrust ? dt * (g.speedActive ? 240.0f : 140.0f) : 0.0f;
+    for (; ps.trailAccum >= 1.0f; ps.trailAccum -= 1.0f) {
+        float jx = (rand01(ps.rng) - 0.5f) * 60.0f, jy = (rand01(ps.rng) - 0.5f) * 60.0f;
+        emitParticle(ps, BLEND_ADD,
+            g.playerPos.x - g.playerDir.x * playerRadius, g.playerPos.y - g.playerDir.y * playerRadius,
+            -g.playerDir.x * 160.0f + jx, -g.playerDir.y * 160.0f + jy,
+            0.35f + 0.25f * rand01(ps.rng), g.speedActive ? 0x40C8FFu : 0xFF9A30u);
+    }
+    ps.sparkleAccum += dt * 5.0f;
+    for (; ps.sparkleAccum >= 1.0f; ps.sparkleAccum -= 1.0f)
+        for (auto& pu : g.powerups) {
+            if (!isLive(g, pu)) continue;
+            float a = rand01(ps.rng) * 6.2831853f;
+            emitParticle(ps, BLEND_ADD, pu.p.x + cosf(a) * pu.r, pu.p.y + sinf(a) * pu.r,
+                cosf(a) * 12.0f, sinf(a) * 12.0f + 10.0f, 0.6f, powerUpDefs[pu.type].sparkle);
+        }
+}
+
+static void integratePool(ParticlePool& p, float dt, float damp) {
+    size_t n = p.count;
+    float* __restrict x = p.x.data(); float* __restrict y = p.y.data();
+    float* __restrict vx = p.vx.data(); float* __restrict vy = p.vy.data();
+    float* __restrict life = p.life.data();
+    size_t i = 0;
+#ifdef PARTICLES_SSE
+    if (particlesSimd) {
+        const __m128 vdt = _mm_set1_ps(dt), vdamp = _mm_set1_ps(damp);
+        for (; i < n; i += 4) { // may run past count, never past cap
+            __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i);
+            __m128 qx = _mm_loadu_ps(vx + i), qy = _mm_loadu_ps(vy + i);
+            _mm_storeu_ps(x + i, _mm_add_ps(px, _mm_mul_ps(qx, vdt)));
+            _mm_storeu_ps(y + i, _mm_add_ps(py, _mm_mul_ps(qy, vdt)));
+            _mm_storeu_ps(vx + i, _mm_mul_ps(qx, vdamp));
+            _mm_storeu_ps(vy + i, _mm_mul_ps(qy, vdamp));
+            _mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), vdt));
+        }
+        return;
+    }
+#endif
+    for (; i < n; i++) {
+        x[i] += vx[i] * dt; y[i] += vy[i] * dt;
+        vx[i] *= damp; vy[i] *= damp;
+        life[i] -= dt;
+    }
+}
+
+// swap-remove: order is irrelevant, so the last live particle fills each hole
+static void expirePool(ParticlePool& p) {
+    size_t i = 0;
+    while (i < p.count) {
+        if (p.life[i] > 0.0f) { i++; continue; }
+        size_t last = --p.count;
+        p.x[i] = p.x[last]; p.y[i] = p.y[last]; p.vx[i] = p.vx[last]; p.vy[i] = p.vy[last];
+        p.life[i] = p.life[last]; p.invLife[i] = p.invLife[last]; p.rgb[i] = p.rgb[last];
+    }
+}
+
+void updateParticles(ParticleSystem& ps, float dt) {
+    float damp = (std::max)(0.0f, 1.0f - ps.drag * dt);
+    for (auto& p : ps.pools) {
+        integratePool(p, dt, damp);
+        expirePool(p);
+    }
+}
+
+// write positions and faded colours into the pool's staging arrays
+void particlesFill(ParticlePool& p) {
+    float* v = p.verts.data();
+    uint8_t* c = p.colors.data();
+    for (size_t i = 0; i < p.count; i++) {
+        v[2 * i] = p.x[i]; v[2 * i + 1] = p.y[i];
+        uint32_t rgb = p.rgb[i];
+        c[4 * i] = (uint8_t)(rgb >> 16); c[4 * i + 1] = (uint8_t)(rgb >> 8); c[4 * i + 2] = (uint8_t)rgb;
+        c[4 * i + 3] = (uint8_t)(255.0f * (std::min)(1.0f, p.life[i] * p.invLife[i]));
+    }
+}
+
+void drawParticles(ParticleSystem& ps) {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    for (int b = 0; b < BLEND_COUNT; b++) {
+        ParticlePool& p = ps.pools[b];
+        if (!p.count) continue;
+        particlesFill(p);
+        glState.use(b == BLEND_ADD ? BLEND_MODE_ADD : BLEND_MODE_ALPHA);
+        glPointSize(p.pointSize);
+        glVertexPointer(2, GL_FLOAT, 0, p.verts.data());
+        glColorPointer(4, GL_UNSIGNED_BYTE, 0, p.colors.data());
+        glDrawArrays(GL_POINTS, 0, (GLsizei)p.count);
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glState.set(BLEND_MODE_OPAQUE);
+    glPointSize(1.0f);
+}
+
+// -------------------------------
+// Instanced renderer (OpenGL 3.3): obstacles, collectibles and power-ups
+// as instances of five unit meshes (circle, quad, triangle, pentagon and
+// the magnet's arch) in one static VBO. Each instance carries position, size, rotation and
+// spin, bob and colour; the vertex shader animates the spin and bob, the
+// fragment shader fades glows out from their centre. Instances are sorted
+// into layers (glow, outline, body, detail) and each layer draws one
+// instanced call per mesh. Chosen at startup (--renderer); without GL 3.3
+// the legacy immediate-mode path draws everything.
+// -------------------------------
+enum RendererKind { RENDER_LEGACY, RENDER_INSTANCED };
+RendererKind renderer = RENDER_LEGACY;
+
+// The types and enums those entry points need. Windows' gl.h stops at 1.1
+// and the SDK ships no glext.h, so they are declared here; where gl.h
+// already pulls in glext.h (Mesa), its GL_VERSION_* guards skip them.
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#ifndef APIENTRYP
+#define APIENTRYP APIENTRY *
+#endif
+#ifndef GL_VERSION_1_5
+typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STATIC_DRAW 0x88E4
+typedef void (APIENTRYP PFNGLBINDBUFFERPROC)(GLenum target, GLuint buffer);
+typedef void (APIENTRYP PFNGLGENBUFFERSPROC)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRYP PFNGLBUFFERDATAPROC)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+typedef void (APIENTRYP PFNGLBUFFERSUBDATAPROC)(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+#endif
+#ifndef GL_VERSION_2_0
+typedef char GLchar;
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+typedef void (APIENTRYP PFNGLATTACHSHADERPROC)(GLuint program, GLuint shader);
+typedef void (APIENTRYP PFNGLCOMPILESHADERPROC)(GLuint shader);
+typedef GLuint (APIENTRYP PFNGLCREATEPROGRAMPROC)(void);
+typedef GLuint (APIENTRYP PFNGLCREATESHADERPROC)(GLenum type);
+typedef void (APIENTRYP PFNGLDELETESHADERPROC)(GLuint shader);
+typedef void (APIENTRYP PFNGLENABLEVERTEXATTRIBARRAYPROC)(GLuint index);
+typedef void (APIENTRYP PFNGLGETPROGRAMIVPROC)(GLuint program, GLenum pname, GLint* params);
+typedef void (APIENTRYP PFNGLGETPROGRAMINFOLOGPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog);
+typedef void (APIENTRYP PFNGLGETSHADERIVPROC)(GLuint shader, GLenum pname, GLint* params);
+typedef void (APIENTRYP PFNGLGETSHADERINFOLOGPROC)(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog);
+typedef GLint (APIENTRYP PFNGLGETUNIFORMLOCATIONPROC)(GLuint program, const GLchar* name);
+typedef void (APIENTRYP PFNGLLINKPROGRAMPROC)(GLuint program);
+typedef void (APIENTRYP PFNGLSHADERSOURCEPROC)(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length);
+typedef void (APIENTRYP PFNGLUSEPROGRAMPROC)(GLuint program);
+typedef void (APIENTRYP PFNGLUNIFORM1FPROC)(GLint location, GLfloat v0);
+typedef void (APIENTRYP PFNGLUNIFORM4FPROC)(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+typedef void (APIENTRYP PFNGLVERTEXATTRIBPOINTERPROC)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+#endif
+#ifndef GL_VERSION_3_0
+typedef void (APIENTRYP PFNGLBINDVERTEXARRAYPROC)(GLuint array);
+typedef void (APIENTRYP PFNGLGENVERTEXARRAYSPROC)(GLsizei n, GLuint* arrays);
+#endif
+#ifndef GL_VERSION_3_1
+typedef void (APIENTRYP PFNGLDRAWARRAYSINSTANCEDPROC)(GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+#endif
+#ifndef GL_VERSION_3_3
+typedef void (APIENTRYP PFNGLVERTEXATTRIBDIVISORPROC)(GLuint index, GLuint divisor);
+#endif
+
+// GL 2.0+ entry points, fetched at startup (Windows' opengl32 only exports 1.1)
+struct Gl33 {
+    PFNGLCREATESHADERPROC CreateShader;
+    PFNGLSHADERSOURCEPROC ShaderSource;
+    PFNGLCOMPILESHADERPROC CompileShader;
+    PFNGLGETSHADERIVPROC GetShaderiv;
+    PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog;
+    PFNGLDELETESHADERPROC DeleteShader;
+    PFNGLCREATEPROGRAMPROC CreateProgram;
+    PFNGLATTACHSHADERPROC AttachShader;
+    PFNGLLINKPROGRAMPROC LinkProgram;
+    PFNGLGETPROGRAMIVPROC GetProgramiv;
+    PFNGLGETPROGRAMINFOLOGPROC GetProgramInfoLog;
+    PFNGLUSEPROGRAMPROC UseProgram;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+    PFNGLUNIFORM1FPROC Uniform1f;
+    PFNGLUNIFORM4FPROC Uniform4f;
+    PFNGLGENBUFFERSPROC GenBuffers;
+    PFNGLBINDBUFFERPROC BindBuffer;
+    PFNGLBUFFERDATAPROC BufferData;
+    PFNGLBUFFERSUBDATAPROC BufferSubData;
+    PFNGLGENVERTEXARRAYSPROC GenVertexArrays;
+    PFNGLBINDVERTEXARRAYPROC BindVertexArray;
+    PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+    PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+    PFNGLDRAWARRAYSINSTANCEDPROC DrawArraysInstanced;
+};
+
+#ifndef _WIN32
+void* (*eglProc)(const char*) = NULL; // eglGetProcAddress while --render-check runs on EGL
+#endif
+
+static void* glProc(const char* name) {
+#ifdef _WIN32
+    return (void*)wglGetProcAddress(name);
+#else
+    if (eglProc) return eglProc(name);
+    return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+}
+
+bool loadGl33(Gl33& f) {
+    void** slot = (void**)&f;
+    const char* names[] = { "glCreateShader", "glShaderSource", "glCompileShader", "glGetShaderiv", "glGetShaderInfoLog",
+        "glDeleteShader", "glCreateProgram", "glAttachShader", "glLinkProgram", "glGetProgramiv", "glGetProgramInfoLog",
+        "glUseProgram", "glGetUniformLocation", "glUniform1f", "glUniform4f", "glGenBuffers", "glBindBuffer", "glBufferData",
+        "glBufferSubData", "glGenVertexArrays", "glBindVertexArray", "glVertexAttribPointer", "glEnableVertexAttribArray",
+        "glVertexAttribDivisor", "glDrawArraysInstanced" };
+    static_assert(sizeof(names) / sizeof(names[0]) * sizeof(void*) == sizeof(Gl33), "one name per entry point");
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        if (!(slot[i] = glProc(names[i]))) return false;
+    return true;
+}
+
+enum InstanceMesh { MESH_CIRCLE, MESH_QUAD, MESH_TRIANGLE, MESH_PENTAGON, MESH_ARCH, MESH_COUNT }; // arch: the magnet's bend
+// drawn in this order (glows under every body, as in the legacy glow pass); glows are additive, the rest opaque
+enum InstanceLayer { LAYER_GLOW, LAYER_OBSTACLE_EDGE, LAYER_OBSTACLE, LAYER_BACK, LAYER_BODY, LAYER_DETAIL, LAYER_TOP, LAYER_COUNT };
+
+struct Instance {
+    float x, y, w, h;          // centre and half size (the meshes span -1..1)
+    float rot, spin, bob, phase; // radians, radians/s, bob amplitude (px), bob phase
+    uint32_t rgba;             // bytes r, g, b, a in memory order
+    float glow;                // > 0: peak alpha of a glow fading out to the rim
+};
+
+struct InstancedRenderer {
+    Gl33 gl;
+    GLuint program = 0, vao = 0, meshVbo = 0, instanceVbo = 0;
+    GLint uView = -1, uTime = -1;
+    GLint meshFirst[MESH_COUNT], meshCount[MESH_COUNT];
+    size_t instanceCap = 0;
+    // per-frame staging, grown once and reused
+    std::vector<Instance> staged, sorted;
+    std::vector<uint8_t> key; // layer * MESH_COUNT + mesh, per staged instance
+    // last frame
+    size_t instances = 0;
+    int drawCalls = 0;
+};
+InstancedRenderer instancedRenderer;
+
+static inline uint32_t packRgba(float r, float g, float b, float a = 1.0f) {
+    uint8_t c[4] = { (uint8_t)(r * 255.0f + 0.5f), (uint8_t)(g * 255.0f + 0.5f), (uint8_t)(b * 255.0f + 0.5f), (uint8_t)(a * 255.0f + 0.5f) };
+    uint32_t v;
+    memcpy(&v, c, 4);
+    return v;
+}
+static inline uint32_t packHex(uint32_t hex) { return packRgba((hex >> 16 & 255) / 255.0f, (hex >> 8 & 255) / 255.0f, (hex & 255) / 255.0f); }
+
+static GLuint compileShader(const Gl33& gl, GLenum type, const char* src) {
+    GLuint sh = gl.CreateShader(type);
+    gl.ShaderSource(sh, 1, &src, NULL);
+    gl.CompileShader(sh);
+    GLint ok = 0;
+    gl.GetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        gl.GetShaderInfoLog(sh, sizeof(log), NULL, log);
+        printf("Instanced renderer: shader does not compile:\n%s\n", log);
+        gl.DeleteShader(sh);
+        return 0;
+    }
+    return sh;
+}
+
+// needs a current context; false (with the reason printed) means stay on the legacy path
+bool initInstancedRenderer(InstancedRenderer& ir) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if (!version || sscanf(version, "%d.%d", &major, &minor) != 2 || major * 10 + minor < 33) {
+        printf("Instanced renderer: needs OpenGL 3.3, have %s\n", version ? version : "none");
+        return false;
+    }
+    if (!loadGl33(ir.gl)) { printf("Instanced renderer: GL 3.3 entry points missing\n"); return false; }
+    const Gl33& gl = ir.gl;
+
+    const char* vs =
+        "#version 330 core\n"
+        "layout(location = 0) in vec2 corner;\n"
+        "layout(location = 1) in vec4 place;\n"   // x, y, half width, half height
+        "layout(location = 2) in vec4 motion;\n"  // rotation, spin, bob, phase
+        "layout(location = 3) in vec4 color;\n"
+        "layout(location = 4) in float glow;\n"
+        "uniform vec4 view;\n"                    // world x0, y0, 2 / width, 2 / height
+        "uniform float time;\n"
+        "out vec4 vColor; out vec2 vLocal; out float vGlow;\n"
+        "void main() {\n"
+        "    float a = motion.x + motion.y * time, c = cos(a), s = sin(a);\n"
+        "    vec2 p = corner * place.zw;\n"
+        "    vec2 at = place.xy + vec2(p.x * c - p.y * s, p.x * s + p.y * c) + vec2(0.0, motion.z * sin(motion.w + time * 3.0));\n"
+        "    gl_Position = vec4((at - view.xy) * view.zw - 1.0, 0.0, 1.0);\n"
+        "    vColor = color; vLocal = corner; vGlow = glow;\n"
+        "}\n";
+    const char* fs =
+        "#version 330 core\n"
+        "in vec4 vColor; in vec2 vLocal; in float vGlow;\n"
+        "out vec4 frag;\n"
+        "void main() {\n"
+        "    float a = vGlow > 0.0 ? vGlow * (1.0 - smoothstep(0.75, 1.0, length(vLocal))) : vColor.a;\n"
+        "    frag = vec4(vColor.rgb, a);\n"
+        "}\n";
+    GLuint v = compileShader(gl, GL_VERTEX_SHADER, vs), f = compileShader(gl, GL_FRAGMENT_SHADER, fs);
+    if (!v || !f) return false;
+    ir.program = gl.CreateProgram();
+    gl.AttachShader(ir.program, v);
+    gl.AttachShader(ir.program, f);
+    gl.LinkProgram(ir.program);
+    gl.DeleteShader(v); gl.DeleteShader(f);
+    GLint ok = 0;
+    gl.GetProgramiv(ir.program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        gl.GetProgramInfoLog(ir.program, sizeof(log), NULL, log);
+        printf("Instanced renderer: program does not link:\n%s\n", log);
+        return false;
+    }
+    ir.uView = gl.GetUniformLocation(ir.program, "view");
+    ir.uTime = gl.GetUniformLocation(ir.program, "time");
+
+    // the unit meshes as triangle lists: circle of 24, quad, the collectible's triangle, pentagon, arch
+    std::vector<float> mesh;
+    auto tri = [&mesh](float ax, float ay, float bx, float by, float cx, float cy) {
+        float t[6] = { ax, ay, bx, by, cx, cy };
+        mesh.insert(mesh.end(), t, t + 6);
+    };
+    const float pi = 3.14159265358979323846f;
+    ir.meshFirst[MESH_CIRCLE] = 0;
+    for (int i = 0; i < 24; i++) tri(0, 0, cosf(i * pi / 12), sinf(i * pi / 12), cosf((i + 1) * pi / 12), sinf((i + 1) * pi / 12));
+    ir.meshFirst[MESH_QUAD] = (GLint)(mesh.size() / 2);
+    tri(-1, -1, 1, -1, 1, 1); tri(-1, -1, 1, 1, -1, 1);
+    ir.meshFirst[MESH_TRIANGLE] = (GLint)(mesh.size() / 2);
+    tri(0, 1, -0.6f, -0.6f, 0.6f, -0.6f);
+    ir.meshFirst[MESH_PENTAGON] = (GLint)(mesh.size() / 2);
+    const float px[5] = { 0.0f, 0.7f, 0.4f, -0.4f, -0.7f }, py[5] = { 1.0f, 0.2f, -0.8f, -0.8f, 0.2f };
+    for (int i = 1; i < 4; i++) tri(px[0], py[0], px[i], py[i], px[i + 1], py[i + 1]);
+    ir.meshFirst[MESH_ARCH] = (GLint)(mesh.size() / 2);
+    for (int i = 0; i < 12; i++) {
+        // lower half of a ring from radius 0.45 to 1
+        float a0 = pi * (1.0f + i / 12.0f), a1 = pi * (1.0f + (i + 1) / 12.0f);
+        float c0 = cosf(a0), s0 = sinf(a0), c1 = cosf(a1), s1 = sinf(a1);
+        tri(c0, s0, c1, s1, 0.45f * c1, 0.45f * s1); tri(c0, s0, 0.45f * c1, 0.45f * s1, 0.45f * c0, 0.45f * s0);
+    }
+    for (int m = 0; m < MESH_COUNT; m++)
+        ir.meshCount[m] = (m + 1 < MESH_COUNT ? ir.meshFirst[m + 1] : (GLint)(mesh.size() / 2)) - ir.meshFirst[m];
+
+    gl.GenVertexArrays(1, &ir.vao);
+    gl.BindVertexArray(ir.vao);
+    gl.GenBuffers(1, &ir.meshVbo);
+    gl.BindBuffer(GL_ARRAY_BUFFER, ir.meshVbo);
+    gl.BufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(float), mesh.data(), GL_STATIC_DRAW);
+    gl.VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+    gl.EnableVertexAttribArray(0);
+    gl.GenBuffers(1, &ir.instanceVbo);
+    gl.BindBuffer(GL_ARRAY_BUFFER, ir.instanceVbo);
+    for (GLuint a = 1; a <= 4; a++) { gl.EnableVertexAttribArray(a); gl.VertexAttribDivisor(a, 1); }
+    gl.BindVertexArray(0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+static inline void stageInstance(InstancedRenderer& ir, InstanceLayer layer, InstanceMesh mesh, const Instance& in) {
+    ir.staged.push_back(in);
+    ir.key.push_back((uint8_t)(layer * MESH_COUNT + mesh));
+}
+
+// a thin quad from the centre offset (dx, dy) along angle a, like a 1-2 px line
+static inline Instance lineInstance(Vec2 c, float dx, float dy, float halfLen, float halfWidth, float a, float bob, float phase, uint32_t rgba) {
+    return { c.x + dx, c.y + dy, halfLen, halfWidth, a, 0.0f, bob, phase, rgba, 0.0f };
+}
+
+// one power-up in the shape its type's row asks for, bobbing as in drawPowerUpsOfType
+static void stagePowerUp(InstancedRenderer& ir, const PowerUp& p) {
+    const PowerUpDef& def = powerUpDefs[p.type];
+    uint32_t color = packHex(def.color), white = packRgba(1, 1, 1), black = packRgba(0, 0, 0);
+    Vec2 c = p.p;
+    float r = p.r, bob = 6.0f, ph = p.phase;
+    auto at = [&](InstanceLayer l, InstanceMesh m, float dx, float dy, float hw, float hh, uint32_t rgba) {
+        stageInstance(ir, l, m, { c.x + dx, c.y + dy, hw, hh, 0.0f, 0.0f, bob, ph, rgba, 0.0f });
+    };
+    switch (def.shape) {
+    case SHAPE_ORB:
+        at(LAYER_BODY, MESH_CIRCLE, 0, 0, r, r, color);
+        for (int s = -1; s <= 1; s += 2)
+            stageInstance(ir, LAYER_DETAIL, MESH_QUAD, lineInstance(c, 0, 0, r * 0.45f, 0.5f, s * 0.315f, bob, ph, white));
+        break;
+    case SHAPE_PENTAGON:
+        at(LAYER_BACK, MESH_PENTAGON, 0, 0, r + 1.0f, r + 1.0f, black);
+        at(LAYER_BODY, MESH_PENTAGON, 0, 0, r, r, color);
+        break;
+    case SHAPE_RING:
+        at(LAYER_BODY, MESH_CIRCLE, 0, 0, r, r, color);
+        at(LAYER_DETAIL, MESH_CIRCLE, 0, 0, r * 0.62f, r * 0.62f, packRgba(0.15f, 0.2f, 0.45f));
+        at(LAYER_TOP, MESH_CIRCLE, 0, 0, r * 0.25f, r * 0.25f, color);
+        break;
+    case SHAPE_HORSESHOE:
+        // the bend, two legs and their white tips
+        at(LAYER_BODY, MESH_ARCH, 0.0f, 0.2f * r, r, r, color);
+        at(LAYER_BODY, MESH_QUAD, -0.725f * r, 0.45f * r, 0.275f * r, 0.25f * r, color);
+        at(LAYER_BODY, MESH_QUAD, 0.725f * r, 0.45f * r, 0.275f * r, 0.25f * r, color);
+        at(LAYER_DETAIL, MESH_QUAD, -0.725f * r, 0.85f * r, 0.275f * r, 0.15f * r, white);
+        at(LAYER_DETAIL, MESH_QUAD, 0.725f * r, 0.85f * r, 0.275f * r, 0.15f * r, white);
+        break;
+    case SHAPE_FLAKE:
+        for (int i = 0; i < 3; i++)
+            stageInstance(ir, LAYER_BODY, MESH_QUAD, lineInstance(c, 0, 0, r, 1.0f, i * 3.14159265f / 3.0f + 3.14159265f / 2.0f, bob, ph, color));
+        at(LAYER_DETAIL, MESH_CIRCLE, 0, 0, r * 0.35f, r * 0.35f, color);
+        break;
+    }
+}
+
+// the entities of a snapshot through the camera `v`, drawn into the game-area viewport
+void drawEntitiesInstanced(InstancedRenderer& ir, const GameState& g, const ViewRect& v, float animSec) {
+    ir.staged.clear(); ir.key.clear();
+    uint32_t brown = packRgba(0.6f, 0.28f, 0.12f), black = packRgba(0, 0, 0);
+    for (auto& o : g.obstacles) {
+        stageInstance(ir, LAYER_OBSTACLE_EDGE, MESH_QUAD, { o.p.x, o.p.y, o.r, o.r, 0, 0, 0, 0, black, 0 });
+        stageInstance(ir, LAYER_OBSTACLE, MESH_QUAD, { o.p.x, o.p.y, o.r - 1.0f, o.r - 1.0f, 0, 0, 0, 0, brown, 0 });
+    }
+    uint32_t gold = packRgba(1.0f, 0.92f, 0.2f), grey = packRgba(0.3f, 0.3f, 0.3f), halo = packRgba(1.0f, 0.86f, 0.2f);
+    const float spin = 3.14159265f / 2.0f; // 90 degrees a second, as drawCollectibles
+    for (auto& c : g.collectibles) {
+        if (!isLive(g, c)) continue;
+        float rot = c.rot * (3.14159265f / 180.0f);
+        stageInstance(ir, LAYER_GLOW, MESH_CIRCLE, { c.p.x, c.p.y, c.r + 7, c.r + 7, 0, 0, 0, 0, halo, 0.14f });
+        stageInstance(ir, LAYER_BACK, MESH_TRIANGLE, { c.p.x, c.p.y, c.r + 1.5f, c.r + 1.5f, rot, spin, 0, 0, grey, 0 });
+        stageInstance(ir, LAYER_BODY, MESH_TRIANGLE, { c.p.x, c.p.y, c.r, c.r, rot, spin, 0, 0, gold, 0 });
+    }
+    for (uint32_t i = g.powerupRun[1]; i < g.powerupRun[PU_TYPE_END]; i++)
+        if (isLive(g, g.powerups[i])) stagePowerUp(ir, g.powerups[i]);
+
+    // counting sort into (layer, mesh) runs
+    const int KEYS = LAYER_COUNT * MESH_COUNT;
+    uint32_t start[KEYS + 1] = {};
+    for (uint8_t k : ir.key) start[k + 1]++;
+    for (int k = 0; k < KEYS; k++) start[k + 1] += start[k];
+    ir.sorted.resize(ir.staged.size());
+    uint32_t fill[KEYS];
+    memcpy(fill, start, sizeof(fill));
+    for (size_t i = 0; i < ir.staged.size(); i++) ir.sorted[fill[ir.key[i]]++] = ir.staged[i];
+
+    const Gl33& gl = ir.gl;
+    gl.UseProgram(ir.program);
+    gl.Uniform4f(ir.uView, v.x0, v.y0, 2.0f / (v.x1 - v.x0), 2.0f / (v.y1 - v.y0));
+    gl.Uniform1f(ir.uTime, animSec);
+    gl.BindVertexArray(ir.vao);
+    gl.BindBuffer(GL_ARRAY_BUFFER, ir.instanceVbo);
+    if (ir.sorted.size() > ir.instanceCap) ir.instanceCap = (std::max)(ir.sorted.size(), ir.instanceCap * 2);
+    // a fresh store each frame (grown, or orphaning the one the GPU may still read)
+    gl.BufferData(GL_ARRAY_BUFFER, ir.instanceCap * sizeof(Instance), NULL, GL_STREAM_DRAW);
+    if (!ir.sorted.empty()) gl.BufferSubData(GL_ARRAY_BUFFER, 0, ir.sorted.size() * sizeof(Instance), ir.sorted.data());
+
+    ir.drawCalls = 0;
+    for (int k = 0; k < KEYS; k++) {
+        GLsizei n = (GLsizei)(start[k + 1] - start[k]);
+        if (!n) continue;
+        int layer = k / MESH_COUNT, mesh = k % MESH_COUNT;
+        glState.use(layer == LAYER_GLOW ? BLEND_MODE_ADD : BLEND_MODE_OPAQUE);
+        // no base instance in 3.3: point the per-instance attributes at this run
+        const char* base = (const char*)(start[k] * sizeof(Instance));
+        gl.VertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, x));
+        gl.VertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, rot));
+        gl.VertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Instance), base + offsetof(Instance, rgba));
+        gl.VertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), base + offsetof(Instance, glow));
+        gl.DrawArraysInstanced(GL_TRIANGLES, ir.meshFirst[mesh], ir.meshCount[mesh], n);
+        ir.drawCalls++;
+    }
+    glState.set(BLEND_MODE_OPAQUE);
+    gl.BindVertexArray(0);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.UseProgram(0);
+    ir.instances = ir.sorted.size();
+}
+
+// glows of the live collectibles; the instanced renderer draws its own
+void queueCollectibleGlows(BlendQueue& q, const GameState& g) {
+    for (auto& c : g.collectibles)
+        if (isLive(g, c)) q.circle(PASS_GLOW, BLEND_MODE_ADD, c.p, c.r + 6, 24, 1.0f, 0.86f, 0.2f, 0.12f);
+}
+
+void queueActorGlows(BlendQueue& q, const GameState& g) {
+    q.circle(PASS_GLOW, BLEND_MODE_ADD, g.targetPos, 24, 36, 0.8f, 0.25f, 0.9f, 0.18f);
+    q.circle(PASS_GLOW, BLEND_MODE_ADD, g.playerPos, playerRadius + 8, 32, 0.1f, 0.6f, 1.0f, 0.18f);
+}
+
+// the level's entities with whichever renderer was chosen at startup
+void drawEntities(const GameState& g, const ViewRect& v, float animSec) {
+    if (renderer == RENDER_INSTANCED) { drawEntitiesInstanced(instancedRenderer, g, v, animSec); return; }
+    drawObstacles(g);
+    drawCollectibles(g, animSec);
+    drawPowerUps(g, animSec);
+}
+
+// -------------------------------
+// Timed effects on top of the wheel
+// -------------------------------
+static void setEffectFlag(GameState& g, uint8_t kind, bool on) {
+    if (kind == TIMER_INVULN) g.invulnerable = on;
+    else if (kind == TIMER_SPEED) g.speedActive = on;
+    else if (kind == TIMER_DOUBLE) g.doubleActive = on;
+    else if (kind == TIMER_SHIELD) g.shieldActive = on;
+    else if (kind == TIMER_MAGNET) g.magnetActive = on;
+    else if (kind == TIMER_FREEZE) g.freezeActive = on;
+    else if (kind == TIMER_ROUND && !on) g.remainingMs = 0;
+}
+
+// start an effect, or refresh / stack it if it is already running
+void startEffect(GameState& g, uint8_t kind) {
+    const TimedEffectDef& def = timedEffects[kind];
+    TimerId& id = g.effectTimers[kind];
+    uint32_t left = g.timers.remaining(id);
+    uint32_t ms = def.durationMs;
+    if (def.stacking == TIMER_STACK) ms = (std::min)(left + def.durationMs, def.capMs);
+    if (!g.timers.reschedule(id, ms)) id = g.timers.schedule(ms, kind, 0);
+    setEffectFlag(g, kind, true);
+}
+
+// run the wheel up to the sim clock; expiries switch their effect off and are reported as events
+void advanceTimers(GameState& g, float dt) {
+    Real carry = Real(g.timerCarryMs) + Real(dt) * Real(1000);
+    uint32_t ms = wholePart(carry);
+    g.timerCarryMs = toFloat(carry - Real((int)ms));
+    g.timers.advance(ms, [&g](uint8_t kind, uint32_t arg) {
+        setEffectFlag(g, kind, false);
+        g.bus.emit(EV_EXPIRE, kind, arg, g.playerPos);
+    });
+    g.remainingMs = (int)g.timers.remaining(g.effectTimers[TIMER_ROUND]);
+}
+
+// -------------------------------
+// Minimap: per-cell entity counts over a coarse grid of the world, kept
+// current from placements and pickup events instead of being rebuilt, and
+// turned into RGBA texels for the radar in the top panel (sim thread only)
+// -------------------------------
+const int MINIMAP_W = 128, MINIMAP_H = 64, MINIMAP_N = MINIMAP_W * MINIMAP_H;
+enum { MINI_OBSTACLE, MINI_COLLECT, MINI_POWER, MINI_KINDS };
+
+struct Minimap {
+    float cellW = 1.0f, cellH = 1.0f;
+    float expected = 1.0f;  // entities per cell that light it up fully
+    uint32_t round = 0;     // round the taken counts belong to
+    uint32_t version = 0;   // bumped whenever a texel changes
+    uint32_t count[MINI_KINDS][MINIMAP_N];
+    uint32_t taken[MINI_KINDS][MINIMAP_N]; // pickups gone this round
+    uint8_t texels[MINIMAP_N * 4];
+};
+
+Minimap minimap;
+
+static inline int minimapCell(const Minimap& m, const Vec2& p) {
+    int cx = (std::max)(0, (std::min)(MINIMAP_W - 1, (int)(p.x / m.cellW)));
+    int cy = (std::max)(0, (std::min)(MINIMAP_H - 1, (int)((p.y - GAME_Y0) / m.cellH)));
+    return cy * MINIMAP_W + cx;
+}
+
+void minimapPaint(Minimap& m, int c) {
+    float o = (std::min)(1.0f, m.count[MINI_OBSTACLE][c] / m.expected);
+    float k = (std::min)(1.0f, (m.count[MINI_COLLECT][c] - m.taken[MINI_COLLECT][c]) / m.expected);
+    float pw = (std::min)(1.0f, (m.count[MINI_POWER][c] - m.taken[MINI_POWER][c]) * 3.0f / m.expected); // rarer
+    uint8_t* t = m.texels + c * 4;
+    t[0] = (uint8_t)(std::min)(255.0f, 12.0f + 150.0f * o + 200.0f * k + 40.0f * pw);
+    t[1] = (uint8_t)(std::min)(255.0f, 12.0f + 70.0f * o + 180.0f * k + 160.0f * pw);
+    t[2] = (uint8_t)(std::min)(255.0f, 24.0f + 40.0f * o + 40.0f * k + 220.0f * pw);
+    t[3] = 255;
+}
+
+// full rebuild, only when the level itself changes (load, generate, clear)
+void minimapBuild(Minimap& m, const GameState& g) {
+    m.cellW = g.worldW / MINIMAP_W;
+    m.cellH = g.worldH / MINIMAP_H;
+    m.expected = (std::max)(1.0f, m.cellW * m.cellH / 6000.0f);
+    memset(m.count, 0, sizeof(m.count));
+    memset(m.taken, 0, sizeof(m.taken));
+    for (auto& ob : g.obstacles) m.count[MINI_OBSTACLE][minimapCell(m, ob.p)]++;
+    for (auto& c : g.collectibles) {
+        int cell = minimapCell(m, c.p);
+        m.count[MINI_COLLECT][cell]++;
+        if (!isLive(g, c)) m.taken[MINI_COLLECT][cell]++;
+    }
+    for (auto& pu : g.powerups) {
+        int cell = minimapCell(m, pu.p);
+        m.count[MINI_POWER][cell]++;
+        if (!isLive(g, pu)) m.taken[MINI_POWER][cell]++;
+    }
+    m.round = g.round;
+    for (int c = 0; c < MINIMAP_N; c++) minimapPaint(m, c);
+    m.version++;
+}
+
+// kind: MINI_*
+void minimapAdd(Minimap& m, int kind, const Vec2& p) {
+    int c = minimapCell(m, p);
+    m.count[kind][c]++;
+    minimapPaint(m, c);
+    m.version++;
+}
+
+// an entity left the level (hot reload); `taken` if it was a pickup gone this round
+void minimapRemove(Minimap& m, int kind, const Vec2& p, bool taken) {
+    int c = minimapCell(m, p);
+    m.count[kind][c]--;
+    if (taken && m.taken[kind][c]) m.taken[kind][c]--;
+    minimapPaint(m, c);
+    m.version++;
+}
+
+// a pickup was taken or given back (events, rewind)
+void minimapRetake(Minimap& m, int kind, const Vec2& p, bool taken) {
+    int c = minimapCell(m, p);
+    if (taken) m.taken[kind][c]++; else m.taken[kind][c]--;
+    minimapPaint(m, c);
+    m.version++;
+}
+
+// a new round revives every pickup: only the taken counts reset
+void minimapSync(Minimap& m, const GameState& g) {
+    if (m.round == g.round) return;
+    memset(m.taken, 0, sizeof(m.taken));
+    m.round = g.round;
+    for (int c = 0; c < MINIMAP_N; c++) minimapPaint(m, c);
+    m.version++;
+}
+
+// -------------------------------
+// Event subscribers: each drains the tick's events in one call
+// -------------------------------
+// gameplay consequences of collisions (runs inside stepGame, headless too)
+void scoreSubscriber(GameState& g, const GameEvent* ev, int n) {
+    for (int i = 0; i < n; i++) {
+        switch (ev[i].type) {
+        case EV_HIT:
+            if (g.shieldActive) {
+                // the shield takes the hit instead of a life
+                g.timers.cancel(g.effectTimers[TIMER_SHIELD]);
+                setEffectFlag(g, TIMER_SHIELD, false);
+            }
+            else g.playerLives = (std::max)(0, g.playerLives - 1);
+            startEffect(g, TIMER_INVULN);
+            break;
+        case EV_COLLECT:
+            g.playerScore += collectScore * (g.doubleActive ? (int)powerUpDefs[PU_DOUBLE].strength : 1);
+            break;
+        case EV_POWERUP:
+            startEffect(g, powerUpDefs[ev[i].arg].timer);
+            break;
+        }
+    }
+}
+
+void audioSubscriber(GameState& g, const GameEvent* ev, int n) {
+    if (!g.audio) return;
+    // repeats within a sound's window (this tick's included) coalesce in playSound
+    for (int i = 0; i < n; i++) {
+        uint8_t t = ev[i].type;
+        if (t == EV_HIT) playSoundEffect(SND_HIT);
+        else if (t == EV_COLLECT) playSoundEffect(SND_COLLECT);
+        else if (t == EV_ROUND_END) {
+            stopBackgroundMusic();
+            playSoundEffect(ev[i].arg ? SND_WIN : SND_LOSE);
+        }
+    }
+}
+
+void effectsSubscriber(GameState& g, const GameEvent* ev, int n) {
+    if (!g.effects) return;
+    for (int i = 0; i < n; i++) {
+        const GameEvent& e = ev[i];
+        if (e.type == EV_HIT) {
+            simFx.push({ e.at, BLEND_ALPHA, 40, 220.0f, 0.7f, 0xFF5A3Cu });
+            simFx.push({ e.at, BLEND_ADD, 20, 320.0f, 0.3f, 0xFFE0A0u });
+        }
+        // small pop visual
+        else if (e.type == EV_COLLECT) simFx.push({ e.at, BLEND_ADD, 28, 180.0f, 0.5f, 0xFFD24Au });
+        else if (e.type == EV_POWERUP) simFx.push({ e.at, BLEND_ADD, 48, 240.0f, 0.8f, powerUpDefs[e.arg].burst });
+    }
+}
+
+// per-round counts, printed when the round ends
+unsigned roundEventCounts[EV_TYPE_COUNT];
+
+void telemetrySubscriber(GameState& g, const GameEvent* ev, int n) {
+    for (int i = 0; i < n; i++) {
+        roundEventCounts[ev[i].type]++;
+        if (ev[i].type != EV_ROUND_END) continue;
+        printf("Round %s after %u ticks: score %d, %u hits, %u collected, %u power-ups\n",
+            ev[i].arg ? "won" : "lost", g.tick, g.playerScore,
+            roundEventCounts[EV_HIT], roundEventCounts[EV_COLLECT], roundEventCounts[EV_POWERUP]);
+        memset(roundEventCounts, 0, sizeof(roundEventCounts));
+    }
+}
+
+// rolling log of the most recent events, stamped with their tick
+struct ReplayEntry { uint32_t round, tick; GameEvent ev; };
+const int REPLAY_LOG_CAP = 4096;
+ReplayEntry replayLog[REPLAY_LOG_CAP];
+unsigned long long replayLogged = 0;
+
+void replaySubscriber(GameState& g, const GameEvent* ev, int n) {
+    for (int i = 0; i < n; i++) replayLog[replayLogged++ % REPLAY_LOG_CAP] = { g.round, g.tick, ev[i] };
+}
+
+// pickups dim their minimap cell
+void minimapSubscriber(GameState& g, const GameEvent* ev, int n) {
+    // a round reset this tick revived everything these events took
+    if (minimap.round != g.round) { minimapSync(minimap, g); return; }
+    for (int i = 0; i < n; i++) {
+        int kind = ev[i].type == EV_COLLECT ? MINI_COLLECT : ev[i].type == EV_POWERUP ? MINI_POWER : -1;
+        if (kind >= 0) minimapRetake(minimap, kind, ev[i].at, true);
+    }
+}
+
+struct EventSubscriber {
+    const char* name;
+    void (*drain)(GameState& g, const GameEvent* ev, int n);
+};
+
+const EventSubscriber eventSubscribers[SUB_COUNT] = {
+    { "score", scoreSubscriber },
+    { "audio", audioSubscriber },
+    { "effects", effectsSubscriber },
+    { "telemetry", telemetrySubscriber },
+    { "replay", replaySubscriber },
+    { "minimap", minimapSubscriber },
+};
+
+// hand the tick's events to subscribers [first, last), timing each
+void drainEvents(GameState& g, int first, int last) {
+    EventBus& bus = g.bus;
+    if (!bus.count) return;
+    for (int s = first; s < last; s++) {
+        auto t0 = std::chrono::steady_clock::now();
+        eventSubscribers[s].drain(g, bus.events, bus.count);
+        bus.subMs[s] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        bus.subEvents[s] += bus.count;
+        bus.subBatches[s]++;
+    }
+}
+
+// -------------------------------
+// Game logic: collisions, timers
+// -------------------------------
+
+    // -----------------------------------------------
+    // Bezier vertical motion: loops endlessly and speeds up with time
+    // -----------------------------------------------
+    // R: Real in the simulation, float where the pilot predicts the target
+    template <class R>
+    void bezierAdvance(R& t, bool& reverse, R remaining, R dt) {
+        // make target speed up as time decreases (min 0.08f, max 0.35f)
+        R timeRatio = remaining / R(totalTime);  // 1.0 → 0.0
+        R dynamicSpeed = R(0.12f) + (R(1) - timeRatio) * R(0.33f); // faster as time runs out
+
+        // ping-pong movement
+        if (!reverse) t += dynamicSpeed * dt;
+        else t -= dynamicSpeed * dt;
+
+        // reverse direction at ends
+        if (t >= R(1)) { t = R(1); reverse = true; }
+        if (t <= R(0)) { t = R(0); reverse = false; }
+    }
+
+    void computeBezierTarget(GameState& g, float dt) {
+        Real t = Real(g.bezT);
+        if (!g.freezeActive) bezierAdvance(t, g.bezReverse, Real(g.remainingMs) / Real(1000), Real(dt));
+        g.bezT = toFloat(t);
+
+        // compute point along Bezier curve
+        g.targetPos = toVec2(bezierPointReal(t, g.bz_p0, g.bz_p1, g.bz_p2, g.bz_p3));
+    }
+
+
+
+template <int T>
+void collidePowerUps(GameState& g) {
+    float px = g.playerPos.x, py = g.playerPos.y;
+    RVec pos = toReal(g.playerPos);
+    g.index.powerups[T].query(px - playerRadius, py - playerRadius, px + playerRadius, py + playerRadius, [&](uint32_t i) {
+        PowerUp& p = g.powerups[i];
+        if (!isLive(g, p)) return;
+        if (within(pos, toReal(p.p), Real(playerRadius) + Real(p.r))) {
+            g.bus.emit(EV_POWERUP, (uint8_t)T, i, p.p, p.takenRound);
+            p.takenRound = g.round;
+            g.index.pickups.taken(g, T, i);
+        }
+    });
+}
+
+void handleCollisions(GameState& g) {
+    // obstacles: if player collides and not invulnerable -> lose life and push back
+    // only the index buckets around the player are tested (pushback can move it 6 px per obstacle)
+    bool hit = false;
+    float px = g.playerPos.x, py = g.playerPos.y, m = playerRadius + 12.0f;
+    RVec pos = toReal(g.playerPos);
+    g.index.obstacles.query(px - m, py - m, px + m, py + m, [&](uint32_t i) {
+        const Obstacle& ob = g.obstacles[i];
+        RVec o = toReal(ob.p);
+        if (within(pos, o, Real(playerRadius) + Real(ob.r))) {
+            if (!g.invulnerable && !hit) {
+                g.bus.emit(EV_HIT, 0, i, toVec2(pos));
+                hit = true; // one hit per tick; scoring starts the invulnerability
+            }
+            // push back
+            RVec push = { pos.x - o.x, pos.y - o.y };
+            Real mag = realSqrt(push.x * push.x + push.y * push.y);
+            if (mag > Real(0.001f)) {
+                pos.x += push.x / mag * Real(6);
+                pos.y += push.y / mag * Real(6);
+                pos = clampToWorld(g, pos, Real(playerRadius + 2.0f));
+            }
+        }
+    });
+    g.playerPos = toVec2(pos);
+
+    // collectibles (a magnet widens the reach)
+    float reach = playerRadius + (g.magnetActive ? powerUpDefs[PU_MAGNET].strength : 0.0f);
+    px = g.playerPos.x; py = g.playerPos.y;
+    Real reachReal = Real(playerRadius) + (g.magnetActive ? Real(powerUpDefs[PU_MAGNET].strength) : Real(0));
+    g.index.collectibles.query(px - reach, py - reach, px + reach, py + reach, [&](uint32_t i) {
+        Collectible& c = g.collectibles[i];
+        if (!isLive(g, c)) return;
+        if (within(pos, toReal(c.p), reachReal + Real(c.r))) {
+            g.bus.emit(EV_COLLECT, 0, i, c.p, c.takenRound);
+            c.takenRound = g.round;
+            g.index.pickups.taken(g, 0, i);
+        }
+    });
+
+    // powerups, one type run at a time
+    forEachPowerUpType([&](auto t) { collidePowerUps<decltype(t)::value>(g); });
+}
+
+// -------------------------------
+// Movement & update loop
+// -------------------------------
+void updateMovement(GameState& g, float dt) {
+    Real spd = Real(baseSpeed);
+    if (g.speedActive) spd = spd * Real(powerUpDefs[PU_SPEED].strength);
+    RVec pos = toReal(g.playerPos);
+    if (g.sampledInput) {
+        // presses shorter than a tick still move the ship for exactly as long as they lasted
+        RVec in = toReal(g.inputMove);
+        Real held = realSqrt(in.x * in.x + in.y * in.y);
+        if (held > Real(0)) {
+            g.playerDir = toVec2({ in.x / held, in.y / held });
+            pos.x += in.x * spd;
+            pos.y += in.y * spd;
+            g.playerPos = toVec2(clampToWorld(g, pos, Real(playerRadius + 2.0f)));
+        }
+        return;
+    }
+    RVec mv = { Real(0), Real(0) };
+    if (g.keyLeft) mv.x -= Real(1);
+    if (g.keyRight) mv.x += Real(1);
+    if (g.keyUp) mv.y += Real(1);
+    if (g.keyDown) mv.y -= Real(1);
+
+    Real mag = realSqrt(mv.x * mv.x + mv.y * mv.y);
+    if (mag > Real(0)) {
+        mv.x = mv.x / mag; mv.y = mv.y / mag;
+        g.playerDir = toVec2(mv);
+        // if currently colliding with obstacle and invuln active, we still allow movement but pushback handled in collision
+        pos.x += mv.x * spd * Real(dt);
+        pos.y += mv.y * spd * Real(dt);
+        g.playerPos = toVec2(clampToWorld(g, pos, Real(playerRadius + 2.0f)));
+    }
+}
+
+bool checkEndCondition(GameState& g) {
+    if (g.playerLives <= 0) { g.playerWon = false; return true; }
+    if (g.remainingMs <= 0) { g.playerWon = false; return true; }
+    if (within(toReal(g.playerPos), toReal(g.targetPos), Real(playerRadius + 14.0f))) { g.playerWon = true; return true; }
+    return false;
+}
+
+// start/reset a round: player at left, target on the right-side Bezier path
+void resetRound(GameState& g) {
+    g.running = true;
+    g.showEnd = false;
+    g.playerScore = 0;
+    g.playerLives = 5;
+    g.speedActive = g.doubleActive = g.shieldActive = g.magnetActive = g.freezeActive = g.invulnerable = false;
+    g.timers.clear();
+    g.timerCarryMs = 0.0f;
+    startEffect(g, TIMER_ROUND);
+    g.remainingMs = totalTime * 1000;
+    g.tick = 0;
+    g.bus.count = 0;
+    g.round++; // pickups taken last round become live again; the pickup tree recounts lazily
+    // place player at the world's left edge and target at its right, both mid-height
+    int right = (int)g.worldW, mid = GAME_Y0 + (int)(g.worldH * 0.5f);
+    g.playerPos.x = 80.0f; g.playerPos.y = (float)mid;
+    g.targetPos.x = right - 80.0f; g.targetPos.y = (float)mid;
+    // right-side vertical Bezier curve (slight horizontal curve for visibility)
+    g.bz_p0[0] = right - 120;  g.bz_p0[1] = mid - 170;  // bottom
+    g.bz_p1[0] = right - 180;  g.bz_p1[1] = mid;        // curve left
+    g.bz_p2[0] = right - 60;   g.bz_p2[1] = mid;        // curve right
+    g.bz_p3[0] = right - 120;  g.bz_p3[1] = mid + 170;  // top
+
+    g.bezT = 0.0f;
+    g.bezReverse = false;
+}
+
+// one simulation step; returns true on the tick the round ends
+bool stepGame(GameState& g, float dt) {
+    if (!g.running) return false;
+    g.bus.count = 0; // last tick's events have been drained
+    g.tick++;
+    // movement
+    updateMovement(g, dt);
+    // bezier target
+    computeBezierTarget(g, dt);
+    // collisions
+    handleCollisions(g);
+    drainEvents(g, SUB_SCORE, SUB_SCORE + 1);
+    // countdown and effect timers
+    advanceTimers(g, dt);
+    // check end
+    if (checkEndCondition(g)) {
+        g.running = false;
+        g.showEnd = true;
+        g.bus.emit(EV_ROUND_END, g.playerWon ? 1 : 0, 0, g.playerPos);
+        return true;
+    }
+    return false;
+}
+
+// FNV-1a over everything a tick can change: equal hashes mean equal runs
+uint64_t stateHash(const GameState& g) {
+    uint64_t h = 1469598103934665603ull;
+    auto mix = [&h](const void* p, size_t n) {
+        for (size_t i = 0; i < n; i++) { h ^= ((const uint8_t*)p)[i]; h *= 1099511628211ull; }
+    };
+    uint32_t ints[] = { g.round, g.tick, g.running, g.showEnd, g.playerWon, g.speedActive, g.doubleActive,
+        g.shieldActive, g.magnetActive, g.freezeActive, g.invulnerable, g.bezReverse,
+        (uint32_t)g.remainingMs, (uint32_t)g.playerScore, (uint32_t)g.playerLives };
+    float floats[] = { g.playerPos.x, g.playerPos.y, g.playerDir.x, g.playerDir.y, g.targetPos.x, g.targetPos.y,
+        g.bezT, g.timerCarryMs };
+    mix(ints, sizeof(ints));
+    mix(floats, sizeof(floats));
+    for (int k = 0; k < TIMER_KIND_COUNT; k++) {
+        uint32_t left = g.timers.remaining(g.effectTimers[k]);
+        mix(&left, sizeof(left));
+    }
+    for (auto& c : g.collectibles) mix(&c.takenRound, sizeof(c.takenRound));
+    for (auto& pu : g.powerups) mix(&pu.takenRound, sizeof(pu.takenRound));
+    return h;
+}
+
+// -------------------------------
+// Headless bot (drives the key flags instead of GLUT)
+// -------------------------------
+struct BotPolicy {
+    float aimNoise = 0.35f;     // random heading jitter (radians)
+    float greed = 150.0f;       // detour to pickups closer than this (px)
+    float avoidRadius = 60.0f;  // extra clearance kept from obstacles (px)
+    float reactionSec = 0.12f;  // time between decisions
+};
+
+struct BotState {
+    uint32_t rng = 1;
+    float decideTimer = 0.0f;
+};
+
+void botDecide(GameState& g, const BotPolicy& pol, BotState& bot, float dt) {
+    bot.decideTimer -= dt;
+    if (bot.decideTimer > 0.0f) return;
+    bot.decideTimer = pol.reactionSec * (0.5f + rand01(bot.rng));
+
+    // goal: nearest pickup within greed range, otherwise the target
+    Vec2 goal = g.targetPos;
+    PickupHit near;
+    if (g.index.pickups.nearest(g, g.playerPos, 1, &near, pol.greed)) goal = near.p;
+
+    Vec2 want = { goal.x - g.playerPos.x, goal.y - g.playerPos.y };
+    float len = sqrtf(want.x * want.x + want.y * want.y);
+    if (len > 0.001f) { want.x /= len; want.y /= len; }
+
+    // steer around nearby obstacles that lie ahead (push away plus a sidestep),
+    // unless the way to the goal is clear for the next stretch
+    Vec2 ahead = want;
+    float look = (std::min)(len, playerRadius + 2.0f * pol.avoidRadius);
+    Vec2 probe = { g.playerPos.x + ahead.x * look, g.playerPos.y + ahead.y * look };
+    if (!g.index.solid().lineOfSight(g.playerPos, probe, playerRadius + 0.5f * pol.avoidRadius)) {
+        float m = playerRadius + pol.avoidRadius;
+        g.index.obstacles.query(g.playerPos.x - m, g.playerPos.y - m, g.playerPos.x + m, g.playerPos.y + m, [&](uint32_t i) {
+            const Obstacle& ob = g.obstacles[i];
+            float d = dist(g.playerPos, ob.p);
+            float reach = playerRadius + ob.r + pol.avoidRadius;
+            if (d >= reach || d <= 0.001f) return;
+            Vec2 away = { (g.playerPos.x - ob.p.x) / d, (g.playerPos.y - ob.p.y) / d };
+            if (away.x * ahead.x + away.y * ahead.y > 0.3f) return; // already moving clear
+            float w = (reach - d) / pol.avoidRadius;
+            float side = (away.x * ahead.y - away.y * ahead.x) >= 0.0f ? 1.0f : -1.0f;
+            want.x += (away.x - side * away.y) * w;
+            want.y += (away.y + side * away.x) * w;
+        });
+    }
+
+    float a = atan2f(want.y, want.x) + (rand01(bot.rng) * 2.0f - 1.0f) * pol.aimNoise;
+    float cx = cosf(a), cy = sinf(a);
+    g.keyLeft = cx < -0.38f; g.keyRight = cx > 0.38f;
+    g.keyDown = cy < -0.38f; g.keyUp = cy > 0.38f;
+}
+
+// -------------------------------
+// Flow-field pilot: Dijkstra distance fields over a grid of the world,
+// one per sample point of the target's Bezier path. Placing or picking up
+// an object repairs only the affected part of each field. Worlds with more
+// than NAV_MAX_N cells get no fields; the pilot then heads straight for
+// the target.
+// -------------------------------
+const int NAV_CELL = 10; // px
+const int NAV_MAX_N = 1 << 19; // ~100 screens
+const int NAV_SAMPLES = 12;
+const float NAV_INF = 1e30f;
+const float NAV_PICKUP_COST = 0.4f; // cells with an active pickup are cheaper, so routes pass through them
+
+struct NavField {
+    float t;    // Bezier parameter of the goal sample
+    int goal;   // goal cell
+    std::vector<float> d;
+    std::vector<int> parent; // next cell toward the goal, -1 if none
+};
+
+struct FlowPilot {
+    bool built = false;
+    bool usable = false; // fields exist (the world is small enough)
+    int cols = 0, rows = 0;
+    std::vector<float> cost; // per cell, NAV_INF = blocked
+    NavField fields[NAV_SAMPLES];
+    // what the fields were last built/repaired against
+    size_t seenObstacles = 0;
+    std::vector<uint8_t> seenCollect, seenPower;
+    // scratch reused between repairs
+    std::vector<std::pair<float, int>> heap;
+    std::vector<int> dirty;
+    std::vector<uint8_t> mark;
+    std::vector<std::pair<int, float>> changed; // cell, old cost
+    // current plan
+    int goalField = -1;
+    float interceptSec = 0.0f;
+    // planning time per tick
+    float lastPlanMs = 0.0f, maxPlanMs = 0.0f;
+    double sumPlanMs = 0.0;
+    int planTicks = 0;
+};
+
+static inline int navCell(const FlowPilot& nav, const Vec2& p) {
+    int cx = (int)(p.x / NAV_CELL), cy = (int)((p.y - GAME_Y0) / NAV_CELL);
+    cx = (std::max)(0, (std::min)(nav.cols - 1, cx));
+    cy = (std::max)(0, (std::min)(nav.rows - 1, cy));
+    return cy * nav.cols + cx;
+}
+
+static inline Vec2 navCenter(const FlowPilot& nav, int i) {
+    return { (i % nav.cols + 0.5f) * NAV_CELL, GAME_Y0 + (i / nav.cols + 0.5f) * NAV_CELL };
+}
+
+// recompute cell costs in [cx0,cx1]x[cy0,cy1], remembering cells that changed
+void navStamp(FlowPilot& nav, const GameState& g, int cx0, int cy0, int cx1, int cy1) {
+    cx0 = (std::max)(0, cx0); cy0 = (std::max)(0, cy0);
+    cx1 = (std::min)(nav.cols - 1, cx1); cy1 = (std::min)(nav.rows - 1, cy1);
+    float pad = playerRadius + 2.0f, reach = playerRadius + 2.0f;
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            int i = cy * nav.cols + cx;
+            Vec2 c = navCenter(nav, i);
+            float cost = 1.0f;
+            // clampToArea keeps the player out of the border strip
+            if (c.x < pad || c.x > g.worldW - pad || c.y < GAME_Y0 + pad || c.y > GAME_Y0 + g.worldH - pad) cost = NAV_INF;
+            float x0 = c.x - reach, y0 = c.y - reach, x1 = c.x + reach, y1 = c.y + reach;
+            if (cost != NAV_INF)
+                g.index.obstacles.query(x0, y0, x1, y1, [&](uint32_t k) {
+                    if (dist(c, g.obstacles[k].p) < g.obstacles[k].r + playerRadius + 2.0f) cost = NAV_INF;
+                });
+            if (cost != NAV_INF) {
+                g.index.collectibles.query(x0, y0, x1, y1, [&](uint32_t k) {
+                    const Collectible& col = g.collectibles[k];
+                    if (isLive(g, col) && dist(c, col.p) < col.r + playerRadius) cost = NAV_PICKUP_COST;
+                });
+                for (int t = 1; t < PU_TYPE_END; t++)
+                    g.index.powerups[t].query(x0, y0, x1, y1, [&](uint32_t k) {
+                        const PowerUp& pu = g.powerups[k];
+                        if (isLive(g, pu) && dist(c, pu.p) < pu.r + playerRadius) cost = NAV_PICKUP_COST;
+                    });
+            }
+            if (cost != nav.cost[i]) {
+                nav.changed.push_back({ i, nav.cost[i] });
+                nav.cost[i] = cost;
+            }
+        }
+    }
+}
+
+void navStampAround(FlowPilot& nav, const GameState& g, const Vec2& p, float r) {
+    float reach = r + playerRadius + 2.0f;
+    navStamp(nav, g, (int)((p.x - reach) / NAV_CELL) - 1, (int)((p.y - reach - GAME_Y0) / NAV_CELL) - 1,
+        (int)((p.x + reach) / NAV_CELL) + 1, (int)((p.y + reach - GAME_Y0) / NAV_CELL) + 1);
+}
+
+static inline float navEdge(const FlowPilot& nav, int a, int b, bool diag) {
+    return (diag ? 1.41421356f : 1.0f) * 0.5f * (nav.cost[a] + nav.cost[b]);
+}
+
+// fn(neighbour, diagonal) for the 8-connected neighbours of cell i
+template <class Fn>
+static inline void navNeighbours(const FlowPilot& nav, int i, Fn fn) {
+    int cx = i % nav.cols, cy = i / nav.cols;
+    for (int dy = -1; dy <= 1; dy++)
+        for (int dx = -1; dx <= 1; dx++) {
+            if (!dx && !dy) continue;
+            int nx = cx + dx, ny = cy + dy;
+            if (nx < 0 || ny < 0 || nx >= nav.cols || ny >= nav.rows) continue;
+            fn(ny * nav.cols + nx, dx && dy);
+        }
+}
+
+typedef std::greater<std::pair<float, int>> NavHeapOrder;
+
+void navPush(FlowPilot& nav, float d, int i) {
+    nav.heap.push_back({ d, i });
+    std::push_heap(nav.heap.begin(), nav.heap.end(), NavHeapOrder());
+}
+
+// plain Dijkstra from whatever is queued; only improvements propagate
+void navPropagate(FlowPilot& nav, NavField& f) {
+    while (!nav.heap.empty()) {
+        std::pop_heap(nav.heap.begin(), nav.heap.end(), NavHeapOrder());
+        std::pair<float, int> top = nav.heap.back(); nav.heap.pop_back();
+        int v = top.second;
+        if (top.first > f.d[v]) continue; // stale entry
+        navNeighbours(nav, v, [&](int n, bool diag) {
+            if (nav.cost[n] == NAV_INF) return;
+            float nd = f.d[v] + navEdge(nav, v, n, diag);
+            if (nd < f.d[n]) { f.d[n] = nd; f.parent[n] = v; navPush(nav, nd, n); }
+        });
+    }
+}
+
+void navBuildField(FlowPilot& nav, NavField& f) {
+    f.d.assign((size_t)nav.cols * nav.rows, NAV_INF);
+    f.parent.assign((size_t)nav.cols * nav.rows, -1);
+    nav.heap.clear();
+    if (nav.cost[f.goal] == NAV_INF) return; // sample sits inside an obstacle
+    f.d[f.goal] = 0.0f;
+    navPush(nav, 0.0f, f.goal);
+    navPropagate(nav, f);
+}
+
+// dirty-region repair after the cells in nav.changed got new costs
+void navRepairField(FlowPilot& nav, NavField& f) {
+    nav.mark.assign((size_t)nav.cols * nav.rows, 0);
+    nav.dirty.clear();
+    // cells that got more expensive lose their value, and so does everything
+    // whose shortest path ran through them
+    for (auto& ch : nav.changed)
+        if (nav.cost[ch.first] > ch.second && !nav.mark[ch.first]) { nav.mark[ch.first] = 1; nav.dirty.push_back(ch.first); }
+    for (size_t k = 0; k < nav.dirty.size(); k++) {
+        int v = nav.dirty[k];
+        navNeighbours(nav, v, [&](int n, bool) {
+            if (!nav.mark[n] && f.parent[n] == v) { nav.mark[n] = 1; nav.dirty.push_back(n); }
+        });
+    }
+    for (int v : nav.dirty) { f.d[v] = NAV_INF; f.parent[v] = -1; }
+    // cheaper cells are re-queued as they are; invalidated ones are re-seeded from their valid neighbours
+    for (auto& ch : nav.changed)
+        if (nav.cost[ch.first] < ch.second && !nav.mark[ch.first]) nav.dirty.push_back(ch.first);
+
+    nav.heap.clear();
+    for (int v : nav.dirty) {
+        if (nav.cost[v] == NAV_INF) { f.d[v] = NAV_INF; f.parent[v] = -1; continue; }
+        if (v == f.goal) { f.d[v] = 0.0f; f.parent[v] = -1; }
+        navNeighbours(nav, v, [&](int n, bool diag) {
+            if (f.d[n] == NAV_INF) return;
+            float nd = f.d[n] + navEdge(nav, n, v, diag);
+            if (nd < f.d[v]) { f.d[v] = nd; f.parent[v] = n; }
+        });
+        if (f.d[v] < NAV_INF) navPush(nav, f.d[v], v);
+    }
+    navPropagate(nav, f);
+}
+
+void navFullBuild(FlowPilot& nav, const GameState& g) {
+    nav.cols = (int)ceilf(g.worldW / NAV_CELL);
+    nav.rows = (int)ceilf(g.worldH / NAV_CELL);
+    size_t n = (size_t)nav.cols * nav.rows;
+    nav.usable = n <= (size_t)NAV_MAX_N;
+    if (nav.usable) {
+        nav.cost.assign(n, 0.0f);
+        // size the repair scratch for the worst case up front so ticks never grow it
+        nav.heap.reserve(n * 8);
+        nav.dirty.reserve(n * 2);
+        nav.mark.reserve(n);
+        nav.changed.reserve(n);
+        nav.changed.clear();
+        navStamp(nav, g, 0, 0, nav.cols - 1, nav.rows - 1);
+        nav.changed.clear();
+        for (int i = 0; i < NAV_SAMPLES; i++) {
+            NavField& f = nav.fields[i];
+            f.t = (float)i / (NAV_SAMPLES - 1);
+            float out[2];
+            bezier_point_float(f.t, g.bz_p0, g.bz_p1, g.bz_p2, g.bz_p3, out);
+            f.goal = navCell(nav, { out[0], out[1] });
+            navBuildField(nav, f);
+        }
+    }
+    nav.seenObstacles = g.obstacles.size();
+    nav.seenCollect.resize(g.collectibles.size());
+    for (size_t i = 0; i < g.collectibles.size(); i++) nav.seenCollect[i] = isLive(g, g.collectibles[i]);
+    nav.seenPower.resize(g.powerups.size());
+    for (size_t i = 0; i < g.powerups.size(); i++) nav.seenPower[i] = isLive(g, g.powerups[i]);
+    nav.built = true;
+}
+
+// bring the fields up to date with the level: new placements and consumed pickups are repaired in place
+void navSync(FlowPilot& nav, const GameState& g) {
+    // power-ups are inserted inside their type's run, which shifts indices: any change in count rebuilds
+    if (!nav.built || g.obstacles.size() < nav.seenObstacles ||
+        g.collectibles.size() < nav.seenCollect.size() || g.powerups.size() != nav.seenPower.size()) {
+        navFullBuild(nav, g);
+        return;
+    }
+    if (!nav.usable) return;
+    nav.changed.clear();
+    for (size_t i = nav.seenObstacles; i < g.obstacles.size(); i++) navStampAround(nav, g, g.obstacles[i].p, g.obstacles[i].r);
+    nav.seenObstacles = g.obstacles.size();
+    for (size_t i = 0; i < g.collectibles.size(); i++) {
+        uint8_t a = isLive(g, g.collectibles[i]);
+        if (i < nav.seenCollect.size() && nav.seenCollect[i] == a) continue;
+        navStampAround(nav, g, g.collectibles[i].p, g.collectibles[i].r);
+        if (i < nav.seenCollect.size()) nav.seenCollect[i] = a; else nav.seenCollect.push_back(a);
+    }
+    for (size_t i = 0; i < g.powerups.size(); i++) {
+        uint8_t a = isLive(g, g.powerups[i]);
+        if (i < nav.seenPower.size() && nav.seenPower[i] == a) continue;
+        navStampAround(nav, g, g.powerups[i].p, g.powerups[i].r);
+        if (i < nav.seenPower.size()) nav.seenPower[i] = a; else nav.seenPower.push_back(a);
+    }
+    if (nav.changed.empty()) return;
+    for (int i = 0; i < NAV_SAMPLES; i++) navRepairField(nav, nav.fields[i]);
+    nav.changed.clear();
+}
+
+// nearest cell around the player that still has a route (pushback can leave the player inside an inflated obstacle)
+int navStartCell(const FlowPilot& nav, const NavField& f, const Vec2& p) {
+    int c = navCell(nav, p);
+    if (f.d[c] < NAV_INF) return c;
+    int best = -1; float bd = NAV_INF;
+    int cx = c % nav.cols, cy = c / nav.cols;
+    for (int dy = -2; dy <= 2; dy++)
+        for (int dx = -2; dx <= 2; dx++) {
+            int nx = cx + dx, ny = cy + dy;
+            if (nx < 0 || ny < 0 || nx >= nav.cols || ny >= nav.rows) continue;
+            int n = ny * nav.cols + nx;
+            if (f.d[n] < bd) { bd = f.d[n]; best = n; }
+        }
+    return best;
+}
+
+// pick the path sample where we can meet the target soonest and return the heading toward it
+Vec2 navPlan(FlowPilot& nav, const GameState& g) {
+    auto t0 = std::chrono::steady_clock::now();
+    navSync(nav, g);
+    if (!nav.usable) {
+        nav.goalField = -1;
+        nav.lastPlanMs = 0.0f;
+        return { g.targetPos.x - g.playerPos.x, g.targetPos.y - g.playerPos.y };
+    }
+
+    // travel time to every sample
+    float cellsPerSec = baseSpeed * speedFactor(g) / NAV_CELL;
+    float travel[NAV_SAMPLES], arrive[NAV_SAMPLES];
+    int pending = 0;
+    for (int i = 0; i < NAV_SAMPLES; i++) {
+        int s = navStartCell(nav, nav.fields[i], g.playerPos);
+        travel[i] = s >= 0 ? nav.fields[i].d[s] / cellsPerSec : NAV_INF;
+        arrive[i] = NAV_INF;
+        if (travel[i] < NAV_INF) pending++;
+    }
+    // run the target forward along its curve and note when it passes each sample after we could be there
+    float bt = g.bezT; bool rev = g.bezReverse;
+    float rem = g.remainingMs * 0.001f;
+    float frozen = g.timers.remaining(g.effectTimers[TIMER_FREEZE]) * 0.001f;
+    const float h = 1.0f / 30.0f;
+    for (float tau = h; tau < 20.0f && pending > 0; tau += h) {
+        float prev = bt;
+        if (tau > frozen) bezierAdvance(bt, rev, rem, h);
+        rem = (std::max)(0.0f, rem - h);
+        float lo = (std::min)(prev, bt), hi = (std::max)(prev, bt);
+        for (int i = 0; i < NAV_SAMPLES; i++) {
+            float ts = nav.fields[i].t;
+            if (arrive[i] == NAV_INF && travel[i] <= tau && ts >= lo && ts <= hi) { arrive[i] = tau; pending--; }
+        }
+    }
+    nav.goalField = -1;
+    for (int i = 0; i < NAV_SAMPLES; i++)
+        if (arrive[i] < NAV_INF && (nav.goalField < 0 || arrive[i] < arrive[nav.goalField])) nav.goalField = i;
+    nav.interceptSec = nav.goalField >= 0 ? arrive[nav.goalField] : 0.0f;
+
+    // close in directly once the target is near, otherwise follow the field a few cells ahead
+    Vec2 aim = g.targetPos;
+    if (nav.goalField >= 0 && dist(g.playerPos, g.targetPos) > playerRadius + 60.0f) {
+        const NavField& f = nav.fields[nav.goalField];
+        int c = navStartCell(nav, f, g.playerPos);
+        for (int k = 0; k < 4 && c >= 0 && f.parent[c] >= 0; k++) c = f.parent[c];
+        if (c >= 0) aim = navCenter(nav, c);
+    }
+    Vec2 dir = { aim.x - g.playerPos.x, aim.y - g.playerPos.y };
+
+    nav.lastPlanMs = (float)std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    nav.maxPlanMs = (std::max)(nav.maxPlanMs, nav.lastPlanMs);
+    nav.sumPlanMs += nav.lastPlanMs;
+    nav.planTicks++;
+    return dir;
+}
+
+void flowPilotDrive(FlowPilot& nav, GameState& g, const BotPolicy& pol, BotState& bot, float dt) {
+    Vec2 dir = navPlan(nav, g);
+    bot.decideTimer -= dt;
+    if (bot.decideTimer > 0.0f) return;
+    bot.decideTimer = pol.reactionSec * (0.5f + rand01(bot.rng));
+    float a = atan2f(dir.y, dir.x) + (rand01(bot.rng) * 2.0f - 1.0f) * pol.aimNoise;
+    float cx = cosf(a), cy = sinf(a);
+    g.keyLeft = cx < -0.38f; g.keyRight = cx > 0.38f;
+    g.keyDown = cy < -0.38f; g.keyUp = cy > 0.38f;
+}
+
+// in-game pilot: 'A' lets it fly (attract mode), 'H' only shows its route
+FlowPilot pilot;
+BotPolicy pilotPolicy = { 0.0f, 0.0f, 0.0f, 0.0f };
+BotState pilotBot;
+bool autopilot = false;
+bool showHint = false;
+
+// -------------------------------
+// Work-stealing thread pool (batch evaluator, level generator)
+// -------------------------------
+// Work-stealing pool over a fixed batch of chunks: each worker drains the
+// front of its own deque, then steals from the back of the others.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threads) : queues(threads < 1 ? 1 : threads) {}
+
+    template <class Fn>
+    void run(int count, int chunk, Fn fn) {
+        int n = (int)queues.size();
+        int chunks = (count + chunk - 1) / chunk;
+        for (int c = 0; c < chunks; c++) {
+            // contiguous slabs keep each worker's games together until stealing starts
+            Queue& q = queues[(int)((long long)c * n / chunks)];
+            q.items.push_back({ c * chunk, (std::min)(count, (c + 1) * chunk) });
+        }
+        std::vector<std::thread> threads;
+        for (int w = 0; w < n; w++) {
+            threads.emplace_back([this, w, n, &fn]() {
+                Range r;
+                while (pop(w, r) || steal(w, n, r))
+                    for (int i = r.begin; i < r.end; i++) fn(i, w);
+            });
+        }
+        for (auto& t : threads) t.join();
+    }
+
+    std::atomic<int> steals{ 0 };
+
+private:
+    struct Range { int begin, end; };
+    struct Queue { std::mutex m; std::deque<Range> items; };
+    std::vector<Queue> queues;
+
+    bool pop(int w, Range& r) {
+        std::lock_guard<std::mutex> lock(queues[w].m);
+        if (queues[w].items.empty()) return false;
+        r = queues[w].items.front(); queues[w].items.pop_front();
+        return true;
+    }
+    bool steal(int w, int n, Range& r) {
+        for (int k = 1; k < n; k++) {
+            Queue& v = queues[(w + k) % n];
+            std::lock_guard<std::mutex> lock(v.m);
+            if (v.items.empty()) continue;
+            r = v.items.back(); v.items.pop_back();
+            steals++;
+            return true;
+        }
+        return false;
+    }
+};
+
+// -------------------------------
+// Procedural levels: Bridson Poisson-disk sampling with the same spacing
+// rule as overlapsExisting (r1 + r2 + 6), accelerated by a background grid
+// that holds at most one site per cell.
+// -------------------------------
+struct LevelGenParams {
+    uint32_t seed = 1;
+    float width = (float)WIN_W;                    // world spans x in [0,width],
+    float height = (float)(GAME_Y1 - GAME_Y0);     // y in [GAME_Y0, GAME_Y0+height]
+    float density = 1.0f;                          // fraction of Poisson-disk sites that get an object
+    float obstacleShare = 0.3f, collectShare = 0.55f; // the rest are power-ups
+    int maxEntities = 0;                           // 0 = fill the whole area
+    int attempts = 8;                              // candidates tried around each active site
+    int threads = 0;                               // 0 = all cores
+    bool index = true;                             // build the spatial indexes; off when the level is only written out
+};
+
+struct GenSite { float x, y, r; };
+struct GenOut { float x, y; uint8_t kind, type; };
+
+// The world is cut into tiles much wider than the spacing rule, filled in four
+// checkerboard phases: tiles of one colour never touch each other's cells, so
+// each phase runs its tiles in parallel. Every tile has its own RNG stream and
+// output list, which keeps the result identical for any thread count.
+int generateLevel(GameState& g, const LevelGenParams& prm) {
+    // same radii and gap as placement in mouseClick / overlapsExisting
+    const float R_OBSTACLE = obstacleRadius, R_COLLECT = collectibleRadius, R_POWER = powerUpRadius, GAP = 6.0f, PAD = 20.0f;
+    const float R_MAX = R_OBSTACLE, R_MIN = R_COLLECT;
+    const int TILE = 32; // cells per side of a fill tile
+
+    clearLevel(g);
+    g.worldW = (std::max)((float)WIN_W, prm.width);
+    g.worldH = (std::max)((float)(GAME_Y1 - GAME_Y0), prm.height);
+
+    // clearance around the round's spawn point and target path
+    GameState start;
+    start.worldW = g.worldW; start.worldH = g.worldH;
+    resetRound(start);
+    Vec2 curve[64];
+    float cx0 = 1e9f, cx1 = -1e9f, cy0 = 1e9f, cy1 = -1e9f;
+    for (int i = 0; i < 64; i++) {
+        float out[2];
+        bezier_point_float(i / 63.0f, start.bz_p0, start.bz_p1, start.bz_p2, start.bz_p3, out);
+        curve[i] = { out[0], out[1] };
+        cx0 = (std::min)(cx0, out[0]); cx1 = (std::max)(cx1, out[0]);
+        cy0 = (std::min)(cy0, out[1]); cy1 = (std::max)(cy1, out[1]);
+    }
+    auto clearOfRound = [&](float x, float y, float r) {
+        Vec2 p = { x, y };
+        if (dist(p, start.playerPos) < r + playerRadius + GAP) return false;
+        if (dist(p, start.targetPos) < r + 20.0f + GAP) return false;
+        float m = r + 20.0f + GAP;
+        if (x > cx0 - m && x < cx1 + m && y > cy0 - m && y < cy1 + m)
+            for (auto& c : curve) if (dist(p, c) < m) return false;
+        return true;
+    };
+
+    // two sites are at least 2*R_MIN+GAP apart, more than a cell diagonal,
+    // so each cell holds at most one site. A border of empty cells lets the
+    // neighbourhood scan skip bounds checks; empty cells hold a far-away dummy.
+    const float cell = (2.0f * R_MIN + GAP) / 1.41421356f;
+    const int BORDER = (int)ceilf((2.0f * R_MAX + GAP) / cell);
+    const int cols = (int)ceilf(prm.width / cell) + 2 * BORDER, rows = (int)ceilf(prm.height / cell) + 2 * BORDER;
+    std::vector<GenSite> grid((size_t)cols * rows, GenSite{ -1e6f, -1e6f, 0.0f });
+    const float x0 = PAD, x1 = prm.width - PAD, y0 = GAME_Y0 + PAD, y1 = GAME_Y0 + prm.height - PAD;
+    auto cellOf = [&](float x, float y) {
+        return (ptrdiff_t)((int)((y - GAME_Y0) / cell) + BORDER) * cols + (int)(x / cell) + BORDER;
+    };
+
+    const int attempts = (std::max)(1, prm.attempts);
+    std::vector<Vec2> ring(attempts);
+    for (int k = 0; k < attempts; k++) {
+        float a = (float)k / attempts * 2.0f * 3.14159265f;
+        ring[k] = { cosf(a), sinf(a) };
+    }
+
+    const float radius[3] = { R_OBSTACLE, R_COLLECT, R_POWER };
+    const float share[3] = { prm.obstacleShare, prm.collectShare, (std::max)(0.0f, 1.0f - prm.obstacleShare - prm.collectShare) };
+
+    // per kind: grid offsets of every cell that can hold a conflicting site,
+    // nearest first since that is where almost every rejection comes from
+    std::vector<ptrdiff_t> near[3];
+    for (int k = 0; k < 3; k++) {
+        float reach = radius[k] + R_MAX + GAP;
+        std::vector<std::pair<int, ptrdiff_t>> offs;
+        for (int dy = -BORDER; dy <= BORDER; dy++)
+            for (int dx = -BORDER; dx <= BORDER; dx++) {
+                // closest possible distance between points of the two cells
+                float gx = (std::max)(0, abs(dx) - 1) * cell, gy = (std::max)(0, abs(dy) - 1) * cell;
+                if (gx * gx + gy * gy < reach * reach) offs.push_back({ dx * dx + dy * dy, (ptrdiff_t)dy * cols + dx });
+            }
+        std::sort(offs.begin(), offs.end());
+        for (auto& o : offs) near[k].push_back(o.second);
+    }
+    auto fits = [&](float x, float y, int kind) {
+        if (x < x0 || x > x1 || y < y0 || y > y1) return false;
+        const GenSite* base = &grid[cellOf(x, y)];
+        float r = radius[kind];
+        for (ptrdiff_t off : near[kind]) {
+            const GenSite& s = base[off];
+            float dx = s.x - x, dy = s.y - y, m = s.r + r + GAP;
+            if (dx * dx + dy * dy < m * m) return false;
+        }
+        return clearOfRound(x, y, r);
+    };
+
+    const float tileW = TILE * cell;
+    const int tilesX = (int)ceilf(prm.width / tileW), tilesY = (int)ceilf(prm.height / tileW);
+    std::vector<std::vector<GenOut>> out((size_t)tilesX * tilesY);
+
+    auto fillTile = [&](int tx, int ty, std::vector<GenSite>& active) {
+        std::vector<GenOut>& emitted = out[(size_t)ty * tilesX + tx];
+        uint32_t rng = (prm.seed ? prm.seed : 1u) ^ ((uint32_t)(ty * tilesX + tx + 1) * 2654435761u);
+        if (!rng) rng = 1;
+        float tx0 = tx * tileW, tx1 = (std::min)(prm.width, tx0 + tileW);
+        float ty0 = GAME_Y0 + ty * tileW, ty1 = (std::min)(GAME_Y0 + prm.height, ty0 + tileW);
+
+        // big obstacles get rejected more often than small pickups, so weight each
+        // kind by its observed tries/accepts to keep the requested mix
+        float tried[3] = { 1, 1, 1 }, took[3] = { 1, 1, 1 };
+        float w[3] = { share[0], share[1], share[2] }, wsum = w[0] + w[1] + w[2];
+        int picks = 0;
+        auto pickKind = [&]() {
+            if ((++picks & 15) == 0) {
+                wsum = 0.0f;
+                for (int k = 0; k < 3; k++) { w[k] = share[k] * tried[k] / took[k]; wsum += w[k]; }
+            }
+            float u = rand01(rng) * wsum;
+            int kind = u < w[0] ? 0 : (u < w[0] + w[1] ? 1 : 2);
+            tried[kind] += 1.0f;
+            return kind;
+        };
+        auto accept = [&](float x, float y, int kind) {
+            GenSite s = { x, y, radius[kind] };
+            grid[cellOf(x, y)] = s;
+            active.push_back(s);
+            took[kind] += 1.0f;
+            if (rand01(rng) >= prm.density) return; // site stays reserved, spacing is unchanged
+            emitted.push_back({ x, y, (uint8_t)kind, (uint8_t)(1 + xorshift32(rng) % (PU_TYPE_END - 1)) });
+        };
+
+        // candidates sit just outside the exclusion ring of an active site; when
+        // the frontier runs dry, random darts reseed any gap growth could not reach
+        active.clear();
+        size_t head = 0;
+        int misses = 0;
+        while (misses < 24) {
+            if (head == active.size()) {
+                int kind = pickKind();
+                float x = tx0 + rand01(rng) * (tx1 - tx0), y = ty0 + rand01(rng) * (ty1 - ty0);
+                if (fits(x, y, kind)) { accept(x, y, kind); misses = 0; }
+                else misses++;
+                continue;
+            }
+            // one pass around the site, keeping every candidate that fits, then retire it
+            GenSite a = active[head++];
+            float ph = rand01(rng) * 2.0f * 3.14159265f, pc = cosf(ph), ps = sinf(ph);
+            for (int k = 0; k < attempts; k++) {
+                int kind = pickKind();
+                float d = (a.r + radius[kind] + GAP) * (1.0f + 0.2f * rand01(rng)) + 0.01f;
+                float ux = ring[k].x * pc - ring[k].y * ps, uy = ring[k].x * ps + ring[k].y * pc;
+                float x = a.x + ux * d, y = a.y + uy * d;
+                if (x >= tx0 && x < tx1 && y >= ty0 && y < ty1 && fits(x, y, kind)) accept(x, y, kind);
+            }
+        }
+    };
+
+    int threads = prm.threads > 0 ? prm.threads : (int)std::thread::hardware_concurrency();
+    threads = (std::max)(1, (std::min)(threads, (tilesX * tilesY + 3) / 4));
+    std::vector<std::vector<GenSite>> scratch(threads);
+    for (int phase = 0; phase < 4; phase++) {
+        int px = phase & 1, py = phase >> 1;
+        int nx = (tilesX - px + 1) / 2, ny = (tilesY - py + 1) / 2;
+        if (nx <= 0 || ny <= 0) continue;
+        WorkStealingPool pool(threads);
+        pool.run(nx * ny, 4, [&](int i, int worker) {
+            fillTile(px + 2 * (i % nx), py + 2 * (i / nx), scratch[worker]);
+        });
+    }
+
+    // gather in tile order so the level does not depend on scheduling. A
+    // --count cap keeps an even subsample: entry n stays when
+    // floor((n+1)*total/all) steps past floor(n*total/all), so the dropped
+    // sites are spread over the whole world instead of cutting off its end
+    uint64_t all = 0;
+    for (auto& t : out) all += t.size();
+    uint64_t total = all;
+    if (prm.maxEntities > 0) total = (std::min)(total, (uint64_t)prm.maxEntities);
+    auto keep = [&](uint64_t n) { return (n + 1) * total / all > n * total / all; };
+    size_t counts[3] = { 0, 0, 0 };
+    uint64_t n = 0;
+    for (auto& t : out) for (auto& e : t) if (keep(n++)) counts[e.kind]++;
+    g.obstacles.reserve(counts[0]); g.collectibles.reserve(counts[1]); g.powerups.reserve(counts[2]);
+    n = 0;
+    for (auto& t : out) {
+        for (auto& e : t) {
+            if (!keep(n++)) continue;
+            Vec2 p = { e.x, e.y };
+            if (e.kind == 0) g.obstacles.add({ p, radius[0] });
+            else if (e.kind == 1) g.collectibles.add({ p, radius[1], 0, 0.0f });
+            else g.powerups.add({ p, radius[2], e.type, 0, 0.0f });
+        }
+    }
+    groupPowerUps(g);
+    if (prm.index) indexLevel(g);
+    return (int)total;
+}
+
+// -------------------------------
+// Paint brush: dragging with a placement mode lays objects along the
+// path. Candidates sit on a hex lattice fixed to the world, with a pitch of
+// the mode's spacing rule (2r + 6) times `spacing`. Painting over the same
+// spot offers the same points again, and they are turned down. Each motion
+// event's candidates are checked as one batch. One index query per kind
+// for the segment's box fills a small hash grid, and accepted candidates
+// go into it too. Accepted objects wait in `pending` until paintFlush
+// adds them, once per sim tick. Painted objects are appended to their
+// grid; a power-up joins the end of its type's run, and the runs above it
+// (and the pickup tree's references to them) shift up. The obstacle and
+// pickup trees are rebuilt at the end of the stroke (paintFinish), so the
+// pilot's line of sight and pickup queries miss the new objects until then.
+// -------------------------------
+const float PAINT_SEGMENT_MAX = 512.0f; // longer drags are split, which bounds a batch's grid
+
+struct PaintBrush {
+    float radius = 36.0f;  // half the stroke width
+    float spacing = 1.0f;  // lattice pitch over the closest legal spacing
+    struct Pending { Vec2 p; int mode; };
+    std::vector<Pending> pending; // accepted, not yet in the level
+    // the batch's grid: a site is linked into every cell its keep-out box touches
+    struct Site { float x, y, r; int next; };
+    std::vector<int> head;
+    std::vector<Site> sites;
+    std::vector<Vec2> candidates;
+    float x0 = 0.0f, y0 = 0.0f, cell = 1.0f;
+    int cols = 0, rows = 0;
+    // this stroke
+    unsigned trees = 0; // LEVEL_* parts whose trees paintFinish rebuilds
+    unsigned batches = 0, offered = 0, placed = 0;
+    long long batchUs = 0, maxBatchUs = 0, flushUs = 0, finishUs = 0;
+};
+
+static inline float paintRadius(int mode) {
+    return mode == OBSTACLE_MODE ? obstacleRadius : mode == COLLECT_MODE ? collectibleRadius : powerUpRadius;
+}
+
+// lattice points of `mode` within the brush of segment a-z, inside the world
+void paintCandidates(const GameState& g, const PaintBrush& b, int mode, Vec2 a, Vec2 z, std::vector<Vec2>& out) {
+    out.clear();
+    float pitch = (2.0f * paintRadius(mode) + 6.0f) * (std::max)(1.0f, b.spacing), rowH = pitch * 0.8660254f;
+    float R = (std::max)(b.radius, pitch * 0.5f); // at least one row of points
+    float lx0 = (std::max)(20.0f, (std::min)(a.x, z.x) - R), lx1 = (std::min)(g.worldW - 20.0f, (std::max)(a.x, z.x) + R);
+    float ly0 = (std::max)(GAME_Y0 + 20.0f, (std::min)(a.y, z.y) - R), ly1 = (std::min)(GAME_Y0 + g.worldH - 20.0f, (std::max)(a.y, z.y) + R);
+    float dx = z.x - a.x, dy = z.y - a.y, len2 = dx * dx + dy * dy;
+    for (int j = (int)ceilf((ly0 - GAME_Y0) / rowH); GAME_Y0 + j * rowH <= ly1; j++) {
+        float y = GAME_Y0 + j * rowH, shift = (j & 1) ? pitch * 0.5f : 0.0f;
+        for (int i = (int)ceilf((lx0 - shift) / pitch); i * pitch + shift <= lx1; i++) {
+            Vec2 p = { i * pitch + shift, y };
+            float t = len2 > 0.0f ? (std::max)(0.0f, (std::min)(1.0f, ((p.x - a.x) * dx + (p.y - a.y) * dy) / len2)) : 0.0f;
+            float ex = a.x + dx * t - p.x, ey = a.y + dy * t - p.y;
+            if (ex * ex + ey * ey <= R * R) out.push_back(p);
+        }
+    }
+}
+
+// links a site of radius `r` into the cells where a candidate of radius cr could touch it
+static void paintSite(PaintBrush& b, float x, float y, float r, float cr) {
+    float m = r + cr + 6.0f;
+    int c0 = (std::max)(0, (int)((x - m - b.x0) / b.cell)), c1 = (std::min)(b.cols - 1, (int)((x + m - b.x0) / b.cell));
+    int r0 = (std::max)(0, (int)((y - m - b.y0) / b.cell)), r1 = (std::min)(b.rows - 1, (int)((y + m - b.y0) / b.cell));
+    for (int row = r0; row <= r1; row++)
+        for (int col = c0; col <= c1; col++) {
+            int c = row * b.cols + col;
+            b.sites.push_back({ x, y, r, b.head[c] });
+            b.head[c] = (int)b.sites.size() - 1;
+        }
+}
+
+// one motion event: returns how many of its candidates were accepted
+int paintSegment(const GameState& g, PaintBrush& b, int mode, Vec2 a, Vec2 z) {
+    float len = dist(a, z);
+    if (len > PAINT_SEGMENT_MAX) {
+        int n = (int)ceilf(len / PAINT_SEGMENT_MAX), placed = 0;
+        for (int k = 0; k < n; k++) {
+            float t0 = (float)k / n, t1 = (float)(k + 1) / n;
+            placed += paintSegment(g, b, mode, { a.x + (z.x - a.x) * t0, a.y + (z.y - a.y) * t0 }, { a.x + (z.x - a.x) * t1, a.y + (z.y - a.y) * t1 });
+        }
+        return placed;
+    }
+    long long t0 = nowUs();
+    paintCandidates(g, b, mode, a, z, b.candidates);
+    b.batches++;
+    b.offered += (unsigned)b.candidates.size();
+    if (b.candidates.empty()) return 0;
+
+    float r = paintRadius(mode);
+    float bx0 = FLT_MAX, by0 = FLT_MAX, bx1 = -FLT_MAX, by1 = -FLT_MAX;
+    for (const Vec2& p : b.candidates) {
+        bx0 = (std::min)(bx0, p.x); bx1 = (std::max)(bx1, p.x);
+        by0 = (std::min)(by0, p.y); by1 = (std::max)(by1, p.y);
+    }
+    b.cell = 2.0f * (r + obstacleRadius + 6.0f);
+    b.x0 = bx0; b.y0 = by0;
+    b.cols = (int)((bx1 - bx0) / b.cell) + 1; b.rows = (int)((by1 - by0) / b.cell) + 1;
+    b.head.assign((size_t)b.cols * b.rows, -1);
+    b.sites.clear();
+
+    // everything that could touch a candidate: from the index, then still pending
+    float qx0 = bx0 - r - 6.0f, qy0 = by0 - r - 6.0f, qx1 = bx1 + r + 6.0f, qy1 = by1 + r + 6.0f;
+    g.index.obstacles.query(qx0, qy0, qx1, qy1, [&](uint32_t i) { paintSite(b, g.obstacles[i].p.x, g.obstacles[i].p.y, g.obstacles[i].r, r); });
+    g.index.collectibles.query(qx0, qy0, qx1, qy1, [&](uint32_t i) { paintSite(b, g.collectibles[i].p.x, g.collectibles[i].p.y, g.collectibles[i].r, r); });
+    for (int t = 1; t < PU_TYPE_END; t++)
+        g.index.powerups[t].query(qx0, qy0, qx1, qy1, [&](uint32_t i) { paintSite(b, g.powerups[i].p.x, g.powerups[i].p.y, g.powerups[i].r, r); });
+    for (const auto& q : b.pending) {
+        float pr = paintRadius(q.mode);
+        if (q.p.x + pr >= qx0 && q.p.x - pr <= qx1 && q.p.y + pr >= qy0 && q.p.y - pr <= qy1) paintSite(b, q.p.x, q.p.y, pr, r);
+    }
+
+    // each candidate checks its own cell, against the level and the ones accepted before it
+    int placed = 0;
+    for (const Vec2& p : b.candidates) {
+        int c = (int)((p.y - b.y0) / b.cell) * b.cols + (int)((p.x - b.x0) / b.cell);
+        bool hit = nearActors(g, p, r);
+        for (int k = b.head[c]; k >= 0 && !hit; k = b.sites[k].next) {
+            const PaintBrush::Site& st = b.sites[k];
+            float ex = st.x - p.x, ey = st.y - p.y, m = st.r + r + 6.0f;
+            hit = ex * ex + ey * ey < m * m;
+        }
+        if (hit) continue;
+        paintSite(b, p.x, p.y, r, r);
+        b.pending.push_back({ p, mode });
+        placed++;
+    }
+    b.placed += placed;
+    long long us = nowUs() - t0;
+    b.batchUs += us;
+    b.maxBatchUs = (std::max)(b.maxBatchUs, us);
+    return placed;
+}
+
+// adds the pending objects to the level and its index; false if there were none
+bool paintFlush(GameState& g, PaintBrush& b, Minimap* m) {
+    if (b.pending.empty()) return false;
+    long long t0 = nowUs();
+    size_t obstacles = g.obstacles.size(), collectibles = g.collectibles.size();
+    PowerUp runs[PU_TYPE_END][64];
+    int counts[PU_TYPE_END] = {};
+    unsigned parts = 0;
+    // a type's run grows at its end; the runs above it move up
+    auto insertRun = [&](int t) {
+        uint32_t at = g.powerupRun[t + 1], n = (uint32_t)counts[t];
+        if (!n) return;
+        addPowerUps(g, t, runs[t], n);
+        g.index.powerups[t].append(g.powerups, g.powerupRun[t], at, at + n, g.worldW, g.worldH);
+        for (int u = t + 1; u < PU_TYPE_END; u++) g.index.powerups[u].shift(n);
+        g.index.pickups.inserted(at, n);
+        counts[t] = 0;
+    };
+    for (const auto& q : b.pending) {
+        parts |= q.mode == OBSTACLE_MODE ? LEVEL_OBSTACLES : q.mode == COLLECT_MODE ? LEVEL_COLLECTIBLES : LEVEL_POWERUPS;
+        if (q.mode == OBSTACLE_MODE) g.obstacles.add({ q.p, obstacleRadius });
+        else if (q.mode == COLLECT_MODE) g.collectibles.add({ q.p, collectibleRadius, 0, 0.0f });
+        else {
+            int t = q.mode - POWER_MODE + 1;
+            runs[t][counts[t]++] = { q.p, powerUpRadius, t, 0, 0.0f };
+            if (counts[t] == 64) insertRun(t);
+        }
+        if (m) minimapAdd(*m, q.mode == OBSTACLE_MODE ? MINI_OBSTACLE : q.mode == COLLECT_MODE ? MINI_COLLECT : MINI_POWER, q.p);
+    }
+    for (int t = 1; t < PU_TYPE_END; t++) insertRun(t);
+    b.pending.clear();
+    if (parts & LEVEL_OBSTACLES)
+        g.index.obstacles.append(g.obstacles, 0, obstacles, g.obstacles.size(), g.worldW, g.worldH);
+    if (parts & LEVEL_COLLECTIBLES)
+        g.index.collectibles.append(g.collectibles, 0, collectibles, g.collectibles.size(), g.worldW, g.worldH);
+    b.trees |= parts;
+    b.flushUs += nowUs() - t0;
+    return true;
+}
+
+// end of a stroke: the trees catch up with what it painted
+void paintFinish(GameState& g, PaintBrush& b) {
+    if (!b.trees) return;
+    long long t0 = nowUs();
+    indexTrees(g, b.trees);
+    b.trees = 0;
+    b.finishUs += nowUs() - t0;
+}
+
+// -------------------------------
+// Level diff for hot reload: each kind's entities are keyed by position,
+// radius and type, in the tenths of a px saved files use (levelTenths).
+// The file's keys go into an open-addressing hash table, and each loaded
+// entity takes a matching unclaimed one. What only one side has is a
+// removal or an insert. Applying a diff removes and inserts just those
+// entities. Kept pickups keep their taken state, and only the index parts
+// of the kinds that changed need rebuilding. Nothing else in the level is
+// touched.
+// -------------------------------
+// a bigger diff swaps in the whole file instead. Measured (--reload-bench):
+// the sim's side of an incremental reload costs as much as a full swap-in
+// at about 2% of the level changed for edits of any kind, 9% for obstacles
+const float RELOAD_FULL_SHARE = 0.05f;
+
+struct LevelDiff {
+    struct Key { int32_t x, y, r, type; uint32_t index; }; // index UINT32_MAX: empty slot
+    std::vector<Key> table;
+    std::vector<uint8_t> claimed; // per file entity (per power-up while applying)
+    std::vector<PowerUp> runScratch;
+    std::vector<uint32_t> removed[3], added[3]; // per MINI_* kind: indices into the level / the file
+
+    size_t changes() const {
+        size_t n = 0;
+        for (int k = 0; k < 3; k++) n += removed[k].size() + added[k].size();
+        return n;
+    }
+};
+
+template <class T, class TypeFn>
+void diffPools(LevelDiff& d, int kind, const EntityPool<T>& now, const EntityPool<T>& file, TypeFn typeOf) {
+    auto key = [&](const T& e, size_t i) -> LevelDiff::Key {
+        return { levelTenths(e.p.x), levelTenths(e.p.y), levelTenths(e.r), typeOf(e), (uint32_t)i };
+    };
+    auto slot = [](const LevelDiff::Key& k, size_t mask) {
+        uint64_t h = ((uint64_t)(uint32_t)k.x * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)(uint32_t)k.y * 0xC2B2AE3D27D4EB4Full) ^
+            ((uint64_t)(uint32_t)(k.r * 31 + k.type) * 0x165667B19E3779F9ull);
+        return (size_t)(h ^ (h >> 29)) & mask;
+    };
+    size_t cap = 16;
+    while (cap < file.size() * 2) cap *= 2;
+    d.table.assign(cap, LevelDiff::Key{ 0, 0, 0, 0, UINT32_MAX });
+    d.claimed.assign(file.size(), 0);
+    for (size_t j = 0; j < file.size(); j++) {
+        LevelDiff::Key k = key(file[j], j);
+        size_t s = slot(k, cap - 1);
+        while (d.table[s].index != UINT32_MAX) s = (s + 1) & (cap - 1);
+        d.table[s] = k;
+    }
+    d.removed[kind].clear(); d.added[kind].clear();
+    for (size_t i = 0; i < now.size(); i++) {
+        LevelDiff::Key k = key(now[i], i);
+        size_t s = slot(k, cap - 1);
+        bool kept = false;
+        for (; d.table[s].index != UINT32_MAX; s = (s + 1) & (cap - 1)) {
+            const LevelDiff::Key& e = d.table[s];
+            if (e.x != k.x || e.y != k.y || e.r != k.r || e.type != k.type || d.claimed[e.index]) continue;
+            d.claimed[e.index] = 1;
+            kept = true;
+            break;
+        }
+        if (!kept) d.removed[kind].push_back((uint32_t)i);
+    }
+    for (size_t j = 0; j < file.size(); j++)
+        if (!d.claimed[j]) d.added[kind].push_back((uint32_t)j);
+}
+
+void diffLevel(LevelDiff& d, const GameState& g, const GameState& file) {
+    diffPools(d, MINI_OBSTACLE, g.obstacles, file.obstacles, [](const Obstacle&) { return 0; });
+    diffPools(d, MINI_COLLECT, g.collectibles, file.collectibles, [](const Collectible&) { return 0; });
+    diffPools(d, MINI_POWER, g.powerups, file.powerups, [](const PowerUp& pu) { return pu.type; });
+}
+
+// the same entities in the same order, at file precision: g saved as-is
+bool sameLevel(const GameState& g, const GameState& file) {
+    if (g.obstacles.size() != file.obstacles.size() || g.collectibles.size() != file.collectibles.size() ||
+        g.powerups.size() != file.powerups.size() || g.worldW != file.worldW || g.worldH != file.worldH) return false;
+    auto same = [](const Vec2& p, float r, const Vec2& q, float s) {
+        return levelTenths(p.x) == levelTenths(q.x) && levelTenths(p.y) == levelTenths(q.y) && levelTenths(r) == levelTenths(s);
+    };
+    for (size_t i = 0; i < g.obstacles.size(); i++)
+        if (!same(g.obstacles[i].p, g.obstacles[i].r, file.obstacles[i].p, file.obstacles[i].r)) return false;
+    for (size_t i = 0; i < g.collectibles.size(); i++)
+        if (!same(g.collectibles[i].p, g.collectibles[i].r, file.collectibles[i].p, file.collectibles[i].r)) return false;
+    for (size_t i = 0; i < g.powerups.size(); i++)
+        if (g.powerups[i].type != file.powerups[i].type || !same(g.powerups[i].p, g.powerups[i].r, file.powerups[i].p, file.powerups[i].r)) return false;
+    return true;
+}
+
+// obstacle and collectible removals go highest index first, so the entity
+// a swap-remove moves down is never one still to go. Power-ups keep their
+// type runs: removals close up in one pass and inserts go in per type.
+// Returns the LEVEL_* parts that changed; their index is the caller's
+unsigned applyLevelDiff(GameState& g, const GameState& file, LevelDiff& d, Minimap* m) {
+    unsigned parts = 0;
+    for (int k = 0; k < 3; k++) {
+        if (!d.removed[k].empty() || !d.added[k].empty()) parts |= 1u << k; // MINI_* order is LEVEL_* order
+        std::sort(d.removed[k].begin(), d.removed[k].end(), std::greater<uint32_t>());
+    }
+    bool stale = m && m->round != g.round; // its taken counts are reset on the next sync anyway
+    for (uint32_t i : d.removed[MINI_OBSTACLE]) {
+        if (m) minimapRemove(*m, MINI_OBSTACLE, g.obstacles[i].p, false);
+        g.obstacles.swapRemove(i);
+    }
+    for (uint32_t i : d.removed[MINI_COLLECT]) {
+        if (m) minimapRemove(*m, MINI_COLLECT, g.collectibles[i].p, !stale && !isLive(g, g.collectibles[i]));
+        g.collectibles.swapRemove(i);
+    }
+    if (!d.removed[MINI_POWER].empty()) {
+        d.claimed.assign(g.powerups.size(), 0);
+        for (uint32_t i : d.removed[MINI_POWER]) {
+            if (m) minimapRemove(*m, MINI_POWER, g.powerups[i].p, !stale && !isLive(g, g.powerups[i]));
+            for (int t = g.powerups[i].type + 1; t <= PU_TYPE_END; t++) g.powerupRun[t]--;
+            d.claimed[i] = 1;
+        }
+        g.powerups.eraseIf([&](size_t i) { return d.claimed[i] != 0; });
+    }
+    for (uint32_t j : d.added[MINI_OBSTACLE]) {
+        g.obstacles.add(file.obstacles[j]);
+        if (m) minimapAdd(*m, MINI_OBSTACLE, file.obstacles[j].p);
+    }
+    for (uint32_t j : d.added[MINI_COLLECT]) {
+        Collectible c = file.collectibles[j]; c.takenRound = 0;
+        g.collectibles.add(c);
+        if (m) minimapAdd(*m, MINI_COLLECT, c.p);
+    }
+    // the file's power-ups are grouped by type, so the added ones come a type at a time
+    std::vector<PowerUp>& run = d.runScratch;
+    for (size_t k = 0; k < d.added[MINI_POWER].size(); k++) {
+        PowerUp pu = file.powerups[d.added[MINI_POWER][k]]; pu.takenRound = 0;
+        run.push_back(pu);
+        if (m) minimapAdd(*m, MINI_POWER, pu.p);
+        if (k + 1 == d.added[MINI_POWER].size() || file.powerups[d.added[MINI_POWER][k + 1]].type != pu.type) {
+            addPowerUps(g, pu.type, run.data(), run.size());
+            run.clear();
+        }
+    }
+    return parts;
+}
+
+// one read of the level file on its way to the sim (hot reload, 'L')
+struct LevelReload {
+    GameState file;   // indexed: what a full reload swaps in
+    LevelDiff diff;   // indices into the watcher's mirror of the level in play
+    LevelIndex index; // the `parts` that changed, indexed for the level with the diff applied
+    unsigned parts = 0;
+    bool full = true;
+    unsigned epoch = 0; // the mirror's
+    long long changedUs = 0;
+    float readMs = 0.0f;
+};
+
+// -------------------------------
+// Simulation thread: owns `game` and `pilot`, runs fixed ticks, takes
+// input through a lock-free SPSC queue and publishes render snapshots
+// through a lock-free triple buffer
+// -------------------------------
+const int SIM_HZ = 120;
+const float SIM_DT = 1.0f / SIM_HZ;
+const int PILOT_ROUTE_MAX = 400;
+
+// the writer always has a private buffer, the reader swaps in the newest
+// published one; neither side ever waits
+template <class T>
+class TripleBuffer {
+public:
+    T& writeBuffer() { return bufs[writeIdx]; }
+    void publish() {
+        int prev = latest.exchange(writeIdx | FRESH, std::memory_order_acq_rel);
+        if (prev & FRESH) skipped.fetch_add(1, std::memory_order_relaxed); // reader never saw it
+        writeIdx = prev & 3;
+        published.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool acquire() {
+        if (!(latest.load(std::memory_order_relaxed) & FRESH)) return false;
+        readIdx = latest.exchange(readIdx, std::memory_order_acq_rel) & 3;
+        return true;
+    }
+    const T& readBuffer() const { return bufs[readIdx]; }
+    std::atomic<unsigned long long> published{ 0 }, skipped{ 0 };
+private:
+    enum { FRESH = 4 };
+    T bufs[3];
+    std::atomic<int> latest{ 2 };
+    int writeIdx = 0, readIdx = 1;
+};
+
+// everything display() needs, copied from the sim at the end of a tick
+struct RenderSnapshot {
+    GameState state;
+    uint64_t tick = 0;
+    long long publishUs = 0;
+    long long inputUs = 0, inputSimUs = 0; // newest input applied so far, and when the sim took it
+    float tickMs = 0.0f;
+    size_t visible = 0, levelSize = 0; // level entities copied / in the world
+    uint32_t minimapVersion = ~0u;
+    uint8_t minimap[MINIMAP_N * 4];
+    bool scrubbing = false;
+    float rewindSec = 0.0f, historySec = 0.0f; // shown frame behind the newest / history kept
+    int quickSlot = 0;
+    size_t rewindBytes = 0, quickBytes = 0;
+    float captureUs = 0.0f, captureMaxUs = 0.0f, seekUs = 0.0f, seekMaxUs = 0.0f;
+    // pilot overlay
+    bool autopilot = false, showHint = false;
+    float planMs = 0.0f;
+    bool hasGoal = false;
+    Vec2 goal = { 0.0f, 0.0f };
+    int routeLen = 0;
+    Vec2 route[PILOT_ROUTE_MAX];
+};
+
+struct SimCommand {
+    enum Kind { SPECIAL_DOWN, SPECIAL_UP, KEY, PLACE, PAINT, PAINT_END } kind;
+    int key;        // GLUT key / mode for PLACE and PAINT
+    Vec2 at;        // PLACE position / start of a PAINT segment
+    long long stampUs;
+    Vec2 to = { 0.0f, 0.0f }; // end of a PAINT segment
+};
+
+// The renderer gets the whole state except the level, of which only what
+// the spatial index finds under the camera is copied: publishing costs the
+// same on a 1M-entity world as on a one-screen level.
+struct ViewCuller {
+    // empty stand-ins swapped into the sim state while it is copied
+    EntityPool<Obstacle> obstacles;
+    EntityPool<Collectible> collectibles;
+    EntityPool<PowerUp> powerups;
+    LevelIndex index;
+    size_t visible = 0, total = 0; // last copy
+};
+
+void copyVisible(GameState& dst, GameState& src, ViewCuller& park) {
+    src.obstacles.swap(park.obstacles); src.collectibles.swap(park.collectibles); src.powerups.swap(park.powerups);
+    std::swap(src.index, park.index);
+    dst = src; // everything but the level
+    src.obstacles.swap(park.obstacles); src.collectibles.swap(park.collectibles); src.powerups.swap(park.powerups);
+    std::swap(src.index, park.index);
+
+    // a little margin for glows and the power-up bob; taken pickups are left out
+    ViewRect v = cameraView(src);
+    const float M = 16.0f;
+    v.x0 -= M; v.y0 -= M; v.x1 += M; v.y1 += M;
+    src.index.obstacles.query(v.x0, v.y0, v.x1, v.y1, [&](uint32_t i) { dst.obstacles.add(src.obstacles[i]); });
+    src.index.collectibles.query(v.x0, v.y0, v.x1, v.y1, [&](uint32_t i) {
+        if (isLive(src, src.collectibles[i])) dst.collectibles.add(src.collectibles[i]);
+    });
+    for (int t = 0; t <= PU_TYPE_END; t++) {
+        dst.powerupRun[t] = (uint32_t)dst.powerups.size();
+        if (t == 0 || t == PU_TYPE_END) continue;
+        src.index.powerups[t].query(v.x0, v.y0, v.x1, v.y1, [&](uint32_t i) {
+            if (isLive(src, src.powerups[i])) dst.powerups.add(src.powerups[i]);
+        });
+    }
+    park.visible = dst.obstacles.size() + dst.collectibles.size() + dst.powerups.size();
+    park.total = src.obstacles.size() + src.collectibles.size() + src.powerups.size();
+}
+
+// -------------------------------
+// Rewind and quick-save. Every tick stores one small frame (player, target,
+// HUD, effect timers left) in a ring covering the last REWIND_SECONDS, and
+// logs the pickups the tick took with their before/after takenRound. The
+// level never moves, so entities need no keyframes: seeking undoes or
+// redoes the logged pickups between the shown frame and the target one.
+// Memory is fixed; quick-save slots are full copies of the pickup state.
+// -------------------------------
+const int REWIND_SECONDS = 10;
+const int REWIND_STEP = SIM_HZ / 4; // frames per Z / X press (key repeat scrubs)
+
+struct RewindFrame {
+    uint32_t round, tick;
+    bool running, showEnd, playerWon;
+    bool speedActive, doubleActive, shieldActive, magnetActive, freezeActive, invulnerable;
+    int remainingMs, playerScore, playerLives;
+    Vec2 playerPos, playerDir, targetPos;
+    int bz[8];
+    float bezT, timerCarryMs;
+    bool bezReverse;
+    uint32_t effectLeft[TIMER_KIND_COUNT]; // ms left per effect, 0 = off
+    uint32_t deltaEnd;                     // log position after this tick's pickups
+};
+
+struct RewindDelta {
+    uint8_t power; // 0 collectible, 1 power-up
+    uint32_t index, before, after;
+};
+
+struct Rewind {
+    static const int FRAMES = REWIND_SECONDS * SIM_HZ, DELTAS = 8192;
+    RewindFrame frames[FRAMES];
+    RewindDelta deltas[DELTAS];
+    uint32_t first = 0, count = 0; // ring of frames, oldest at `first`
+    uint32_t deltaEnd = 0;         // log position of the live state (free-running, mod DELTAS)
+    bool scrubbing = false;        // the sim is paused on frame `shown`
+    uint32_t shown = 0;            // offset from the oldest frame
+    unsigned long long seenDropped = 0;
+    // costs, in microseconds
+    double captureUs = 0.0, captureMaxUs = 0.0, seekUs = 0.0, seekMaxUs = 0.0;
+    unsigned long long captures = 0, seeks = 0;
+
+    RewindFrame& frame(uint32_t k) { return frames[(first + k) % FRAMES]; }
+    const RewindFrame& frame(uint32_t k) const { return frames[(first + k) % FRAMES]; }
+};
+
+void rewindStore(RewindFrame& f, const GameState& g) {
+    f.round = g.round; f.tick = g.tick;
+    f.running = g.running; f.showEnd = g.showEnd; f.playerWon = g.playerWon;
+    f.speedActive = g.speedActive; f.doubleActive = g.doubleActive; f.shieldActive = g.shieldActive;
+    f.magnetActive = g.magnetActive; f.freezeActive = g.freezeActive; f.invulnerable = g.invulnerable;
+    f.remainingMs = g.remainingMs; f.playerScore = g.playerScore; f.playerLives = g.playerLives;
+    f.playerPos = g.playerPos; f.playerDir = g.playerDir; f.targetPos = g.targetPos;
+    memcpy(f.bz, g.bz_p0, sizeof(int) * 2); memcpy(f.bz + 2, g.bz_p1, sizeof(int) * 2);
+    memcpy(f.bz + 4, g.bz_p2, sizeof(int) * 2); memcpy(f.bz + 6, g.bz_p3, sizeof(int) * 2);
+    f.bezT = g.bezT; f.bezReverse = g.bezReverse; f.timerCarryMs = g.timerCarryMs;
+    for (int k = 0; k < TIMER_KIND_COUNT; k++) f.effectLeft[k] = g.timers.remaining(g.effectTimers[k]);
+}
+
+// the wheel restarts from the stored time left; its nodes are reused
+void rewindLoad(const RewindFrame& f, GameState& g) {
+    g.round = f.round; g.tick = f.tick;
+    g.running = f.running; g.showEnd = f.showEnd; g.playerWon = f.playerWon;
+    g.speedActive = f.speedActive; g.doubleActive = f.doubleActive; g.shieldActive = f.shieldActive;
+    g.magnetActive = f.magnetActive; g.freezeActive = f.freezeActive; g.invulnerable = f.invulnerable;
+    g.remainingMs = f.remainingMs; g.playerScore = f.playerScore; g.playerLives = f.playerLives;
+    g.playerPos = f.playerPos; g.playerDir = f.playerDir; g.targetPos = f.targetPos;
+    memcpy(g.bz_p0, f.bz, sizeof(int) * 2); memcpy(g.bz_p1, f.bz + 2, sizeof(int) * 2);
+    memcpy(g.bz_p2, f.bz + 4, sizeof(int) * 2); memcpy(g.bz_p3, f.bz + 6, sizeof(int) * 2);
+    g.bezT = f.bezT; g.bezReverse = f.bezReverse; g.timerCarryMs = f.timerCarryMs;
+    g.timers.clear();
+    for (int k = 0; k < TIMER_KIND_COUNT; k++) {
+        g.effectTimers[k] = TimerId();
+        if (f.effectLeft[k]) g.effectTimers[k] = g.timers.schedule(f.effectLeft[k], (uint8_t)k, 0);
+    }
+    g.bus.count = 0;
+}
+
+// forget the history (level changed, quick-load)
+void rewindClear(Rewind& rw) {
+    rw.first = rw.count = 0;
+    rw.scrubbing = false;
+}
+
+// after each tick: log its pickups and append its frame; bounded by the tick's events
+void rewindCapture(Rewind& rw, const GameState& g) {
+    if (rw.count && rw.frame(rw.count - 1).round == g.round && rw.frame(rw.count - 1).tick == g.tick) return; // not ticking
+    auto t0 = std::chrono::steady_clock::now();
+    // a dropped event is a pickup the log can't undo: start over from here
+    if (g.bus.dropped != rw.seenDropped) { rw.seenDropped = g.bus.dropped; rewindClear(rw); }
+    for (int i = 0; i < g.bus.count; i++) {
+        const GameEvent& e = g.bus.events[i];
+        if (e.type == EV_COLLECT || e.type == EV_POWERUP)
+            rw.deltas[rw.deltaEnd++ % Rewind::DELTAS] = { (uint8_t)(e.type == EV_POWERUP), e.entity, e.before, g.round };
+    }
+    // drop the oldest frames once the log has wrapped over the pickups they need
+    while (rw.count && rw.deltaEnd - rw.frame(0).deltaEnd > (uint32_t)Rewind::DELTAS) { rw.first = (rw.first + 1) % Rewind::FRAMES; rw.count--; }
+    if (rw.count == (uint32_t)Rewind::FRAMES) { rw.first = (rw.first + 1) % Rewind::FRAMES; rw.count--; }
+    RewindFrame& f = rw.frame(rw.count++);
+    rewindStore(f, g);
+    f.deltaEnd = rw.deltaEnd;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    rw.captureUs += us; rw.captureMaxUs = (std::max)(rw.captureMaxUs, us); rw.captures++;
+}
+
+static inline void rewindSetTaken(GameState& g, const RewindDelta& d, uint32_t takenRound, uint32_t round) {
+    uint32_t& t = d.power ? g.powerups[d.index].takenRound : g.collectibles[d.index].takenRound;
+    // the minimap only tracks the round it shows; a seek across rounds rebuilds it
+    if (round == minimap.round && (t == round) != (takenRound == round))
+        minimapRetake(minimap, d.power ? MINI_POWER : MINI_COLLECT,
+            d.power ? g.powerups[d.index].p : g.collectibles[d.index].p, takenRound == round);
+    t = takenRound;
+}
+
+// show frame `to` (offset from the oldest); costs the pickups in between, not the level size
+void rewindSeek(Rewind& rw, GameState& g, uint32_t to) {
+    if (!rw.count) return;
+    auto t0 = std::chrono::steady_clock::now();
+    to = (std::min)(to, rw.count - 1);
+    const RewindFrame& f = rw.frame(to);
+    uint32_t at = rw.scrubbing ? rw.frame(rw.shown).deltaEnd : rw.deltaEnd, end = f.deltaEnd;
+    // undo newer pickups newest first, or redo older ones oldest first
+    while (at != end && at - end <= (uint32_t)Rewind::DELTAS) { const RewindDelta& d = rw.deltas[--at % Rewind::DELTAS]; rewindSetTaken(g, d, d.before, f.round); }
+    while (at != end) { const RewindDelta& d = rw.deltas[at++ % Rewind::DELTAS]; rewindSetTaken(g, d, d.after, f.round); }
+    rewindLoad(f, g);
+    if (minimap.round != g.round) minimapBuild(minimap, g);
+    g.index.pickups.invalidate(); // pickups may have come back
+    rw.shown = to;
+    rw.scrubbing = true;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    rw.seekUs += us; rw.seekMaxUs = (std::max)(rw.seekMaxUs, us); rw.seeks++;
+}
+
+void rewindStep(Rewind& rw, GameState& g, int frames) {
+    if (!rw.count) return;
+    int from = rw.scrubbing ? (int)rw.shown : (int)rw.count - 1;
+    rewindSeek(rw, g, (uint32_t)(std::max)(0, (std::min)((int)rw.count - 1, from + frames)));
+}
+
+// play on from the frame shown; the frames after it are dropped
+void rewindResume(Rewind& rw) {
+    if (!rw.scrubbing) return;
+    rw.count = rw.shown + 1;
+    rw.deltaEnd = rw.frame(rw.shown).deltaEnd;
+    rw.scrubbing = false;
+}
+
+size_t rewindBytesUsed(const Rewind& rw) {
+    return rw.count * sizeof(RewindFrame) + (rw.count ? rw.deltaEnd - rw.frame(0).deltaEnd : 0) * sizeof(RewindDelta);
+}
+
+// quick-save: a whole state, valid only for the level it was taken on
+struct QuickSave {
+    bool used = false;
+    RewindFrame core;
+    size_t obstacles = 0;
+    float worldW = 0.0f, worldH = 0.0f;
+    std::vector<uint32_t> collectTaken, powerTaken;
+};
+const int QUICK_SLOTS = 3;
+
+void quickSave(QuickSave& q, const GameState& g) {
+    rewindStore(q.core, g);
+    q.obstacles = g.obstacles.size(); q.worldW = g.worldW; q.worldH = g.worldH;
+    q.collectTaken.resize(g.collectibles.size());
+    q.powerTaken.resize(g.powerups.size());
+    for (size_t i = 0; i < g.collectibles.size(); i++) q.collectTaken[i] = g.collectibles[i].takenRound;
+    for (size_t i = 0; i < g.powerups.size(); i++) q.powerTaken[i] = g.powerups[i].takenRound;
+    q.used = true;
+}
+
+bool quickLoad(const QuickSave& q, GameState& g) {
+    if (!q.used || q.obstacles != g.obstacles.size() || q.worldW != g.worldW || q.worldH != g.worldH ||
+        q.collectTaken.size() != g.collectibles.size() || q.powerTaken.size() != g.powerups.size()) return false;
+    for (size_t i = 0; i < g.collectibles.size(); i++) g.collectibles[i].takenRound = q.collectTaken[i];
+    for (size_t i = 0; i < g.powerups.size(); i++) g.powerups[i].takenRound = q.powerTaken[i];
+    rewindLoad(q.core, g);
+    g.index.pickups.invalidate();
+    return true;
+}
+
+size_t quickSaveBytes(const QuickSave* slots) {
+    size_t n = 0;
+    for (int i = 0; i < QUICK_SLOTS; i++) n += (slots[i].collectTaken.capacity() + slots[i].powerTaken.capacity()) * sizeof(uint32_t);
+    return n;
+}
+
+Rewind simRewind;
+PaintBrush simBrush;
+QuickSave quickSlots[QUICK_SLOTS];
+int quickSlot = 0;
+
+SpscRing<SimCommand, 256> simCommands;
+TripleBuffer<RenderSnapshot> simSnapshots;
+ViewCuller simCuller;
+std::thread simThread;
+std::atomic<bool> simQuit{ false };
+std::atomic<unsigned long long> simOverruns{ 0 };
+uint64_t simTicks = 0;
+long long lastInputUs = 0, lastInputSimUs = 0;
+
+// 'R' to the first tick that plays the new round (written by the sim)
+long long roundKeyUs = 0;
+bool roundPending = false;
+std::atomic<float> roundStartMs{ 0.0f }, roundStartMaxMs{ 0.0f };
+std::atomic<unsigned> roundStarts{ 0 };
+
+// the level file 'S' saves and 'L' loads (--level picks another)
+const char* levelPath = "level.txt";
+bool levelWatched = false; // --watch: reloads it on every change (set before the sim starts)
+uint32_t simLevelGen = 0;  // bumped by every change to the level in play
+
+// 'L' reads and indexes the file on a worker into `staged` while the sim
+// keeps ticking; the sim swaps the finished level in at a tick boundary.
+// Commands that edit or save the level wait for it first, so they still
+// apply in the order they were sent
+struct LevelLoad {
+    std::future<bool> done;
+    std::unique_ptr<GameState> staged; // keeps the previous level's memory for the next load
+    std::unique_ptr<LevelReload> copy; // --watch: what was read, for the watcher to diff against
+    long long startUs = 0;
+    float lastMs = 0.0f;
+};
+LevelLoad levelLoad;
+
+// leave the rewound frame and play on from it
+void simResume() {
+    if (!simRewind.scrubbing) return;
+    rewindResume(simRewind);
+    game.index.pickups.invalidate();
+    if (pilot.built) navSync(pilot, game);
+}
+
+// the level was replaced or edited: derived state follows it
+void simLevelChanged() {
+    simLevelGen++;
+    pilot.built = false;
+    minimapBuild(minimap, game);
+    rewindClear(simRewind);
+}
+
+void levelLoadStart() {
+    if (levelLoad.done.valid()) return; // one at a time
+    if (!levelLoad.staged) levelLoad.staged.reset(new GameState());
+    GameState* st = levelLoad.staged.get();
+    st->index.kind = game.index.kind;
+    const char* path = levelPath;
+    std::unique_ptr<LevelReload>* copy = levelWatched ? &levelLoad.copy : NULL;
+    levelLoad.startUs = nowUs();
+    levelLoad.done = std::async(std::launch::async, [st, path, copy] {
+        if (!loadLevel(*st, path)) return false;
+        if (copy) { copy->reset(new LevelReload()); copyLevel((*copy)->file, *st); }
+        return true;
+    });
+}
+
+void levelWatchResync(std::unique_ptr<LevelReload>& r); // hot reload, below
+
+// adopts a finished load; `wait` blocks on one still running
+void levelLoadPoll(bool wait) {
+    if (!levelLoad.done.valid()) return;
+    if (!wait && levelLoad.done.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+    bool ok = levelLoad.done.get();
+    levelLoad.lastMs = (nowUs() - levelLoad.startUs) * 0.001f;
+    if (!ok) { printf("Cannot load %s\n", levelPath); return; }
+    adoptLevel(game, *levelLoad.staged, true); // rebuilds only if 'I' was pressed while it loaded
+    simLevelChanged();
+    if (levelLoad.copy) levelWatchResync(levelLoad.copy);
+    printf("Loaded %s: %zu objects in %.1f ms%s\n", levelPath,
+        game.obstacles.size() + game.collectibles.size() + game.powerups.size(), levelLoad.lastMs,
+        wait ? "" : " (the sim kept ticking)");
+}
+
+// painted objects join the level before anything else reads it
+void simPaintFlush() {
+    if (!paintFlush(game, simBrush, &minimap)) return;
+    simLevelGen++;
+    rewindClear(simRewind); // logged indices no longer match
+    if (pilot.built) navSync(pilot, game);
 }
 
 // -------------------------------
-// Draw game objects and visuals
+// Level hot reload (--watch): a watcher thread waits for the level file to
+// change, using inotify on Linux, change notifications on Windows and the
+// file's time stamp elsewhere. Everything that grows with the level runs
+// on the watcher. It reads and indexes the file, then diffs it against a
+// mirror of the level in play: the same entities in the same order. It
+// applies the diff to the mirror and indexes the parts that changed. At a
+// tick boundary the sim replays the removals and inserts and swaps those
+// index parts in. After any other edit (placing, painting, 'C', 'G') the
+// level no longer matches the mirror: the sim swaps in the whole indexed
+// file instead and the next read starts the mirror over.
 // -------------------------------
-void drawBackgroundStars(float dt) {
-    // subtle moving stars
-    glColor3f(0.85f, 0.85f, 1.0f);
-    int count = 80;
-    float time = (float)glutGet(GLUT_ELAPSED_TIME) * 0.001f;
-    for (int i = 0; i < count; i++) {
-        float x = fmodf(i * 37.1f + time * 30.0f, (float)WIN_W);
-        float y = GAME_Y0 + fmodf(i * 61.7f + time * 13.0f, (float)(GAME_Y1 - GAME_Y0));
-        glPointSize((i % 6 == 0) ? 2.8f : 1.6f);
-        glBegin(GL_POINTS); glVertex2f(x, y); glEnd();
+struct LevelWatch {
+    std::thread thread;
+    std::atomic<bool> quit{ false }, pending{ false };
+    std::atomic<int> kind{ INDEX_GRID }; // the sim's index kind, the one the watcher builds
+    std::atomic<unsigned> epoch{ 0 };    // bumped by the sim when its level stops matching the mirror
+    std::mutex lock;
+    std::unique_ptr<LevelReload> ready;  // read, waiting for the sim
+    std::unique_ptr<LevelReload> synced; // the sim's level is this file, in order: the next mirror
+    GameState mirror;                    // watcher thread
+    unsigned mirrorEpoch = UINT32_MAX;
+    uint32_t syncedGen = UINT32_MAX;     // sim thread: simLevelGen when the level last matched the mirror
+    unsigned reloads = 0, full = 0;
+};
+LevelWatch levelWatch;
+
+// sim thread: the level in play now holds r's file entity for entity
+void levelWatchResync(std::unique_ptr<LevelReload>& r) {
+    std::lock_guard<std::mutex> hold(levelWatch.lock);
+    r->epoch = levelWatch.epoch.load(std::memory_order_relaxed) + 1;
+    levelWatch.epoch.store(r->epoch, std::memory_order_relaxed);
+    levelWatch.synced.swap(r);
+    levelWatch.syncedGen = simLevelGen;
+}
+
+static long long levelStamp(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    return (long long)st.st_mtime * 1000003LL + (long long)st.st_size;
+}
+
+// a read that replaces one the sim has not taken yet goes whole: the
+// mirror already has the other one's edits. An unreadable file is skipped
+static void levelWatchRead(LevelWatch& w, long long seenUs) {
+    std::unique_ptr<LevelReload> r(new LevelReload()), back;
+    GameState& file = r->file;
+    file.index.kind = (IndexKind)w.kind.load(std::memory_order_relaxed);
+    if (!loadLevel(file, levelPath)) return;
+    unsigned epoch;
+    {
+        std::lock_guard<std::mutex> hold(w.lock);
+        back.swap(w.synced);
+        epoch = w.epoch.load(std::memory_order_relaxed);
+    }
+    GameState& m = w.mirror;
+    if (back && back->epoch == epoch) { swapLevel(m, back->file); w.mirrorEpoch = epoch; }
+    LevelDiff& d = r->diff;
+    bool full = w.mirrorEpoch != epoch || w.pending.load(std::memory_order_acquire) ||
+        file.worldW != m.worldW || file.worldH != m.worldH;
+    if (!full) {
+        diffLevel(d, m, file);
+        if (!d.changes()) return; // saved without changes
+        size_t size = (std::max)(m.obstacles.size() + m.collectibles.size() + m.powerups.size(),
+            file.obstacles.size() + file.collectibles.size() + file.powerups.size());
+        full = d.changes() > RELOAD_FULL_SHARE * size;
+    }
+    if (full) { copyLevel(m, file); w.mirrorEpoch = epoch; }
+    else {
+        m.index.kind = r->index.kind = file.index.kind;
+        r->parts = applyLevelDiff(m, file, d, NULL);
+        indexLevel(m, r->parts);
+        swapIndexParts(r->index, m.index, r->parts);
     }
+    r->full = full; r->epoch = epoch;
+    r->changedUs = seenUs; r->readMs = (nowUs() - seenUs) * 0.001f;
+    std::lock_guard<std::mutex> hold(w.lock);
+    w.ready.swap(r);
+    w.pending.store(true, std::memory_order_release);
 }
 
-void drawPlayer() {
-    // glow outer
-    glColor4f(0.1f, 0.6f, 1.0f, 0.18f);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    drawCircle({ playerPos.x, playerPos.y }, playerRadius + 8, 32);
-    glDisable(GL_BLEND);
+void levelWatchMain(LevelWatch& w) {
+    // the directory is watched: editors often save by renaming a new file over the old one
+    char dir[512] = ".";
+    const char* name = levelPath;
+    const char* slash = strrchr(levelPath, '/');
+#ifdef _WIN32
+    if (const char* back = strrchr(levelPath, '\\')) if (!slash || back > slash) slash = back;
+#endif
+    if (slash) {
+        snprintf(dir, sizeof(dir), "%.*s", slash == levelPath ? 1 : (int)(slash - levelPath), levelPath);
+        name = slash + 1;
+    }
+#if defined(__linux__)
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd >= 0 && inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+        printf("Watching %s (inotify)\n", levelPath);
+        alignas(inotify_event) char buf[4096];
+        while (!w.quit.load(std::memory_order_acquire)) {
+            pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 100) <= 0) continue;
+            long long seen = nowUs();
+            bool hit = false;
+            ssize_t n;
+            while ((n = read(fd, buf, sizeof(buf))) > 0)
+                for (char* at = buf; at < buf + n; at += sizeof(inotify_event) + ((inotify_event*)at)->len) {
+                    const inotify_event* ev = (const inotify_event*)at;
+                    if (ev->len && !strcmp(ev->name, name)) hit = true;
+                }
+            if (hit) levelWatchRead(w, seen);
+        }
+        close(fd);
+        return;
+    }
+    if (fd >= 0) close(fd);
+#elif defined(_WIN32)
+    HANDLE h = FindFirstChangeNotificationA(dir, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (h != INVALID_HANDLE_VALUE) {
+        printf("Watching %s (change notifications)\n", levelPath);
+        while (!w.quit.load(std::memory_order_acquire)) {
+            if (WaitForSingleObject(h, 100) != WAIT_OBJECT_0) continue;
+            long long seen = nowUs();
+            // any file in the directory, possibly mid-write: let it settle, then the diff tells
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            FindNextChangeNotification(h);
+            levelWatchRead(w, seen);
+        }
+        FindCloseChangeNotification(h);
+        return;
+    }
+#endif
+    printf("Watching %s (polling)\n", levelPath);
+    long long stamp = levelStamp(levelPath);
+    while (!w.quit.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        long long now = levelStamp(levelPath);
+        if (now != stamp) { stamp = now; levelWatchRead(w, nowUs()); }
+    }
+}
 
-    // main body
-    glColor3f(0.18f, 0.7f, 1.0f);
-    drawCircle(playerPos, playerRadius, 32);
+void startLevelWatch() { levelWatch.thread = std::thread(levelWatchMain, std::ref(levelWatch)); }
 
-    // nose / triangle pointing to direction
-    glColor3f(0.95f, 0.6f, 0.2f);
-    Vec2 tip = { playerPos.x + playerDir.x * (playerRadius + 10), playerPos.y + playerDir.y * (playerRadius + 10) };
-    Vec2 left = { playerPos.x - playerDir.y * 8.0f, playerPos.y + playerDir.x * 8.0f };
-    Vec2 right = { playerPos.x + playerDir.y * 8.0f, playerPos.y - playerDir.x * 8.0f };
-    glBegin(GL_TRIANGLES);
-    glVertex2f(tip.x, tip.y);
-    glVertex2f(left.x, left.y);
-    glVertex2f(right.x, right.y);
-    glEnd();
+void stopLevelWatch() {
+    levelWatch.quit.store(true, std::memory_order_release);
+    if (levelWatch.thread.joinable()) levelWatch.thread.join();
+}
 
-    // direction line
+// sim thread, each tick: take the newest read of the file
+void levelWatchPoll() {
+    levelWatch.kind.store(game.index.kind, std::memory_order_relaxed);
+    if (!levelWatch.pending.load(std::memory_order_acquire)) return;
+    std::unique_ptr<LevelReload> r;
+    {
+        std::lock_guard<std::mutex> hold(levelWatch.lock);
+        r.swap(levelWatch.ready);
+        levelWatch.pending.store(false, std::memory_order_relaxed);
+    }
+    if (!r) return;
+    levelLoadPoll(true); // an 'L' or a paint stroke sent earlier lands first
+    simPaintFlush();
+    long long t0 = nowUs();
+    bool mirrored = r->epoch == levelWatch.epoch.load(std::memory_order_relaxed), whole = false;
+    size_t removed = 0, added = 0;
+    if (!r->full && mirrored && simLevelGen == levelWatch.syncedGen) {
+        for (int k = 0; k < 3; k++) { removed += r->diff.removed[k].size(); added += r->diff.added[k].size(); }
+        unsigned parts = applyLevelDiff(game, r->file, r->diff, &minimap);
+        if (r->index.kind == game.index.kind) swapIndexParts(game.index, r->index, parts);
+        else indexLevel(game, parts); // 'I' was pressed since the read
+        game.index.pickups.invalidate(); // counted on the mirror, where nothing is taken
+        levelWatch.syncedGen = ++simLevelGen;
+        rewindClear(simRewind); // logged indices no longer match
+        // the pilot's fields only repair around new objects
+        if (removed) pilot.built = false;
+        else if (pilot.built) navSync(pilot, game);
+    }
+    else if (sameLevel(game, r->file)) {
+        // our own 'S' after an edit: already in play, and from now on the mirror
+        levelWatchResync(r);
+        return;
+    }
+    else {
+        mirrored = mirrored && r->full;
+        whole = true;
+        adoptLevel(game, r->file, true);
+        simLevelChanged();
+        if (mirrored) levelWatch.syncedGen = simLevelGen;
+        else levelWatch.epoch.fetch_add(1, std::memory_order_relaxed); // the next read starts the mirror over
+        levelWatch.full++;
+    }
+    for (QuickSave& q : quickSlots) q.used = false; // saved against the old level's indices
+    levelWatch.reloads++;
+    long long done = nowUs();
+    if (whole) printf("Reloaded %s: swapped in all %zu objects in %.2f ms", levelPath,
+        game.obstacles.size() + game.collectibles.size() + game.powerups.size(), (done - t0) * 0.001);
+    else printf("Reloaded %s: %zu removed, %zu added in %.2f ms", levelPath, removed, added, (done - t0) * 0.001);
+    printf(" (read, diff and index %.1f ms; %.1f ms from the change to the level in play)\n", r->readMs, (done - r->changedUs) * 0.001);
+}
+
+void simKeyboard(unsigned char key) {
+    // rewind: Z steps back, X forward while paused on a rewound frame
+    if (key == 'z' || key == 'Z') { rewindStep(simRewind, game, -REWIND_STEP); return; }
+    if (key == 'x' || key == 'X') { if (simRewind.scrubbing) rewindStep(simRewind, game, REWIND_STEP); return; }
+    // any other key plays on from the frame shown (space does nothing else)
+    simResume();
+    // everything below but the pilot keys edits, saves or plays the level
+    if (key && strchr("rRcCsSlLgGiI", key)) levelLoadPoll(true);
+    if (key == 'r' || key == 'R') {
+        roundKeyUs = lastInputUs; roundPending = true;
+        playBackgroundMusic();
+        // start/reset
+        resetRound(game);
+        // pickups revived by the new round are repaired in place; the fields stay
+        if (pilot.built) navSync(pilot, game);
+    }
+    if (key == 'c' || key == 'C') {
+        // clear everything (reset to placement mode)
+        stopBackgroundMusic();
+        clearLevel(game);
+        game.running = false; game.showEnd = false;
+        game.playerScore = 0; game.playerLives = 5; game.remainingMs = totalTime * 1000;
+        simLevelChanged();
+    }
+    // save / load the placed level (used by the --batch evaluator)
+    if (key == 's' || key == 'S') {
+        if (saveLevel(game, levelPath)) printf("Saved %s\n", levelPath);
+    }
+    if ((key == 'l' || key == 'L') && !game.running) levelLoadStart();
+    // flow-field pilot: fly the ship / show the planned route
+    if (key == 'a' || key == 'A') {
+        autopilot = !autopilot;
+        game.keyLeft = game.keyRight = game.keyUp = game.keyDown = false;
+    }
+    if (key == 'h' || key == 'H') showHint = !showHint;
+    // paint brush: [ ] stroke width, , . spacing
+    if (key == '[' || key == ']' || key == ',' || key == '.') {
+        if (key == '[') simBrush.radius = (std::max)(8.0f, simBrush.radius / 1.25f);
+        if (key == ']') simBrush.radius = (std::min)(400.0f, simBrush.radius * 1.25f);
+        if (key == ',') simBrush.spacing = (std::max)(1.0f, simBrush.spacing - 0.25f);
+        if (key == '.') simBrush.spacing = (std::min)(4.0f, simBrush.spacing + 0.25f);
+        printf("Brush: %.0f px wide, spacing %.2fx\n", simBrush.radius * 2.0f, simBrush.spacing);
+    }
+    // switch the level's spatial index: queries find the same entities, visited in another order
+    if (key == 'i' || key == 'I') {
+        game.index.kind = (IndexKind)((game.index.kind + 1) % INDEX_KIND_COUNT);
+        indexLevel(game);
+        printf("Index: %s\n", indexKindNames[game.index.kind]);
+    }
+    // fill the play area with a random Poisson-disk level
+    if ((key == 'g' || key == 'G') && !game.running) {
+        LevelGenParams prm;
+        prm.seed = (uint32_t)rand() * 2654435761u + 1u;
+        prm.density = 0.35f;
+        int n = generateLevel(game, prm);
+        printf("Generated level with %d objects (seed %u)\n", n, prm.seed);
+        simLevelChanged();
+    }
+}
+
+void simPlace(int mode, Vec2 p) {
+    simResume();
+    levelLoadPoll(true);
+    p = clampToArea(game, p, 20.0f);
+    unsigned parts = 0; // only the placed kind's index is rebuilt
+    if (mode == OBSTACLE_MODE) {
+        Obstacle ob; ob.p = p; ob.r = obstacleRadius;
+        if (!overlapsExisting(game, ob.p, ob.r)) { game.obstacles.add(ob); minimapAdd(minimap, MINI_OBSTACLE, p); parts = LEVEL_OBSTACLES; }
+    }
+    else if (mode == COLLECT_MODE) {
+        Collectible c; c.p = p; c.r = collectibleRadius; c.takenRound = 0; c.rot = 0.0f;
+        if (!overlapsExisting(game, c.p, c.r)) { game.collectibles.add(c); minimapAdd(minimap, MINI_COLLECT, p); parts = LEVEL_COLLECTIBLES; }
+    }
+    else if (mode >= POWER_MODE && mode < PLACE_MODE_END) {
+        PowerUp pu; pu.p = p; pu.r = powerUpRadius; pu.type = mode - POWER_MODE + 1; pu.takenRound = 0; pu.phase = 0.0f;
+        if (!overlapsExisting(game, pu.p, pu.r)) { addPowerUp(game, pu); minimapAdd(minimap, MINI_POWER, p); parts = LEVEL_POWERUPS; }
+    }
+    if (parts) {
+        simLevelGen++;
+        indexLevel(game, parts);
+        rewindClear(simRewind); // logged indices no longer match
+    }
+    // repair the pilot's fields around the new object only
+    if (pilot.built) navSync(pilot, game);
+}
+
+void simApply(const SimCommand& cmd) {
+    bool down = cmd.kind == SimCommand::SPECIAL_DOWN;
+    if (cmd.kind != SimCommand::PAINT) simPaintFlush();
+    switch (cmd.kind) {
+    case SimCommand::SPECIAL_DOWN:
+        // quick-save slots: F5 saves, F9 loads, F6 picks the next slot
+        if (cmd.key == GLUT_KEY_F5) {
+            quickSave(quickSlots[quickSlot], game);
+            printf("Quick-saved slot %d (%zu KB)\n", quickSlot + 1, quickSaveBytes(quickSlots) / 1024);
+            break;
+        }
+        if (cmd.key == GLUT_KEY_F9) {
+            if (!quickLoad(quickSlots[quickSlot], game)) { printf("Slot %d is empty or from another level\n", quickSlot + 1); break; }
+            rewindClear(simRewind);
+            minimapBuild(minimap, game);
+            if (pilot.built) navSync(pilot, game);
+            printf("Quick-loaded slot %d\n", quickSlot + 1);
+            break;
+        }
+        if (cmd.key == GLUT_KEY_F6) { quickSlot = (quickSlot + 1) % QUICK_SLOTS; break; }
+        simResume(); // steering plays on from a rewound frame
+        // fall through
+    case SimCommand::SPECIAL_UP:
+        if (cmd.key == GLUT_KEY_LEFT) game.keyLeft = down;
+        if (cmd.key == GLUT_KEY_RIGHT) game.keyRight = down;
+        if (cmd.key == GLUT_KEY_UP) game.keyUp = down;
+        if (cmd.key == GLUT_KEY_DOWN) game.keyDown = down;
+        break;
+    case SimCommand::KEY: simKeyboard((unsigned char)cmd.key); break;
+    case SimCommand::PLACE: simPlace(cmd.key, cmd.at); break;
+    case SimCommand::PAINT:
+        simResume();
+        levelLoadPoll(true);
+        paintSegment(game, simBrush, cmd.key, cmd.at, cmd.to);
+        break;
+    case SimCommand::PAINT_END:
+        paintFinish(game, simBrush);
+        if (simBrush.batches)
+            printf("Painted %u of %u candidates in %u batches: %.1f us per batch (max %lld), %.1f ms adding, %.1f ms in tree rebuilds\n",
+                simBrush.placed, simBrush.offered, simBrush.batches, (double)simBrush.batchUs / simBrush.batches,
+                simBrush.maxBatchUs, simBrush.flushUs * 0.001, simBrush.finishUs * 0.001);
+        simBrush.batches = simBrush.offered = simBrush.placed = 0;
+        simBrush.batchUs = simBrush.maxBatchUs = simBrush.flushUs = simBrush.finishUs = 0;
+        break;
+    }
+}
+
+void simPublish(float tickMs) {
+    RenderSnapshot& s = simSnapshots.writeBuffer();
+    copyVisible(s.state, game, simCuller); // pools copy into the buffer's existing memory
+    s.visible = simCuller.visible; s.levelSize = simCuller.total;
+    // texels only travel when a cell changed since this buffer last had them
+    minimapSync(minimap, game);
+    if (s.minimapVersion != minimap.version) {
+        memcpy(s.minimap, minimap.texels, sizeof(s.minimap));
+        s.minimapVersion = minimap.version;
+    }
+    s.scrubbing = simRewind.scrubbing;
+    s.historySec = simRewind.count / (float)SIM_HZ;
+    s.rewindSec = simRewind.scrubbing ? (simRewind.count - 1 - simRewind.shown) / (float)SIM_HZ : 0.0f;
+    s.quickSlot = quickSlot;
+    s.rewindBytes = rewindBytesUsed(simRewind); s.quickBytes = quickSaveBytes(quickSlots);
+    s.captureUs = simRewind.captures ? (float)(simRewind.captureUs / simRewind.captures) : 0.0f;
+    s.seekUs = simRewind.seeks ? (float)(simRewind.seekUs / simRewind.seeks) : 0.0f;
+    s.captureMaxUs = (float)simRewind.captureMaxUs; s.seekMaxUs = (float)simRewind.seekMaxUs;
+    s.tick = ++simTicks;
+    s.inputUs = lastInputUs; s.inputSimUs = lastInputSimUs;
+    s.tickMs = tickMs;
+    s.autopilot = autopilot; s.showHint = showHint;
+    s.planMs = pilot.lastPlanMs;
+    s.hasGoal = pilot.built && pilot.goalField >= 0 && (autopilot || showHint);
+    s.routeLen = 0;
+    if (s.hasGoal) {
+        const NavField& f = pilot.fields[pilot.goalField];
+        s.goal = navCenter(pilot, f.goal);
+        int c = navStartCell(pilot, f, game.playerPos);
+        for (int k = 0; c >= 0 && s.routeLen < PILOT_ROUTE_MAX; k++, c = f.parent[c])
+            if (k % 2 == 0) s.route[s.routeLen++] = navCenter(pilot, c);
+    }
+    s.publishUs = nowUs();
+    simSnapshots.publish();
+}
+
+static inline Vec2 heldDirection(const GameState& g) {
+    Vec2 d = { (g.keyRight ? 1.0f : 0.0f) - (g.keyLeft ? 1.0f : 0.0f), (g.keyUp ? 1.0f : 0.0f) - (g.keyDown ? 1.0f : 0.0f) };
+    float m = sqrtf(d.x * d.x + d.y * d.y);
+    if (m > 0.0f) { d.x /= m; d.y /= m; }
+    return d;
+}
+
+long long simWindowUs = 0; // wall time of the previous tick boundary
+
+// drain input at the tick boundary t0, replaying key changes at their
+// timestamps across [previous boundary, t0] to get the held time per direction
+void simDrainInput(long long t0) {
+    long long start = simWindowUs ? simWindowUs : t0 - 1000000 / SIM_HZ;
+    long long cursor = start;
+    Vec2 move = { 0.0f, 0.0f };
+    SimCommand cmd;
+    while (simCommands.pop(cmd)) {
+        long long at = (std::max)(cursor, (std::min)(t0, cmd.stampUs));
+        Vec2 d = heldDirection(game);
+        move.x += d.x * (at - cursor); move.y += d.y * (at - cursor);
+        cursor = at;
+        lastInputUs = cmd.stampUs;
+        lastInputSimUs = t0;
+        simApply(cmd);
+    }
+    Vec2 d = heldDirection(game);
+    move.x += d.x * (t0 - cursor); move.y += d.y * (t0 - cursor);
+    // wall-clock window -> one sim tick, whatever the scheduling jitter
+    float scale = SIM_DT / (float)(std::max)(1LL, t0 - start);
+    game.inputMove = { move.x * scale, move.y * scale };
+    game.sampledInput = !autopilot; // the pilot steers through the key bools
+    simWindowUs = t0;
+    simPaintFlush(); // one index rebuild for every batch painted this tick
+}
+
+void simThreadMain() {
+#ifdef _WIN32
+    timeBeginPeriod(1); // 1 ms sleep granularity for the tick pacing
+#endif
+    const auto tickLen = std::chrono::microseconds(1000000 / SIM_HZ);
+    auto next = std::chrono::steady_clock::now();
+    while (!simQuit.load(std::memory_order_acquire)) {
+        long long t0 = nowUs();
+        // input is applied at tick boundaries, in timestamp order
+        simDrainInput(t0);
+        levelLoadPoll(false);
+        levelWatchPoll();
+
+        // paused on a rewound frame: nothing moves until play resumes
+        if (!simRewind.scrubbing) {
+            // pilot plans every tick while it flies or shows its route
+            if (game.running && autopilot) flowPilotDrive(pilot, game, pilotPolicy, pilotBot, SIM_DT);
+            else if (game.running && showHint) navPlan(pilot, game);
+            stepGame(game, SIM_DT);
+            if (roundPending && game.running) {
+                float ms = (nowUs() - roundKeyUs) * 0.001f;
+                roundStartMs.store(ms, std::memory_order_relaxed);
+                if (ms > roundStartMaxMs.load(std::memory_order_relaxed)) roundStartMaxMs.store(ms, std::memory_order_relaxed);
+                roundStarts.fetch_add(1, std::memory_order_relaxed);
+                roundPending = false;
+            }
+            // side effects of this tick, batched per subscriber
+            drainEvents(game, SUB_AUDIO, SUB_COUNT);
+            rewindCapture(simRewind, game);
+        }
+        game.bus.count = 0;
+        simPublish((nowUs() - t0) * 0.001f);
+
+        next += tickLen;
+        auto now = std::chrono::steady_clock::now();
+        if (now > next) {
+            simOverruns.fetch_add(1, std::memory_order_relaxed);
+            if (now - next > tickLen * 8) next = now; // stalled (debugger, suspend): don't try to catch up
+        }
+        std::this_thread::sleep_until(next);
+    }
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void startSimThread() {
+    simLevelChanged();
+    simPublish(0.0f);
+    simThread = std::thread(simThreadMain);
+}
+
+void stopSimThread() {
+    simQuit.store(true, std::memory_order_release);
+    if (simThread.joinable()) simThread.join();
+}
+
+// rolling window of latency samples (render thread only)
+struct LatencyStats {
+    static const int CAP = 4096;
+    float ms[CAP];
+    long long n = 0;
+    void add(float v) { ms[n++ % CAP] = v; }
+    void report(const char* name) const {
+        int k = (int)(std::min)(n, (long long)CAP);
+        if (!k) { printf("  %-16s no samples\n", name); return; }
+        float v[CAP];
+        std::copy(ms, ms + k, v);
+        std::sort(v, v + k);
+        printf("  %-16s p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f ms (%d samples)\n", name,
+            v[k / 2], v[k * 9 / 10], v[k * 99 / 100], v[k - 1], k);
+    }
+};
+
+LatencyStats latInputSim, latInputPhoton, latSimPhoton, latTick;
+unsigned long long renderFrames = 0, staleFrames = 0;
+bool snapshotFresh = false;
+long long shownInputUs = 0;
+
+void printThreadStats() {
+    printf("Sim %d Hz: %llu snapshots, %llu overwritten before display, %llu tick overruns\n", SIM_HZ,
+        simSnapshots.published.load(), simSnapshots.skipped.load(), simOverruns.load());
+    printf("Render: %llu frames, %llu reused the previous snapshot; queue drops: input %u, fx %u\n",
+        renderFrames, staleFrames, simCommands.drops.load(), simFx.drops.load());
+    const EventBus& bus = simSnapshots.readBuffer().state.bus;
+    printf("Events: %llu emitted, %llu dropped\n", bus.emitted, bus.dropped);
+    printf("View: %zu of %zu level entities published in the last snapshot\n", simSnapshots.readBuffer().visible,
+        simSnapshots.readBuffer().levelSize);
+    if (renderer == RENDER_INSTANCED)
+        printf("Renderer: instanced, %zu instances in %d draw calls last frame\n", instancedRenderer.instances, instancedRenderer.drawCalls);
+    else printf("Renderer: legacy\n");
+    printf("Startup:\n");
+    startup.print();
+    printf("Round start: %.2f ms from 'R' to the first gameplay tick (%.2f ms worst of %u)\n",
+        roundStartMs.load(), roundStartMaxMs.load(), roundStarts.load());
+    if (!audioReady()) printf("Audio: still starting\n");
+    else if (music.ok)
+        printf("Music: streaming %s to %s, %zu KB ring, %.2f ms to the first sample, %llu underrun frames, mixer %.2f us/period\n",
+            musicPath, audioOut.device, music.ring.size() * sizeof(int16_t) / 1024, music.startupMs.load(),
+            (unsigned long long)music.underruns.load(), audioOut.periods ? audioOut.mixUs.load() / audioOut.periods : 0.0);
+    else printf("Music: %s not found (%s)\n", musicPath, audioOut.device);
+    if (!audioReady()) {}
+    else if (assets.base) printf("Assets: %s mapped, %u entries, %u decompressed in %.2f ms\n", assetArchivePath, assets.count,
+        assets.decodes, assets.decodeMs);
+    else printf("Assets: loose files\n");
+    if (audioReady()) printf("Sound: %llu played, %llu coalesced, %llu over their cap, %llu stole a voice, %llu dropped; %d of %d voices (peak %d)\n",
+        sfx.played.load(), sfx.coalesced.load(), sfx.capped.load(), sfx.stolen.load(), sfx.dropped.load(),
+        sfx.active.load(), audioVoices, sfx.peak.load());
+    printf("  %u blend state changes for %u blended draws last frame (%u toggling blending around each)\n",
+        glState.lastChanges, glState.lastBlended, glState.lastBlended * 3);
+    for (int s = 0; s < SUB_COUNT; s++)
+        printf("  %-10s %8llu events in %7llu batches, %.2f us/batch\n", eventSubscribers[s].name,
+            bus.subEvents[s], bus.subBatches[s], bus.subBatches[s] ? bus.subMs[s] * 1000.0 / bus.subBatches[s] : 0.0);
+    const RenderSnapshot& snap = simSnapshots.readBuffer();
+    printf("Rewind: %.1f s of history, %zu KB of %zu KB; %zu KB in quick-save slots\n", snap.historySec,
+        snap.rewindBytes / 1024, sizeof(Rewind) / 1024, snap.quickBytes / 1024);
+    printf("  capture %.2f us avg, %.2f us max; seek %.2f us avg, %.2f us max\n",
+        snap.captureUs, snap.captureMaxUs, snap.seekUs, snap.seekMaxUs);
+    latTick.report("sim tick");
+    latInputSim.report("input->sim");
+    latSimPhoton.report("sim->photon");
+    latInputPhoton.report("input->photon");
+}
+
+// planning cost, in the top panel next to the score
+void drawPilotStatus(const RenderSnapshot& s) {
+    if (!(s.autopilot || s.showHint)) return;
+    char buf[64];
+    sprintf(buf, "%s %.2f ms", s.autopilot ? "AUTO" : "HINT", s.planMs);
+    glColor3f(0.4f, 1.0f, 0.6f);
+    print_on_screen(470, WIN_H - 60, buf);
+}
+
+// rewind banner over the play area while paused on an older frame
+void drawRewindStatus(const RenderSnapshot& s) {
+    if (!s.scrubbing) return;
+    char buf[96];
+    sprintf(buf, "REWIND -%.2f s of %.1f   Z/X scrub, any key plays on", s.rewindSec, s.historySec);
+    glColor3f(1.0f, 0.8f, 0.3f);
+    print_on_screen(20, GAME_Y1 - 30, buf);
+}
+
+GLuint minimapTex = 0;
+uint32_t minimapUploaded = ~0u;
+
+// radar left of the hearts: one textured quad, re-uploaded only when a cell changed
+void drawMinimap(const RenderSnapshot& s) {
+    const GameState& g = s.state;
+    const float bx = 612.0f, by = GAME_Y1 + 10.0f, bw = 148.0f, bh = TOP_H - 20.0f;
+    float sc = (std::min)(bw / g.worldW, bh / g.worldH); // keep the world's aspect
+    float w = g.worldW * sc, h = g.worldH * sc, x0 = bx + (bw - w) * 0.5f, y0 = by + (bh - h) * 0.5f;
+
+    if (!minimapTex) {
+        glGenTextures(1, &minimapTex);
+        glBindTexture(GL_TEXTURE_2D, minimapTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, MINIMAP_W, MINIMAP_H, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    glBindTexture(GL_TEXTURE_2D, minimapTex);
+    if (s.minimapVersion != minimapUploaded) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, MINIMAP_W, MINIMAP_H, GL_RGBA, GL_UNSIGNED_BYTE, s.minimap);
+        minimapUploaded = s.minimapVersion;
+    }
+    glEnable(GL_TEXTURE_2D);
     glColor3f(1, 1, 1);
-    glBegin(GL_LINES);
-    glVertex2f(playerPos.x, playerPos.y);
-    glVertex2f(playerPos.x + playerDir.x * (playerRadius + 20), playerPos.y + playerDir.y * (playerRadius + 20));
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(x0, y0);
+    glTexCoord2f(1, 0); glVertex2f(x0 + w, y0);
+    glTexCoord2f(1, 1); glVertex2f(x0 + w, y0 + h);
+    glTexCoord2f(0, 1); glVertex2f(x0, y0 + h);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+
+    // frame, camera, target and player on top
+    ViewRect v = cameraView(g);
+    glColor3f(0.5f, 0.5f, 0.6f);
+    glBegin(GL_LINE_LOOP);
+    glVertex2f(x0, y0); glVertex2f(x0 + w, y0); glVertex2f(x0 + w, y0 + h); glVertex2f(x0, y0 + h);
     glEnd();
-    // Add glowing center point for fourth primitive
-    glPointSize(6);
     glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_LINE_LOOP);
+    glVertex2f(x0 + v.x0 * sc, y0 + (v.y0 - GAME_Y0) * sc); glVertex2f(x0 + v.x1 * sc, y0 + (v.y0 - GAME_Y0) * sc);
+    glVertex2f(x0 + v.x1 * sc, y0 + (v.y1 - GAME_Y0) * sc); glVertex2f(x0 + v.x0 * sc, y0 + (v.y1 - GAME_Y0) * sc);
+    glEnd();
+    glPointSize(4);
     glBegin(GL_POINTS);
-    glVertex2f(playerPos.x, playerPos.y);
+    glColor3f(0.9f, 0.4f, 1.0f);
+    glVertex2f(x0 + g.targetPos.x * sc, y0 + (g.targetPos.y - GAME_Y0) * sc);
+    glColor3f(0.3f, 0.8f, 1.0f);
+    glVertex2f(x0 + g.playerPos.x * sc, y0 + (g.playerPos.y - GAME_Y0) * sc);
     glEnd();
+    glPointSize(1);
 }
 
-void drawTarget() {
-    // outer ring (glow)
-    glColor4f(0.8f, 0.25f, 0.9f, 0.18f);
-    glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    drawCircle(targetPos, 24, 36);
-    glDisable(GL_BLEND);
+// planned route and intercept point, in world coordinates
+void drawPilotHint(const RenderSnapshot& s) {
+    if (!(s.autopilot || s.showHint) || !s.hasGoal) return;
 
-    glColor3f(0.7f, 0.18f, 0.9f);
-    drawCircle(targetPos, 14, 32);
-    glColor3f(1.0f, 0.6f, 1.0f);
-    drawCircle(targetPos, 7, 24);
+    glPointSize(3);
+    glColor3f(0.4f, 1.0f, 0.6f);
+    glBegin(GL_POINTS);
+    for (int k = 0; k < s.routeLen; k++) glVertex2f(s.route[k].x, s.route[k].y);
+    glEnd();
+    // intercept point on the target path
+    glColor3f(0.4f, 1.0f, 0.6f);
+    glBegin(GL_LINE_LOOP);
+    for (int i = 0; i < 16; i++) {
+        float a = i / 16.0f * 2.0f * 3.14159265f;
+        glVertex2f(s.goal.x + cosf(a) * 10.0f, s.goal.y + sinf(a) * 10.0f);
+    }
+    glEnd();
 }
 
-void drawObstacles() {
-    for (auto& o : obstacles) {
-        glColor3f(0.6f, 0.28f, 0.12f);
-        glBegin(GL_QUADS);
-        glVertex2f(o.p.x - o.r, o.p.y - o.r);
-        glVertex2f(o.p.x + o.r, o.p.y - o.r);
-        glVertex2f(o.p.x + o.r, o.p.y + o.r);
-        glVertex2f(o.p.x - o.r, o.p.y + o.r);
-        glEnd();
-        glColor3f(0, 0, 0);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(o.p.x - o.r, o.p.y - o.r);
-        glVertex2f(o.p.x + o.r, o.p.y - o.r);
-        glVertex2f(o.p.x + o.r, o.p.y + o.r);
-        glVertex2f(o.p.x - o.r, o.p.y + o.r);
-        glEnd();
+// -------------------------------
+// Rendering + game loop
+// -------------------------------
+void display();
+unsigned long long allocSeen = 0;
+int allocReportMs = 0;
+
+void idle() {
+    int nowMs = glutGet(GLUT_ELAPSED_TIME);
+    float dt = (prevTimeMs == 0) ? 0.016f : (nowMs - prevTimeMs) / 1000.0f;
+    prevTimeMs = nowMs;
+
+    // newest sim state; the sim keeps ticking whatever the frame rate
+    if (simSnapshots.acquire()) snapshotFresh = true;
+    const GameState& view = simSnapshots.readBuffer().state;
+
+    FxBurst b;
+    while (simFx.pop(b)) emitBurst(particles, b.blend, b.at, b.n, b.speed, b.life, b.rgb);
+    emitAmbientParticles(particles, view, dt);
+    updateParticles(particles, dt);
+
+    // a running round should not allocate; say so once a second if it does
+    if (nowMs - allocReportMs >= 1000) {
+        unsigned long long n = heapAllocs.load();
+        if (view.running && n != allocSeen) printf("Heap allocations in the last second: %llu\n", n - allocSeen);
+        allocSeen = n;
+        allocReportMs = nowMs;
     }
+
+    glutPostRedisplay();
 }
 
-void drawCollectibles(float dt) {
-    for (auto& c : collectibles) {
-        if (!c.active) continue;
-        // glow
-        glColor4f(1.0f, 0.86f, 0.2f, 0.12f);
-        glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-        drawCircle({ c.p.x, c.p.y }, c.r + 6, 24);
-        glDisable(GL_BLEND);
+void display() {
+    const RenderSnapshot& snap = simSnapshots.readBuffer();
+    const GameState& view = snap.state;
+    float animSec = glutGet(GLUT_ELAPSED_TIME) * 0.001f;
+    glClear(GL_COLOR_BUFFER_BIT);
 
-        glPushMatrix();
-        glTranslatef(c.p.x, c.p.y, 0);
-        glRotatef(c.rot, 0, 0, 1);
-        glColor3f(1.0f, 0.92f, 0.2f);
-        glBegin(GL_TRIANGLES);
-        glVertex2f(0, c.r); glVertex2f(-c.r * 0.6f, -c.r * 0.6f); glVertex2f(c.r * 0.6f, -c.r * 0.6f);
-        glEnd();
+    // background game area
+    glColor3f(0.02f, 0.02f, 0.05f);
+    glBegin(GL_QUADS);
+    glVertex2f(0, GAME_Y0); glVertex2f(WIN_W, GAME_Y0);
+    glVertex2f(WIN_W, GAME_Y1); glVertex2f(0, GAME_Y1);
+    glEnd();
+    // animated stars
+    drawBackgroundStars();
 
-        // Outline using a line loop (3rd primitive)
-        glColor3f(0.3f, 0.3f, 0.3f);
-        glBegin(GL_LINE_LOOP);
-        glVertex2f(0, c.r);
-        glVertex2f(-c.r * 0.6f, -c.r * 0.6f);
-        glVertex2f(c.r * 0.6f, -c.r * 0.6f);
-        glEnd();
-        glPopMatrix();
+    // the world, through the camera; the snapshot only holds what it can see
+    ViewRect cam = cameraView(view);
+    beginWorldView(cam);
+    queueActorGlows(blendQueue, view);
+    if (renderer == RENDER_LEGACY) queueCollectibleGlows(blendQueue, view);
+    blendQueue.flush(glState, PASS_GLOW);
+    drawEntities(view, cam, animSec);
+    drawParticles(particles);
+
+    // target & player
+    drawTarget(view);
+    drawPlayer(view);
+    drawPilotHint(snap);
+    endWorldView();
+
+    // panels, over anything that spilled past the game area
+    drawTopPanel(view);
+    drawMinimap(snap);
+    drawBottomPanel();
+    drawPilotStatus(snap);
+    drawRewindStatus(snap);
+
+    // overlay end screen
+    if (view.showEnd) {
+        // dim background
+        blendQueue.quad(PASS_OVERLAY, BLEND_MODE_ALPHA, 0, 0, WIN_W, WIN_H, 0, 0, 0, 0.6f);
+        blendQueue.flush(glState, PASS_OVERLAY);
+        // bright text
+        char buf[128];
+        if (view.playerWon) {
+            glColor3f(1.0f, 0.9f, 0.2f);
+            sprintf(buf, "GAME WIN! Final Score: %d", view.playerScore);
+            print_on_screen(WIN_W / 2 - 160, WIN_H / 2 + 20, buf);
+        }
+        else {
+            glColor3f(1.0f, 0.6f, 0.6f);
+            sprintf(buf, "GAME OVER. Final Score: %d", view.playerScore);
+            print_on_screen(WIN_W / 2 - 160, WIN_H / 2 + 20, buf);
+        }
+        glColor3f(1.0f, 1.0f, 1.0f);
+        print_on_screen(WIN_W / 2 - 120, WIN_H / 2 - 20, "Press C to clear & R to restart");
+    }
+
+    glutSwapBuffers();
+    glState.endFrame();
 
-        c.rot += 90.0f * dt;
-        if (c.rot > 360.0f) c.rot -= 360.0f;
+    // latency: "photon" is taken as the return of the buffer swap
+    long long swapUs = nowUs();
+    if (renderFrames == 0) {
+        startup.mark("first frame");
+        printf("First frame %.1f ms after start (T lists the startup phases)\n", (swapUs - processStartUs) * 0.001f);
     }
+    renderFrames++;
+    if (!snapshotFresh) staleFrames++;
+    else {
+        latSimPhoton.add((swapUs - snap.publishUs) * 0.001f);
+        latTick.add(snap.tickMs);
+        if (snap.inputUs != shownInputUs) {
+            shownInputUs = snap.inputUs;
+            latInputSim.add((snap.inputSimUs - snap.inputUs) * 0.001f);
+            latInputPhoton.add((swapUs - snap.inputUs) * 0.001f);
+        }
+    }
+    snapshotFresh = false;
+}
+
+// -------------------------------
+// Input handling (forwarded to the sim thread)
+// -------------------------------
+void specialDown(int key, int, int) {
+    simCommands.push({ SimCommand::SPECIAL_DOWN, key, { 0.0f, 0.0f }, nowUs() });
+}
+void specialUp(int key, int, int) {
+    simCommands.push({ SimCommand::SPECIAL_UP, key, { 0.0f, 0.0f }, nowUs() });
+}
+
+void keyboard(unsigned char key, int, int) {
+    // thread / latency report stays on the render thread
+    if (key == 't' || key == 'T') { printThreadStats(); return; }
+    if (key == 'c' || key == 'C') currentMode = NONE_MODE;
+    simCommands.push({ SimCommand::KEY, key, { 0.0f, 0.0f }, nowUs() });
 }
 
-void drawPowerUps(float dt) {
-    for (auto& p : powerups) {
-        if (!p.active) continue;
-        p.phase += dt * 3.0f;
-        float bob = sinf(p.phase) * 6.0f;
+// window to world through the camera of the snapshot on screen; the sim clamps to the world
+static inline Vec2 windowToWorld(int x, int oglY) {
+    ViewRect cam = cameraView(simSnapshots.readBuffer().state);
+    return { cam.x0 + x, cam.y0 + (oglY - GAME_Y0) };
+}
+
+// a left drag from a placed object paints more of it (render thread)
+bool painting = false;
+Vec2 paintFrom = { 0.0f, 0.0f };
 
-        if (p.type == 1) {
-            // blue speed
-            glColor3f(0.18f, 0.55f, 1.0f);
-            drawCircle({ p.p.x, p.p.y + bob }, p.r);
-            // small white lines
-            glColor3f(1, 1, 1);
-            glBegin(GL_LINES);
-            glVertex2f(p.p.x - 6, p.p.y + bob - 2); glVertex2f(p.p.x + 6, p.p.y + bob + 2);
-            glVertex2f(p.p.x - 6, p.p.y + bob + 2); glVertex2f(p.p.x + 6, p.p.y + bob - 2);
-            glEnd();
+void mouseClick(int button, int state, int x, int y) {
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_UP && painting) {
+        painting = false;
+        simCommands.push({ SimCommand::PAINT_END, 0, { 0.0f, 0.0f }, nowUs() });
+    }
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+        int oglY = WIN_H - y;
+        if (oglY <= BOTTOM_H) {
+            for (int m = OBSTACLE_MODE; m < PLACE_MODE_END; m++)
+                if (fabsf(x - (panelIconX0 + (m - OBSTACLE_MODE) * panelIconGap)) < 30.0f) currentMode = (PlaceMode)m;
+            return;
         }
-        else {
-            // green double score
-            glColor3f(0.12f, 0.95f, 0.28f);
-            glBegin(GL_POLYGON);
-            glVertex2f(p.p.x, p.p.y + bob + p.r);
-            glVertex2f(p.p.x + p.r * 0.7f, p.p.y + bob + p.r * 0.2f);
-            glVertex2f(p.p.x + p.r * 0.4f, p.p.y + bob - p.r * 0.8f);
-            glVertex2f(p.p.x - p.r * 0.4f, p.p.y + bob - p.r * 0.8f);
-            glVertex2f(p.p.x - p.r * 0.7f, p.p.y + bob + p.r * 0.2f);
-            glEnd();
-            glColor3f(0, 0, 0);
-            glBegin(GL_LINE_LOOP);
-            glVertex2f(p.p.x, p.p.y + bob + p.r);
-            glVertex2f(p.p.x + p.r * 0.7f, p.p.y + bob + p.r * 0.2f);
-            glVertex2f(p.p.x + p.r * 0.4f, p.p.y + bob - p.r * 0.8f);
-            glVertex2f(p.p.x - p.r * 0.4f, p.p.y + bob - p.r * 0.8f);
-            glVertex2f(p.p.x - p.r * 0.7f, p.p.y + bob + p.r * 0.2f);
-            glEnd();
+        // placement in game area
+        if (oglY > GAME_Y0 && oglY < GAME_Y1 && currentMode != NONE_MODE) {
+            Vec2 p = windowToWorld(x, oglY);
+            simCommands.push({ SimCommand::PLACE, (int)currentMode, p, nowUs() });
+            painting = true;
+            paintFrom = p;
         }
     }
 }
 
+// one PAINT per motion event: the segment since the last one
+void mouseDrag(int x, int y) {
+    if (!painting || currentMode == NONE_MODE) return;
+    int oglY = (std::max)(GAME_Y0 + 1, (std::min)(GAME_Y1 - 1, WIN_H - y));
+    Vec2 p = windowToWorld(x, oglY);
+    simCommands.push({ SimCommand::PAINT, (int)currentMode, paintFrom, nowUs(), p });
+    paintFrom = p;
+}
+
 // -------------------------------
-// Game logic: collisions, timers
+// Batch evaluator (--batch): thousands of headless rounds on all cores
 // -------------------------------
+struct GameResult { bool won; float timeSec; int score; int lives; float planMsSum, planMsMax; int planTicks; };
 
-    // -----------------------------------------------
-    // Bezier vertical motion: loops endlessly and speeds up with time
-    // -----------------------------------------------
-    void computeBezierTarget(float dt) {
-        static bool reverse = false;
+// flowTemplate: fields prebuilt for the level, copied per game (null = steering bot).
+// g / nav are the worker's scratch: copying into them reuses their memory.
+GameResult runHeadlessGame(const GameState& level, const BotPolicy& pol, uint32_t seed, const FlowPilot* flowTemplate,
+    GameState& g, FlowPilot& nav) {
+    g = level;
+    g.audio = g.effects = false;
+    resetRound(g);
+    BotState bot;
+    bot.rng = seed ? seed : 0x9E3779B9u;
+    if (flowTemplate) nav = *flowTemplate;
 
-        // make target speed up as time decreases (min 0.08f, max 0.35f)
-        float timeRatio = (float)remainingTime / (float)totalTime;  // 1.0 → 0.0
-        float dynamicSpeed = 0.12f + (1.0f - timeRatio) * 0.33f; // faster as time runs out
+    const float dt = 1.0f / 60.0f;
+    int ticks = 0;
+    const int maxTicks = (totalTime + 2) * 60;
+    while (g.running && ticks < maxTicks) {
+        if (flowTemplate) flowPilotDrive(nav, g, pol, bot, dt);
+        else botDecide(g, pol, bot, dt);
+        stepGame(g, dt);
+        ticks++;
+    }
+    return { g.playerWon, ticks * dt, g.playerScore, g.playerLives,
+        (float)nav.sumPlanMs, nav.maxPlanMs, nav.planTicks };
+}
 
-        // ping-pong movement
-        if (!reverse) bezT += dynamicSpeed * dt;
-        else bezT -= dynamicSpeed * dt;
+static float percentile(std::vector<float>& v, float p) {
+    if (v.empty()) return 0.0f;
+    size_t k = (size_t)(p * (v.size() - 1) + 0.5f);
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
 
-        // reverse direction at ends
-        if (bezT >= 1.0f) { bezT = 1.0f; reverse = true; }
-        if (bezT <= 0.0f) { bezT = 0.0f; reverse = false; }
+int runBatch(int argc, char** argv) {
+    const char* levelPath = NULL;
+    int games = 10000, threads = (int)std::thread::hardware_concurrency();
+    uint32_t seed = 12345;
+    BotPolicy pol;
+    bool flow = false;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--batch") && more) levelPath = argv[++i];
+        else if (!strcmp(argv[i], "--games") && more) games = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && more) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && more) seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--aim-noise") && more) pol.aimNoise = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--greed") && more) pol.greed = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--avoid") && more) pol.avoidRadius = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--reaction") && more) pol.reactionSec = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--bot") && more) flow = !strcmp(argv[++i], "flow");
+    }
+    if (threads < 1) threads = 1;
+    if (games < 1) games = 1;
 
-        // compute point along Bezier curve
-        float out[2];
-        bezier_point_float(bezT, bz_p0, bz_p1, bz_p2, bz_p3, out);
-        targetPos.x = out[0];
-        targetPos.y = out[1];
+    GameState level;
+    if (!levelPath || !loadLevel(level, levelPath)) {
+        printf("Cannot read level '%s'\n", levelPath ? levelPath : "");
+        return 1;
     }
+    printf("Level %s: %d obstacles, %d collectibles, %d powerups\n", levelPath,
+        (int)level.obstacles.size(), (int)level.collectibles.size(), (int)level.powerups.size());
 
+    // the flow pilot's fields only depend on the level, so build them once and copy per game
+    FlowPilot flowTemplate;
+    if (flow) {
+        GameState start = level;
+        resetRound(start);
+        auto b0 = std::chrono::steady_clock::now();
+        navFullBuild(flowTemplate, start);
+        printf("Flow fields: %dx%d cells x %d samples built in %.2f ms%s\n", flowTemplate.cols, flowTemplate.rows, NAV_SAMPLES,
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - b0).count(),
+            flowTemplate.usable ? "" : " (world too large, the pilot flies straight)");
+    }
 
+    std::vector<GameResult> results(games);
+    std::vector<GameState> scratch(threads);
+    std::vector<FlowPilot> navScratch(threads);
+    WorkStealingPool pool(threads);
+    auto t0 = std::chrono::steady_clock::now();
+    pool.run(games, 16, [&](int i, int worker) {
+        // each game owns its seed, so results do not depend on scheduling
+        results[i] = runHeadlessGame(level, pol, seed ^ (uint32_t)(i * 2654435761u), flow ? &flowTemplate : NULL,
+            scratch[worker], navScratch[worker]);
+    });
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
 
-void handleCollisions(float dt) {
-    // obstacles: if player collides and not invulnerable -> lose life and push back
-    if (invulnTimer > 0.0f) invulnTimer -= dt;
-    for (auto& ob : obstacles) {
-        float d = dist(playerPos, ob.p);
-        if (d <= playerRadius + ob.r) {
-            if (invulnTimer <= 0.0f) {
-                playerLives = (std::max)(0, playerLives - 1);
-                invulnTimer = 0.7f; // small invulnerability
-                playSoundEffect("hit.wav");
-            }
-            // push back
-            Vec2 push = { playerPos.x - ob.p.x, playerPos.y - ob.p.y };
-            float mag = sqrtf(push.x * push.x + push.y * push.y);
-            if (mag > 0.001f) {
-                push.x /= mag; push.y /= mag;
-                playerPos.x += push.x * 6.0f;
-                playerPos.y += push.y * 6.0f;
-                playerPos = clampToArea(playerPos);
-            }
-        }
+    // reduce
+    int wins = 0;
+    std::vector<float> winTimes, scores;
+    double scoreSum = 0.0, scoreSq = 0.0;
+    for (auto& r : results) {
+        if (r.won) { wins++; winTimes.push_back(r.timeSec); }
+        scores.push_back((float)r.score);
+        scoreSum += r.score; scoreSq += (double)r.score * r.score;
+    }
+    double mean = scoreSum / games;
+    double sd = sqrt((std::max)(0.0, scoreSq / games - mean * mean));
+
+    printf("Games: %d on %d threads in %.3f s (%.0f games/s, %d steals)\n",
+        games, threads, secs, games / (secs > 0 ? secs : 1e-9), pool.steals.load());
+    printf("Win rate: %.1f%%\n", 100.0 * wins / games);
+    if (!winTimes.empty())
+        printf("Time to target (s): p10 %.1f  p50 %.1f  p90 %.1f\n",
+            percentile(winTimes, 0.1f), percentile(winTimes, 0.5f), percentile(winTimes, 0.9f));
+    printf("Score: mean %.1f  sd %.1f  p10 %.0f  p50 %.0f  p90 %.0f\n", mean, sd,
+        percentile(scores, 0.1f), percentile(scores, 0.5f), percentile(scores, 0.9f));
+    if (flow) {
+        double planSum = 0.0; long long planTicks = 0; float planMax = 0.0f;
+        for (auto& r : results) { planSum += r.planMsSum; planTicks += r.planTicks; planMax = (std::max)(planMax, r.planMsMax); }
+        printf("Plan time per tick: mean %.4f ms  max %.3f ms\n", planSum / (planTicks ? planTicks : 1), planMax);
+    }
+
+    // coarse score histogram
+    float maxScore = *std::max_element(scores.begin(), scores.end());
+    const int bins = 10;
+    int hist[bins] = { 0 };
+    for (float s : scores) hist[(std::min)(bins - 1, (int)(s / (maxScore + 1.0f) * bins))]++;
+    for (int b = 0; b < bins; b++) {
+        int bar = (int)(50.0f * hist[b] / games + 0.5f);
+        printf("  %5.0f+ |%.*s %d\n", b * (maxScore + 1.0f) / bins, bar,
+            "##################################################", hist[b]);
+    }
+    return 0;
+}
+
+// a filled area holds roughly one site per GEN_SITE_AREA px^2; leave some slack
+void sizeLevelFor(LevelGenParams& prm, int count) {
+    const float GEN_SITE_AREA = 1800.0f;
+    float area = count / prm.density * GEN_SITE_AREA * 1.1f;
+    float side = sqrtf(area);
+    prm.width = (std::max)((float)WIN_W, side);
+    prm.height = (std::max)((float)(GAME_Y1 - GAME_Y0), area / prm.width);
+    prm.maxEntities = count;
+}
+
+// --gen-level <out>: write a procedural level, sized to fit --count if given
+int runGenerate(int argc, char** argv) {
+    const char* outPath = NULL;
+    LevelGenParams prm;
+    int count = 0;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--gen-level") && more && argv[i + 1][0] != '-') outPath = argv[++i];
+        else if (!strcmp(argv[i], "--count") && more) count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && more) prm.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--density") && more) prm.density = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--mix") && more) sscanf(argv[++i], "%f,%f", &prm.obstacleShare, &prm.collectShare);
+        else if (!strcmp(argv[i], "--threads") && more) prm.threads = atoi(argv[++i]);
+    }
+    if (prm.density <= 0.0f || prm.density > 1.0f) prm.density = 1.0f;
+    if (count > 0) sizeLevelFor(prm, count);
+    prm.index = false; // the file does not need them; built below only to report their cost
+
+    GameState g;
+    auto t0 = std::chrono::steady_clock::now();
+    int n = generateLevel(g, prm);
+    auto t1 = std::chrono::steady_clock::now();
+    indexLevel(g);
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    double indexSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+    printf("Generated %d entities (%d obstacles, %d collectibles, %d powerups) in %.0fx%.0f px\n", n,
+        (int)g.obstacles.size(), (int)g.collectibles.size(), (int)g.powerups.size(), prm.width, prm.height);
+    printf("Generation: %.3f s (%.2f M entities/s)\n", secs, n / (secs > 0 ? secs : 1e-9) * 1e-6);
+    printf("Spatial indexes: %.3f s (not needed to write the file)\n", indexSecs);
+    if (outPath && !saveLevel(g, outPath)) { printf("Cannot write '%s'\n", outPath); return 1; }
+    return 0;
+}
+
+// --alloc-check [level]: fly the pilot through many rounds and fail if the
+// steady state (ticks, R restarts, per-game copies) touches the heap
+int runAllocCheck(int argc, char** argv) {
+    const char* levelPath = NULL;
+    int rounds = 50;
+    LevelGenParams prm;
+    prm.density = 0.35f;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--alloc-check") && more && argv[i + 1][0] != '-') levelPath = argv[++i];
+        else if (!strcmp(argv[i], "--rounds") && more) rounds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && more) prm.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
     }
 
-    // collectibles
-    for (auto& c : collectibles) {
-        if (!c.active) continue;
-        float d = dist(playerPos, c.p);
-        if (d <= playerRadius + c.r) {
-            int add = 5;
-            if (doubleActive) add *= 2;
-            playerScore += add;
-            c.active = false;
-            playSoundEffect("collect.wav");
-            // small pop visual: we simply scale it briefly by setting rot negative? We'll skip audio.
-        }
+    GameState level;
+    if (levelPath) {
+        if (!loadLevel(level, levelPath)) { printf("Cannot read level '%s'\n", levelPath); return 1; }
     }
+    else generateLevel(level, prm);
+    printf("Level: %d obstacles, %d collectibles, %d powerups\n",
+        (int)level.obstacles.size(), (int)level.collectibles.size(), (int)level.powerups.size());
 
-    // powerups
-    for (auto& p : powerups) {
-        if (!p.active) continue;
-        float d = dist(playerPos, p.p);
-        if (d <= playerRadius + p.r) {
-            p.active = false;
-            if (p.type == 1) { speedActive = true; speedTimer = 6.0f; }
-            else { doubleActive = true; doubleTimer = 8.0f; }
+    GameState g;
+    FlowPilot nav;
+    BotPolicy pol = { 0.0f, 0.0f, 0.0f, 0.0f };
+    BotState bot;
+    const float dt = 1.0f / 60.0f;
+    const int maxTicks = (totalTime + 2) * 60;
+    long long ticks = 0;
+    auto playRound = [&](bool copyLevel) {
+        if (copyLevel) g = level; // batch path: reuse the scratch state
+        g.audio = g.effects = false;
+        resetRound(g);            // R path: O(1), pickups revive by round stamp
+        navSync(nav, g);
+        for (int t = 0; g.running && t < maxTicks; t++, ticks++) {
+            flowPilotDrive(nav, g, pol, bot, dt);
+            stepGame(g, dt);
         }
-    }
+    };
+
+    // warm-up sizes every arena and scratch buffer once
+    playRound(true);
+    playRound(false);
+    unsigned long long before = heapAllocs.load();
+    ticks = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++) playRound(r % 2 == 0);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    unsigned long long allocs = heapAllocs.load() - before;
+
+    printf("Steady state: %d rounds, %lld ticks in %.3f s\n", rounds, ticks, secs);
+    printf("Heap allocations: %llu (%.4f per tick)\n", allocs, (double)allocs / (ticks ? ticks : 1));
+    return allocs ? 1 : 0;
+}
 
-    // update powerup timers
-    if (speedActive) {
-        speedTimer -= dt;
-        if (speedTimer <= 0.0f) speedActive = false;
+// --particle-bench: keep --count particles alive for --frames ticks and
+// time integration + expiry and the CPU side of the batched draw
+int runParticleBench(int argc, char** argv) {
+    int count = 100000, frames = 600;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--count") && more) count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && more) frames = atoi(argv[++i]);
     }
-    if (doubleActive) {
-        doubleTimer -= dt;
-        if (doubleTimer <= 0.0f) doubleActive = false;
+    if (count < 1) count = 1;
+    if (frames < 1) frames = 1;
+
+    for (int pass = 0; pass < 2; pass++) {
+#ifndef PARTICLES_SSE
+        if (pass == 0) continue;
+#endif
+        particlesSimd = pass == 0;
+        ParticleSystem ps;
+        particlesReserve(ps, count);
+        const float dt = 1.0f / 60.0f;
+        // split the load like the game does: mostly additive sparks, some debris
+        int perPool[BLEND_COUNT] = { count - count / 4, count / 4 };
+        auto refill = [&]() {
+            for (int b = 0; b < BLEND_COUNT; b++)
+                while ((int)ps.pools[b].count < perPool[b]) {
+                    Vec2 at = { rand01(ps.rng) * WIN_W, GAME_Y0 + rand01(ps.rng) * (GAME_Y1 - GAME_Y0) };
+                    emitBurst(ps, b, at, (std::min)(32, perPool[b] - (int)ps.pools[b].count), 200.0f, 1.2f, 0xFFD24Au);
+                }
+        };
+        refill();
+        unsigned long long allocs0 = heapAllocs.load();
+        double updMs = 0.0, fillMs = 0.0, worstMs = 0.0;
+        long long born = 0;
+        for (int f = 0; f < frames; f++) {
+            size_t before = ps.pools[0].count + ps.pools[1].count;
+            auto t0 = std::chrono::steady_clock::now();
+            updateParticles(ps, dt);
+            size_t after = ps.pools[0].count + ps.pools[1].count;
+            refill();
+            born += (long long)(before - after);
+            auto t1 = std::chrono::steady_clock::now();
+            for (auto& p : ps.pools) particlesFill(p);
+            auto t2 = std::chrono::steady_clock::now();
+            double u = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            double d = std::chrono::duration<double, std::milli>(t2 - t1).count();
+            updMs += u; fillMs += d;
+            worstMs = (std::max)(worstMs, u + d);
+        }
+        printf("%s: %d live particles, %d frames, %lld respawned\n", particlesSimd ? "SSE" : "Scalar",
+            count, frames, born);
+        printf("  update+expire+respawn %.3f ms  draw fill %.3f ms  total %.3f ms/frame (worst %.3f, budget 16.7)\n",
+            updMs / frames, fillMs / frames, (updMs + fillMs) / frames, worstMs);
+        printf("  heap allocations during run: %llu\n", heapAllocs.load() - allocs0);
     }
+    particlesSimd = true;
+    return 0;
 }
 
-// -------------------------------
-// Movement & update loop
-// -------------------------------
-void updateMovement(float dt) {
-    Vec2 mv = { 0,0 };
-    if (keyLeft) mv.x -= 1.0f;
-    if (keyRight) mv.x += 1.0f;
-    if (keyUp) mv.y += 1.0f;
-    if (keyDown) mv.y -= 1.0f;
-
-    float mag = sqrtf(mv.x * mv.x + mv.y * mv.y);
-    if (mag > 0.0f) {
-        mv.x /= mag; mv.y /= mag;
-        playerDir = mv;
-        // if currently colliding with obstacle and invuln active, we still allow movement but pushback handled in collision
-        float spd = baseSpeed * (speedActive ? 1.8f : 1.0f);
-        playerPos.x += mv.x * spd * dt;
-        playerPos.y += mv.y * spd * dt;
-        playerPos = clampToArea(playerPos);
+// --input-latency: drive the real sim thread with short synthetic taps and
+// report how well their durations survive and how long they take to land
+int runInputLatency(int argc, char** argv) {
+    int taps = 200;
+    float tapMs = 3.0f;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--taps") && more) taps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tap-ms") && more) tapMs = (float)atof(argv[++i]);
     }
-}
+    if (taps < 1) taps = 1;
 
-bool checkEndCondition() {
-    if (playerLives <= 0) { playerWon = false; return true; }
-    if (remainingTime <= 0) { playerWon = false; return true; }
-    if (dist(playerPos, targetPos) <= playerRadius + 14.0f) { playerWon = true; return true; }
-    return false;
-}
+    resetRound(game);
+    game.audio = game.effects = false;
+    game.timers.reschedule(game.effectTimers[TIMER_ROUND], 3600 * 1000); // no timeout during the run
+    startSimThread();
 
-// -------------------------------
-// Rendering + game loop
-// -------------------------------
-void display();
-void idle() {
-    int nowMs = glutGet(GLUT_ELAPSED_TIME);
-    float dt = (prevTimeMs == 0) ? 0.016f : (nowMs - prevTimeMs) / 1000.0f;
-    prevTimeMs = nowMs;
+    // wait for a snapshot that satisfies `done`, spinning so publish times stay exact
+    auto waitFor = [](auto done) -> const RenderSnapshot& {
+        for (;;) {
+            simSnapshots.acquire();
+            const RenderSnapshot& s = simSnapshots.readBuffer();
+            if (done(s)) return s;
+            std::this_thread::yield();
+        }
+    };
 
-    // animate background stars (uses glut elapsed inside draw)
-    if (running) {
-        // movement
-        updateMovement(dt);
-        // bezier target
-        computeBezierTarget(dt);
-        // collisions
-        handleCollisions(dt);
-        // countdown by accumulated seconds
-        accumSec += dt;
-        if (accumSec >= 1.0f) {
-            remainingTime = (std::max)(0, remainingTime - 1); // use parenthesized std::max to avoid windows macro
-            accumSec -= 1.0f;
-        }
-        // check end
-        if (checkEndCondition()) {
-            running = false;
-            showEnd = true;
-            stopBackgroundMusic();                          
-            if (playerWon) playSoundEffect("win.wav");      
-            else           playSoundEffect("lose.wav");     
+    LatencyStats effect, durationErr;
+    int lost = 0, sameTick = 0;
+    uint32_t rng = 0x1234567u;
+    const int tickUs = 1000000 / SIM_HZ;
+    for (int k = 0; k < taps; k++) {
+        uint64_t t = simSnapshots.readBuffer().tick;
+        float x0 = waitFor([t](const RenderSnapshot& s) { return s.tick > t; }).state.playerPos.x;
+        // land the tap anywhere relative to the tick boundaries
+        std::this_thread::sleep_for(std::chrono::microseconds((int)(rand01(rng) * tickUs)));
+        int key = k % 2 ? GLUT_KEY_LEFT : GLUT_KEY_RIGHT;
+        long long down = nowUs();
+        simCommands.push({ SimCommand::SPECIAL_DOWN, key, { 0.0f, 0.0f }, down });
+        // hold, watching for the first snapshot that applied the press
+        long long downTick = 0;
+        auto pressSeen = [&](const RenderSnapshot& s) {
+            if (downTick || s.inputUs < down) return downTick != 0;
+            effect.add((s.publishUs - down) * 0.001f);
+            downTick = s.inputSimUs;
+            return true;
+        };
+        while (nowUs() - down < (long long)(tapMs * 1000.0f)) {
+            if (simSnapshots.acquire()) pressSeen(simSnapshots.readBuffer());
         }
+        long long up = nowUs();
+        simCommands.push({ SimCommand::SPECIAL_UP, key, { 0.0f, 0.0f }, up });
+        waitFor(pressSeen);
+        const RenderSnapshot& b = waitFor([up](const RenderSnapshot& s) { return s.inputUs >= up; });
+        if (b.inputSimUs == downTick) sameTick++; // press and release fell between two boundaries
+        float heldMs = fabsf(b.state.playerPos.x - x0) / baseSpeed * 1000.0f;
+        if (heldMs < 0.01f) lost++;
+        durationErr.add(fabsf(heldMs - (up - down) * 0.001f));
     }
+    stopSimThread();
 
-    glutPostRedisplay();
+    printf("Taps: %d x %.1f ms on a %d Hz sim\n", taps, tapMs, SIM_HZ);
+    printf("  registered %d, lost %d; %d started and ended inside one tick (would be lost by per-tick polling)\n",
+        taps - lost, lost, sameTick);
+    durationErr.report("hold error");
+    effect.report("input->effect");
+    return lost ? 1 : 0;
 }
 
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // background game area
-    glColor3f(0.02f, 0.02f, 0.05f);
-    glBegin(GL_QUADS);
-    glVertex2f(0, GAME_Y0); glVertex2f(WIN_W, GAME_Y0);
-    glVertex2f(WIN_W, GAME_Y1); glVertex2f(0, GAME_Y1);
-    glEnd();
-    // animated stars
-    drawBackgroundStars(0.016f);
-
-    // panels
-    drawTopPanel();
-    drawBottomPanel();
+// --event-bench: push --events synthetic gameplay events through the bus
+// in full per-tick batches and time every subscriber
+int runEventBench(int argc, char** argv) {
+    long long total = 2000000;
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "--events") && i + 1 < argc) total = atoll(argv[++i]);
+    GameState g;
+    // audio stays on but is never started, so playSoundEffect drops every
+    // sound: the audio row times the subscriber's dispatch, not the mixer
+    resetRound(g);
+    uint32_t rng = 99;
+    long long sent = 0;
+    double emitMs = 0.0;
+    FxBurst fx;
+    auto t0 = std::chrono::steady_clock::now();
+    while (sent < total) {
+        g.bus.count = 0;
+        g.tick++;
+        auto e0 = std::chrono::steady_clock::now();
+        for (int k = 0; k < EventBus::CAP && sent < total; k++, sent++) {
+            uint32_t r = xorshift32(rng);
+            // mostly pickups, a few hits, no round ends
+            uint8_t type = (r & 7) == 0 ? EV_HIT : (r & 7) == 1 ? EV_POWERUP : EV_COLLECT;
+            g.bus.emit(type, (uint8_t)(1 + (r >> 8 & 1)), r >> 12, { (float)(r & 1023), (float)(r >> 10 & 511) });
+        }
+        emitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - e0).count();
+        drainEvents(g, 0, SUB_COUNT);
+        while (simFx.pop(fx)) {} // nobody renders here
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
 
-    // objects
-    drawObstacles();
-    drawCollectibles(0.016f);
-    drawPowerUps(0.016f);
+    printf("Events: %lld in batches of %d, %.3f s (%.1f M events/s end to end)\n", sent, EventBus::CAP, secs,
+        sent / (secs > 0 ? secs : 1e-9) * 1e-6);
+    printf("  %-10s %.2f ns/event\n", "emit", emitMs * 1e6 / sent);
+    for (int s = 0; s < SUB_COUNT; s++)
+        printf("  %-10s %.2f ns/event, %.2f us/batch\n", eventSubscribers[s].name,
+            g.bus.subMs[s] * 1e6 / (g.bus.subEvents[s] ? g.bus.subEvents[s] : 1),
+            g.bus.subMs[s] * 1000.0 / (g.bus.subBatches[s] ? g.bus.subBatches[s] : 1));
+    return 0;
+}
 
-    // target & player
-    drawTarget();
-    drawPlayer();
+// --timer-bench: --timers concurrent respawn/cooldown-style timers (0.1-60 s,
+// re-armed on expiry) on the wheel vs. decrementing a float per timer per tick
+int runTimerBench(int argc, char** argv) {
+    int timers = 10000, ticks = 7200;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--timers") && more) timers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--ticks") && more) ticks = atoi(argv[++i]);
+    }
+    if (timers < 1) timers = 1;
+    if (ticks < 1) ticks = 1;
+    const float dt = 1.0f / 120.0f;
+    auto randomMs = [](uint32_t& rng) { return 100u + xorshift32(rng) % 59900u; };
 
-    // overlay end screen
-    if (showEnd) {
-        // dim background
-        glEnable(GL_BLEND);
-        glColor4f(0, 0, 0, 0.6f);
-        glBegin(GL_QUADS);
-        glVertex2f(0, 0); glVertex2f(WIN_W, 0);
-        glVertex2f(WIN_W, WIN_H); glVertex2f(0, WIN_H);
-        glEnd();
-        glDisable(GL_BLEND);
-        // bright text
-        char buf[128];
-        if (playerWon) {
-            glColor3f(1.0f, 0.9f, 0.2f);
-            sprintf(buf, "GAME WIN! Final Score: %d", playerScore);
-            print_on_screen(WIN_W / 2 - 160, WIN_H / 2 + 20, buf);
-        }
-        else {
-            glColor3f(1.0f, 0.6f, 0.6f);
-            sprintf(buf, "GAME OVER. Final Score: %d", playerScore);
-            print_on_screen(WIN_W / 2 - 160, WIN_H / 2 + 20, buf);
-        }
-        glColor3f(1.0f, 1.0f, 1.0f);
-        print_on_screen(WIN_W / 2 - 120, WIN_H / 2 - 20, "Press C to clear & R to restart");
+    uint32_t rng = 42;
+    TimerWheel wheel;
+    wheel.reserve(timers);
+    for (int i = 0; i < timers; i++) wheel.schedule(randomMs(rng), 0, (uint32_t)i);
+    long long fired = 0;
+    float carry = 0.0f;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < ticks; t++) {
+        carry += dt * 1000.0f;
+        uint32_t ms = (uint32_t)carry;
+        carry -= (float)ms;
+        wheel.advance(ms, [&](uint8_t, uint32_t arg) { fired++; wheel.schedule(randomMs(rng), 0, arg); });
     }
+    double wheelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
 
-    glutSwapBuffers();
-}
+    rng = 42;
+    std::vector<float> left(timers);
+    for (auto& l : left) l = randomMs(rng) * 0.001f;
+    long long firedScan = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (int t = 0; t < ticks; t++)
+        for (auto& l : left) {
+            l -= dt;
+            if (l <= 0.0f) { firedScan++; l = randomMs(rng) * 0.001f; }
+        }
+    double scanMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
 
-// -------------------------------
-// Input handling
-// -------------------------------
-void specialDown(int key, int, int) {
-    if (key == GLUT_KEY_LEFT) keyLeft = true;
-    if (key == GLUT_KEY_RIGHT) keyRight = true;
-    if (key == GLUT_KEY_UP) keyUp = true;
-    if (key == GLUT_KEY_DOWN) keyDown = true;
-}
-void specialUp(int key, int, int) {
-    if (key == GLUT_KEY_LEFT) keyLeft = false;
-    if (key == GLUT_KEY_RIGHT) keyRight = false;
-    if (key == GLUT_KEY_UP) keyUp = false;
-    if (key == GLUT_KEY_DOWN) keyDown = false;
+    printf("Timers: %d concurrent, %d ticks at 120 Hz\n", timers, ticks);
+    printf("  wheel     %.4f ms/tick, %lld expiries (%.0f ns each incl. re-arm)\n", wheelMs / ticks, fired,
+        fired ? wheelMs * 1e6 / fired : 0.0);
+    printf("  per-tick  %.4f ms/tick, %lld expiries (float countdown per timer)\n", scanMs / ticks, firedScan);
+    return 0;
 }
 
-void keyboard(unsigned char key, int, int) {
-    if (key == 'r' || key == 'R') {
-        playBackgroundMusic();
-        // start/reset
-        running = true;
-        showEnd = false;
-        playerScore = 0;
-        playerLives = 5;
-        remainingTime = totalTime;
-        speedActive = doubleActive = false;
-        speedTimer = doubleTimer = 0.0f;
-        invulnTimer = 0.0f;
-        prevTimeMs = glutGet(GLUT_ELAPSED_TIME);
-        accumSec = 0.0f;
-        // place player at left and target at right
-        playerPos.x = 80.0f; playerPos.y = (GAME_Y0 + GAME_Y1) * 0.5f;
-        targetPos.x = WIN_W - 80.0f; targetPos.y = (GAME_Y0 + GAME_Y1) * 0.5f;
-        // right-side vertical Bezier curve (slight horizontal curve for visibility)
-        bz_p0[0] = WIN_W - 120;  bz_p0[1] = GAME_Y0 + 80;   // bottom
-        bz_p1[0] = WIN_W - 180;  bz_p1[1] = GAME_Y0 + 250;  // curve left
-        bz_p2[0] = WIN_W - 60;  bz_p2[1] = GAME_Y1 - 250;  // curve right
-        bz_p3[0] = WIN_W - 120;  bz_p3[1] = GAME_Y1 - 80;   // top
-
-        bezT = 0.0f;
+// --view-bench [level]: jump the player across a large world and time the
+// sim tick and the culled snapshot copy against copying the whole level
+int runViewBench(int argc, char** argv) {
+    const char* levelPath = NULL;
+    int count = 1000000, ticks = 2000;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--view-bench") && more && argv[i + 1][0] != '-') levelPath = argv[++i];
+        else if (!strcmp(argv[i], "--count") && more) count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--ticks") && more) ticks = atoi(argv[++i]);
+    }
+    if (ticks < 1) ticks = 1;
 
+    GameState world;
+    auto t0 = std::chrono::steady_clock::now();
+    if (levelPath) {
+        if (!loadLevel(world, levelPath)) { printf("Cannot read level '%s'\n", levelPath); return 1; }
     }
-    if (key == 'c' || key == 'C') {
-        // clear everything (reset to placement mode)
-        stopBackgroundMusic();
-        obstacles.clear(); collectibles.clear(); powerups.clear();
-        currentMode = NONE_MODE;
-        running = false; showEnd = false;
-        playerScore = 0; playerLives = 5; remainingTime = totalTime;
+    else {
+        LevelGenParams prm;
+        sizeLevelFor(prm, (std::max)(1, count));
+        generateLevel(world, prm);
     }
-}
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    size_t total = world.obstacles.size() + world.collectibles.size() + world.powerups.size();
+    printf("World %.0fx%.0f px, %zu entities, %s and indexed in %.0f ms\n", world.worldW, world.worldH, total,
+        levelPath ? "loaded" : "generated", loadMs);
 
-void mouseClick(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
-        int oglY = WIN_H - y;
-        if (oglY <= BOTTOM_H) {
-            float bx[4] = { 200.0f, 200.0f + 120.0f, 200.0f + 240.0f, 200.0f + 360.0f };
-            if (fabsf(x - bx[0]) < 30.0f) currentMode = OBSTACLE_MODE;
-            else if (fabsf(x - bx[1]) < 30.0f) currentMode = COLLECT_MODE;
-            else if (fabsf(x - bx[2]) < 30.0f) currentMode = POWER1_MODE;
-            else if (fabsf(x - bx[3]) < 30.0f) currentMode = POWER2_MODE;
-            return;
-        }
-        // placement in game area
-        if (oglY > GAME_Y0 && oglY < GAME_Y1) {
-            Vec2 p = { (float)x, (float)oglY };
-            // clamp to area (padding)
-            float pad = 20.0f;
-            if (p.x < pad) p.x = pad;
-            if (p.x > WIN_W - pad) p.x = WIN_W - pad;
-            if (p.y < GAME_Y0 + pad) p.y = GAME_Y0 + pad;
-            if (p.y > GAME_Y1 - pad) p.y = GAME_Y1 - pad;
+    world.audio = world.effects = false;
+    resetRound(world);
+    world.timers.reschedule(world.effectTimers[TIMER_ROUND], 3600 * 1000); // no timeout during the run
 
-            if (currentMode == OBSTACLE_MODE) {
-                Obstacle ob; ob.p = p; ob.r = 20.0f;
-                if (!overlapsExisting(ob.p, ob.r)) obstacles.push_back(ob);
-            }
-            else if (currentMode == COLLECT_MODE) {
-                Collectible c; c.p = p; c.r = 12.0f; c.active = true; c.rot = 0.0f;
-                if (!overlapsExisting(c.p, c.r)) collectibles.push_back(c);
-            }
-            else if (currentMode == POWER1_MODE) {
-                PowerUp pu; pu.p = p; pu.r = 14.0f; pu.type = 1; pu.active = true; pu.phase = 0.0f;
-                if (!overlapsExisting(pu.p, pu.r)) powerups.push_back(pu);
-            }
-            else if (currentMode == POWER2_MODE) {
-                PowerUp pu; pu.p = p; pu.r = 14.0f; pu.type = 2; pu.active = true; pu.phase = 0.0f;
-                if (!overlapsExisting(pu.p, pu.r)) powerups.push_back(pu);
-            }
-        }
+    GameState view, full;
+    ViewCuller culler;
+    double stepSum = 0.0, copySum = 0.0, stepMax = 0.0, copyMax = 0.0, visibleSum = 0.0;
+    for (int t = 0; t < ticks; t++) {
+        // a diagonal sweep, so every part of the grid gets visited
+        float u = (t + 0.5f) / ticks;
+        world.playerPos = clampToArea(world, { u * world.worldW, GAME_Y0 + u * world.worldH });
+        auto a = std::chrono::steady_clock::now();
+        stepGame(world, SIM_DT);
+        auto b = std::chrono::steady_clock::now();
+        copyVisible(view, world, culler);
+        auto c = std::chrono::steady_clock::now();
+        double stepMs = std::chrono::duration<double, std::milli>(b - a).count();
+        double copyMs = std::chrono::duration<double, std::milli>(c - b).count();
+        stepSum += stepMs; copySum += copyMs;
+        stepMax = (std::max)(stepMax, stepMs); copyMax = (std::max)(copyMax, copyMs);
+        visibleSum += (double)culler.visible;
+        world.bus.count = 0;
     }
+    full = world; // first copy sizes the buffers, like a snapshot slot
+    auto f0 = std::chrono::steady_clock::now();
+    full = world;
+    double fullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - f0).count();
+
+    printf("Ticks: %d\n", ticks);
+    printf("  sim tick   %.4f ms avg, %.4f ms max\n", stepSum / ticks, stepMax);
+    printf("  snapshot   %.4f ms avg, %.4f ms max, %.0f entities visible on average\n", copySum / ticks, copyMax,
+        visibleSum / ticks);
+    printf("  full copy  %.4f ms (what every snapshot cost before culling)\n", fullMs);
+    return 0;
 }
 
 // -------------------------------
@@ -731,16 +6383,17 @@ void initGame() {
     glLoadIdentity();
 
     // Start positions: player left, target right
-    playerPos.x = 80.0f; playerPos.y = (GAME_Y0 + GAME_Y1) * 0.5f;
-    targetPos.x = WIN_W - 80.0f; targetPos.y = (GAME_Y0 + GAME_Y1) * 0.5f;
+    game.playerPos.x = 80.0f; game.playerPos.y = (GAME_Y0 + GAME_Y1) * 0.5f;
+    game.targetPos.x = WIN_W - 80.0f; game.targetPos.y = (GAME_Y0 + GAME_Y1) * 0.5f;
 
     // Bezier points for vertical motion (right side)
-    bz_p0[0] = WIN_W - 100;  bz_p0[1] = GAME_Y0 + 60;          // bottom point
-    bz_p1[0] = WIN_W - 105;  bz_p1[1] = GAME_Y0 + 220;         // lower-mid
-    bz_p2[0] = WIN_W - 95;   bz_p2[1] = GAME_Y1 - 220;         // upper-mid
-    bz_p3[0] = WIN_W - 100;  bz_p3[1] = GAME_Y1 - 60;          // top point
-    bezT = 0.0f;
+    game.bz_p0[0] = WIN_W - 100;  game.bz_p0[1] = GAME_Y0 + 60;          // bottom point
+    game.bz_p1[0] = WIN_W - 105;  game.bz_p1[1] = GAME_Y0 + 220;         // lower-mid
+    game.bz_p2[0] = WIN_W - 95;   game.bz_p2[1] = GAME_Y1 - 220;         // upper-mid
+    game.bz_p3[0] = WIN_W - 100;  game.bz_p3[1] = GAME_Y1 - 60;          // top point
+    game.bezT = 0.0f;
 
+    particlesReserve(particles, 1 << 17);
 
     prevTimeMs = glutGet(GLUT_ELAPSED_TIME);
 }
@@ -767,14 +6420,1239 @@ void initGame() {
 void displayWrapper() { display(); }
 void idleWrapper() { idle(); }
 
+// --rewind-bench [level]: let the pilot play with rewind capture on, then
+// seek to random frames and check each against the state it had when live
+int runRewindBench(int argc, char** argv) {
+    const char* levelPath = NULL;
+    int ticks = 20000, seeks = 20000;
+    LevelGenParams prm;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--rewind-bench") && more && argv[i + 1][0] != '-') levelPath = argv[++i];
+        else if (!strcmp(argv[i], "--ticks") && more) ticks = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seeks") && more) seeks = atoi(argv[++i]);
+    }
+    if (ticks < 1) ticks = 1;
+
+    GameState g;
+    if (levelPath) {
+        if (!loadLevel(g, levelPath)) { printf("Cannot read level '%s'\n", levelPath); return 1; }
+    }
+    else generateLevel(g, prm);
+    printf("Level: %d obstacles, %d collectibles, %d powerups\n",
+        (int)g.obstacles.size(), (int)g.collectibles.size(), (int)g.powerups.size());
+    g.audio = g.effects = false;
+    minimapBuild(minimap, g);
+
+    static Rewind rw;
+    std::vector<uint64_t> hashAt(Rewind::FRAMES); // parallel to the frame ring
+    FlowPilot nav;
+    BotPolicy pol = { 0.0f, 0.0f, 0.0f, 0.0f };
+    BotState bot;
+    int rounds = 0;
+    for (int t = 0; t < ticks; t++) {
+        if (!g.running) { resetRound(g); navSync(nav, g); rounds++; }
+        flowPilotDrive(nav, g, pol, bot, SIM_DT);
+        stepGame(g, SIM_DT);
+        rewindCapture(rw, g);
+        hashAt[(rw.first + rw.count - 1) % Rewind::FRAMES] = stateHash(g);
+    }
+    printf("Played %d ticks over %d rounds: %u frames (%.1f s) and %u pickups kept\n", ticks, rounds, rw.count,
+        rw.count / (float)SIM_HZ, rw.count ? rw.deltaEnd - rw.frame(0).deltaEnd : 0);
+    printf("  memory   %zu KB used of %zu KB\n", rewindBytesUsed(rw) / 1024, sizeof(Rewind) / 1024);
+    printf("  capture  %.3f us avg, %.3f us max per tick\n", rw.captureUs / rw.captures, rw.captureMaxUs);
+
+    uint32_t rng = 0x9E3779B9u;
+    int match = 0;
+    for (int i = 0; i < seeks; i++) {
+        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+        uint32_t k = rng % rw.count;
+        rewindSeek(rw, g, k);
+        if (stateHash(g) == hashAt[(rw.first + k) % Rewind::FRAMES]) match++;
+    }
+    printf("  seek     %.3f us avg, %.3f us max over %d random frames; %d/%d match the live state\n",
+        rw.seekUs / (std::max)(1ull, rw.seeks), rw.seekMaxUs, seeks, match, seeks);
+
+    QuickSave q;
+    uint64_t saved = stateHash(g);
+    auto q0 = std::chrono::steady_clock::now();
+    quickSave(q, g);
+    auto q1 = std::chrono::steady_clock::now();
+    rewindResume(rw);
+    for (int t = 0; t < 600 && g.running; t++) { flowPilotDrive(nav, g, pol, bot, SIM_DT); stepGame(g, SIM_DT); }
+    auto q2 = std::chrono::steady_clock::now();
+    bool loaded = quickLoad(q, g);
+    auto q3 = std::chrono::steady_clock::now();
+    printf("  quick    save %.1f us, load %.1f us, %.1f KB per slot; restored state %s\n",
+        std::chrono::duration<double, std::micro>(q1 - q0).count(), std::chrono::duration<double, std::micro>(q3 - q2).count(),
+        ((q.collectTaken.size() + q.powerTaken.size()) * sizeof(uint32_t) + sizeof(QuickSave)) / 1024.0,
+        loaded && stateHash(g) == saved ? "matches" : "DIFFERS");
+    return match == seeks && loaded ? 0 : 1;
+}
+
+// --sim-hash [level]: drive the keys from a seeded script (not the pilot,
+// whose planner is float), chain the state hash of every tick, then time
+// the same run without hashing. SIM_FIXED builds print the same hashes
+// on every compiler and flag set only for a level file: without one the
+// level comes from generateLevel, which is float and can place objects
+// differently under other flags (-ffast-math, for one).
+int runSimHash(int argc, char** argv) {
+    const char* levelPath = NULL;
+    int ticks = 200000, every = 0;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--sim-hash") && more && argv[i + 1][0] != '-') levelPath = argv[++i];
+        else if (!strcmp(argv[i], "--ticks") && more) ticks = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && more) seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--every") && more) every = atoi(argv[++i]);
+    }
+    if (ticks < 1) ticks = 1;
+
+    GameState level;
+    if (levelPath) {
+        if (!loadLevel(level, levelPath)) { printf("Cannot read level '%s'\n", levelPath); return 1; }
+    }
+    else {
+        LevelGenParams prm;
+        generateLevel(level, prm);
+    }
+    printf("Math: %s; level: %d obstacles, %d collectibles, %d powerups%s\n", SIM_MATH,
+        (int)level.obstacles.size(), (int)level.collectibles.size(), (int)level.powerups.size(),
+        levelPath ? "" : " (generated in float; pass a level file to compare builds)");
+
+    GameState g;
+    uint64_t chain = 0;
+    double secs = 0.0;
+    for (int pass = 0; pass < 2; pass++) {
+        bool hashing = pass == 0;
+        g = level;
+        g.audio = g.effects = false;
+        uint32_t rng = seed * 2654435761u | 1u;
+        chain = 1469598103934665603ull;
+        int rounds = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int t = 0; t < ticks; t++) {
+            if (!g.running) { resetRound(g); rounds++; }
+            if (t % 15 == 0) {
+                // new keys every 1/8 s, leaning right so rounds reach the target
+                rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+                g.keyRight = (rng & 3) != 0; g.keyLeft = !g.keyRight && (rng & 4);
+                g.keyUp = (rng >> 3 & 3) == 1; g.keyDown = (rng >> 3 & 3) == 2;
+            }
+            stepGame(g, SIM_DT);
+            if (!hashing) continue;
+            chain = (chain ^ stateHash(g)) * 1099511628211ull;
+            if (every && (t + 1) % every == 0) printf("  tick %8d  %016llx\n", t + 1, (unsigned long long)chain);
+        }
+        secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (hashing) printf("Hash after %d ticks (%d rounds): %016llx\n", ticks, rounds, (unsigned long long)chain);
+    }
+    printf("Ticks: %.3f s for %d (%.0f ticks/s, %.3f us per tick)\n", secs, ticks, ticks / secs, secs * 1e6 / ticks);
+    return 0;
+}
+
+// --index-bench: uniform, clustered, corridor and column levels built
+// from the game's entity types; build, player-sized query, nudge-everything
+// and single-placement update costs for each index
+int runIndexBench(int argc, char** argv) {
+    int count = 20000, queries = 100000;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--count") && more) count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queries") && more) queries = atoi(argv[++i]);
+    }
+    count = (std::max)(1, count);
+    queries = (std::max)(1, queries);
+
+    enum { UNIFORM, CLUSTERED, CORRIDOR, COLUMN, LAYOUTS };
+    const char* layoutNames[LAYOUTS] = { "uniform", "clustered", "corridor", "column" };
+    uint32_t rng = 12345u;
+    auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng; };
+    auto unit = [&next]() { return (next() >> 8) * (1.0f / 16777216.0f); };
+
+    for (int layout = 0; layout < LAYOUTS; layout++) {
+        GameState g;
+        g.worldW = sqrtf(count * 10000.0f); g.worldH = g.worldW * 0.5f; // ~5000 px^2 per entity
+        Vec2 centers[12];
+        for (auto& c : centers) c = { unit() * g.worldW, GAME_Y0 + unit() * g.worldH };
+        for (int i = 0; i < count; i++) {
+            Vec2 p;
+            if (layout == UNIFORM) p = { unit() * g.worldW, GAME_Y0 + unit() * g.worldH };
+            else if (layout == CLUSTERED) {
+                // roughly normal, sigma ~80 px, around one of the centres
+                const Vec2& c = centers[next() % 12];
+                p = { c.x + (unit() + unit() + unit() - 1.5f) * 160.0f, c.y + (unit() + unit() + unit() - 1.5f) * 160.0f };
+            }
+            else if (layout == CORRIDOR) p = { unit() * g.worldW, GAME_Y0 + g.worldH * 0.5f + (unit() - 0.5f) * 120.0f };
+            else p = { g.worldW * 0.5f + (unit() - 0.5f) * 120.0f, GAME_Y0 + unit() * g.worldH };
+            p = clampToArea(g, p, 20.0f);
+            uint32_t k = next() % 100;
+            if (k < 30) g.obstacles.add({ p, obstacleRadius });
+            else if (k < 85) g.collectibles.add({ p, collectibleRadius, 0u, 0.0f });
+            else g.powerups.add({ p, powerUpRadius, 1 + (int)(next() % (PU_TYPE_END - 1)), 0u, 0.0f });
+        }
+        groupPowerUps(g);
+        printf("%s: %d entities in %.0fx%.0f px\n", layoutNames[layout], count, g.worldW, g.worldH);
+
+        // query points near entities, where the player actually meets them
+        std::vector<Vec2> at(queries);
+        for (auto& q : at) {
+            uint32_t k = next() % (uint32_t)count;
+            Vec2 c = k < g.obstacles.size() ? g.obstacles[k].p : k < g.obstacles.size() + g.collectibles.size()
+                ? g.collectibles[k - g.obstacles.size()].p : g.powerups[k - g.obstacles.size() - g.collectibles.size()].p;
+            q = { c.x + (unit() - 0.5f) * 80.0f, c.y + (unit() - 0.5f) * 80.0f };
+        }
+
+        for (int kind = 0; kind < INDEX_KIND_COUNT; kind++) {
+            g.index.kind = (IndexKind)kind;
+            auto b0 = std::chrono::steady_clock::now();
+            indexLevel(g);
+            double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - b0).count();
+
+            // the collision pass: obstacles, collectibles and each power-up run around the player
+            long long candidates = 0, hits = 0;
+            auto q0 = std::chrono::steady_clock::now();
+            for (const Vec2& p : at) {
+                float m = playerRadius + 12.0f;
+                g.index.obstacles.query(p.x - m, p.y - m, p.x + m, p.y + m, [&](uint32_t i) {
+                    candidates++; hits += dist(p, g.obstacles[i].p) <= playerRadius + g.obstacles[i].r;
+                });
+                g.index.collectibles.query(p.x - playerRadius, p.y - playerRadius, p.x + playerRadius, p.y + playerRadius, [&](uint32_t i) {
+                    candidates++; hits += dist(p, g.collectibles[i].p) <= playerRadius + g.collectibles[i].r;
+                });
+                for (int t = 1; t < PU_TYPE_END; t++)
+                    g.index.powerups[t].query(p.x - playerRadius, p.y - playerRadius, p.x + playerRadius, p.y + playerRadius, [&](uint32_t i) {
+                        candidates++; hits += dist(p, g.powerups[i].p) <= playerRadius + g.powerups[i].r;
+                    });
+            }
+            double queryNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - q0).count() / queries;
+
+            // every collectible drifts a pixel, as moving entities would between ticks
+            std::vector<Vec2> rest(g.collectibles.size());
+            for (size_t i = 0; i < rest.size(); i++) {
+                rest[i] = g.collectibles[i].p;
+                g.collectibles[i].p.x += (next() & 1) ? 1.0f : -1.0f;
+                g.collectibles[i].p.y += (next() & 1) ? 1.0f : -1.0f;
+            }
+            auto n0 = std::chrono::steady_clock::now();
+            if (kind == INDEX_SWEEP) g.index.collectibles.sweep.refresh(g.collectibles);
+            else g.index.collectibles.build(g.index.kind, g.collectibles, 0, g.collectibles.size(), g.worldW, g.worldH);
+            double nudgeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - n0).count();
+            for (size_t i = 0; i < rest.size(); i++) g.collectibles[i].p = rest[i];
+
+            // editor placements, one index update each
+            const int PLACES = 50;
+            double placeUs = 0.0;
+            for (int k = 0; k < PLACES; k++) {
+                g.collectibles.add({ { unit() * g.worldW, GAME_Y0 + unit() * g.worldH }, collectibleRadius, 0u, 0.0f });
+                auto p0 = std::chrono::steady_clock::now();
+                g.index.collectibles.build(g.index.kind, g.collectibles, 0, g.collectibles.size(), g.worldW, g.worldH);
+                placeUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - p0).count();
+            }
+            for (int k = 0; k < PLACES; k++) g.collectibles.pop(); // same level for the next index
+            printf("  %-16s build %7.2f ms  query %7.0f ns (%6.1f candidates, %.2f hits)  nudge %6.2f ms  place %7.1f us\n",
+                indexKindNames[kind], buildMs, queryNs, (double)candidates / queries, (double)hits / queries, nudgeMs,
+                placeUs / PLACES);
+        }
+    }
+    return 0;
+}
+
+// --paint-bench: random drag strokes over a level (or an empty world),
+// one batch per motion event and one flush per --per-tick of them as in
+// the game, against
+// placing the same candidates one at a time the way a click does
+// (overlapsExisting, then an index rebuild). Both must place the same set.
+int runPaintBench(int argc, char** argv) {
+    const char* path = NULL;
+    int strokes = 100, events = 40, perTick = 2;
+    float step = 24.0f;
+    PaintBrush brush;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--paint-bench") && more && argv[i + 1][0] != '-') path = argv[++i];
+        else if (!strcmp(argv[i], "--strokes") && more) strokes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--events") && more) events = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--per-tick") && more) perTick = (std::max)(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--step") && more) step = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--brush") && more) brush.radius = (float)atof(argv[++i]) * 0.5f;
+        else if (!strcmp(argv[i], "--spacing") && more) brush.spacing = (float)atof(argv[++i]);
+    }
+    GameState level;
+    if (path) {
+        if (!loadLevel(level, path)) { printf("Cannot read level '%s'\n", path); return 1; }
+    }
+    else { level.worldW = 4000.0f; level.worldH = 2000.0f; indexLevel(level); }
+    resetRound(level);
+    size_t before = level.obstacles.size() + level.collectibles.size() + level.powerups.size();
+    printf("Level: %zu objects in %.0fx%.0f px; %d strokes of %d motion events, %.0f px apart, %d per tick, brush %.0f px\n",
+        before, level.worldW, level.worldH, (std::max)(0, strokes), events, step, perTick, brush.radius * 2.0f);
+
+    // the strokes: a random walk per stroke, one mode each
+    uint32_t rng = 2024u;
+    struct Seg { Vec2 a, z; int mode; };
+    std::vector<Seg> segs;
+    for (int k = 0; k < strokes; k++) {
+        int mode = OBSTACLE_MODE + (int)(rand01(rng) * (PLACE_MODE_END - OBSTACLE_MODE)) % (PLACE_MODE_END - OBSTACLE_MODE);
+        Vec2 p = { 40.0f + rand01(rng) * (level.worldW - 80.0f), GAME_Y0 + 40.0f + rand01(rng) * (level.worldH - 80.0f) };
+        float heading = rand01(rng) * 6.2831853f;
+        for (int e = 0; e < events; e++) {
+            heading += (rand01(rng) - 0.5f) * 0.6f;
+            Vec2 q = clampToArea(level, { p.x + cosf(heading) * step, p.y + sinf(heading) * step }, 20.0f);
+            segs.push_back({ p, q, mode });
+            p = q;
+        }
+    }
+
+    GameState g = level;
+    indexLevel(g);
+    size_t placed = 0;
+    long long t0 = nowUs();
+    for (size_t k = 0; k < segs.size(); k++) {
+        placed += paintSegment(g, brush, segs[k].mode, segs[k].a, segs[k].z);
+        bool up = (k + 1) % events == 0 || k + 1 == segs.size(); // end of a stroke
+        if ((k + 1) % perTick == 0 || up) paintFlush(g, brush, NULL);
+        if (up) paintFinish(g, brush);
+    }
+    double batchMs = (nowUs() - t0) * 0.001;
+    printf("  batched     %7zu placed from %u candidates in %8.1f ms: %6.1f us per batch (max %lld), %5.1f ms adding, %5.1f ms in tree rebuilds, %9.0f placements/s\n",
+        placed, brush.offered, batchMs, (double)brush.batchUs / (std::max)(1u, brush.batches), brush.maxBatchUs,
+        brush.flushUs * 0.001, brush.finishUs * 0.001, placed / (std::max)(1e-6, batchMs * 0.001));
+
+    GameState h = level;
+    indexLevel(h);
+    size_t clicked = 0;
+    std::vector<Vec2> cand;
+    t0 = nowUs();
+    for (const Seg& sg : segs) {
+        paintCandidates(h, brush, sg.mode, sg.a, sg.z, cand);
+        float r = paintRadius(sg.mode);
+        for (const Vec2& p : cand) {
+            if (overlapsExisting(h, p, r)) continue;
+            if (sg.mode == OBSTACLE_MODE) h.obstacles.add({ p, r });
+            else if (sg.mode == COLLECT_MODE) h.collectibles.add({ p, r, 0, 0.0f });
+            else addPowerUp(h, { p, r, sg.mode - POWER_MODE + 1, 0, 0.0f });
+            indexLevel(h, sg.mode == OBSTACLE_MODE ? LEVEL_OBSTACLES : sg.mode == COLLECT_MODE ? LEVEL_COLLECTIBLES : LEVEL_POWERUPS);
+            clicked++;
+        }
+    }
+    double clickMs = (nowUs() - t0) * 0.001;
+    printf("  one by one  %7zu placed in %8.1f ms, %9.0f placements/s\n", clicked, clickMs, clicked / (std::max)(1e-6, clickMs * 0.001));
+
+    // same objects, same order within each kind
+    bool same = g.obstacles.size() == h.obstacles.size() && g.collectibles.size() == h.collectibles.size() && g.powerups.size() == h.powerups.size();
+    for (size_t i = 0; same && i < g.obstacles.size(); i++) same = dist(g.obstacles[i].p, h.obstacles[i].p) == 0.0f;
+    for (size_t i = 0; same && i < g.collectibles.size(); i++) same = dist(g.collectibles[i].p, h.collectibles[i].p) == 0.0f;
+    for (size_t i = 0; same && i < g.powerups.size(); i++) same = dist(g.powerups[i].p, h.powerups[i].p) == 0.0f;
+    printf("%s\n", same ? "Both placed the same objects" : "MISMATCH between batched and one-by-one placement");
+    // the grids painted objects were appended to match rebuilt ones
+    const SpatialGrid& go = g.index.obstacles.grid, &gc = g.index.collectibles.grid, &ho = h.index.obstacles.grid, &hc = h.index.collectibles.grid;
+    bool grids = go.items == ho.items && go.start == ho.start && gc.items == hc.items && gc.start == hc.start;
+    for (int t = 1; t < PU_TYPE_END; t++)
+        grids = grids && g.index.powerups[t].grid.items == h.index.powerups[t].grid.items && g.index.powerups[t].grid.start == h.index.powerups[t].grid.start;
+    printf("%s\n", grids ? "Appended grids match rebuilt ones" : "MISMATCH between appended and rebuilt grids");
+    same = same && grids;
+    return same ? 0 : 1;
+}
+
+// --reload-bench: edits of growing size to a level (or a generated one),
+// each replacing objects with new ones: obstacles only (moving walls
+// around), then any kind. Times the watcher's side of an incremental
+// reload (diff, apply to the mirror, index the changed parts) and the
+// sim's (apply, swap the parts in), against a full one: the watcher
+// indexes the whole file, the sim swaps it in and redraws the minimap.
+// Both must leave exactly the file's objects.
+int runReloadBench(int argc, char** argv) {
+    const char* path = NULL;
+    LevelGenParams prm;
+    prm.width = 8000.0f; prm.height = 4000.0f; prm.density = 0.5f;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--reload-bench") && more && argv[i + 1][0] != '-') path = argv[++i];
+        else if (!strcmp(argv[i], "--width") && more) prm.width = (float)atof(argv[++i]);
+        else if (!strcmp(argv[i], "--height") && more) prm.height = (float)atof(argv[++i]);
+    }
+    GameState level;
+    if (path) {
+        if (!loadLevel(level, path)) { printf("Cannot read level '%s'\n", path); return 1; }
+    }
+    else generateLevel(level, prm);
+    size_t total = level.obstacles.size() + level.collectibles.size() + level.powerups.size();
+    printf("Level: %zu objects in %.0fx%.0f px; the game swaps in the whole file above %.0f%% changed\n",
+        total, level.worldW, level.worldH, RELOAD_FULL_SHARE * 100.0f);
+
+    uint32_t rng = 77u;
+    LevelDiff d;
+    static Minimap mini;
+    bool ok = true;
+    for (int mixed = 0; mixed < 2; mixed++)
+    for (size_t edits = 1; edits <= total / 2; edits *= 10) {
+        // the edited file: `edits` objects gone, as many new ones
+        GameState file = level;
+        for (size_t k = 0; k < edits; k++) {
+            float u = mixed ? rand01(rng) : 0.0f;
+            if (u < 0.4f && file.obstacles.size()) file.obstacles.swapRemove((size_t)(rand01(rng) * file.obstacles.size()) % file.obstacles.size());
+            else if (u < 0.8f && file.collectibles.size()) file.collectibles.swapRemove((size_t)(rand01(rng) * file.collectibles.size()) % file.collectibles.size());
+            else if (file.powerups.size()) {
+                size_t i = (size_t)(rand01(rng) * file.powerups.size()) % file.powerups.size();
+                for (int t = file.powerups[i].type + 1; t <= PU_TYPE_END; t++) file.powerupRun[t]--;
+                file.powerups.erase(i);
+            }
+            Vec2 p = { 20.0f + rand01(rng) * (file.worldW - 40.0f), GAME_Y0 + 20.0f + rand01(rng) * (file.worldH - 40.0f) };
+            p.x = roundf(p.x * 10.0f) * 0.1f; p.y = roundf(p.y * 10.0f) * 0.1f; // what a saved file holds
+            u = mixed ? rand01(rng) : 0.0f;
+            if (u < 0.4f) file.obstacles.add({ p, obstacleRadius });
+            else if (u < 0.8f) file.collectibles.add({ p, collectibleRadius, 0, 0.0f });
+            else addPowerUp(file, { p, powerUpRadius, 1 + (int)(rand01(rng) * (PU_TYPE_END - 1)) % (PU_TYPE_END - 1), 0, 0.0f });
+        }
+
+        GameState mirror = level, g = level;
+        LevelIndex shipped;
+        minimapBuild(mini, g);
+        long long t0 = nowUs();
+        diffLevel(d, mirror, file);
+        size_t changes = d.changes();
+        unsigned parts = applyLevelDiff(mirror, file, d, NULL);
+        indexLevel(mirror, parts);
+        swapIndexParts(shipped, mirror.index, parts);
+        long long t1 = nowUs();
+        applyLevelDiff(g, file, d, &mini);
+        swapIndexParts(g.index, shipped, parts);
+        long long t2 = nowUs();
+
+        GameState h = level, staged = file;
+        long long t3 = nowUs();
+        indexLevel(staged);
+        long long t4 = nowUs();
+        adoptLevel(h, staged, true);
+        minimapBuild(mini, h);
+        long long t5 = nowUs();
+
+        bool same = sameLevel(g, mirror);
+        diffLevel(d, g, file);
+        same = same && !d.changes();
+        diffLevel(d, h, file);
+        same = same && !d.changes();
+        ok = ok && same;
+        printf("  %-9s %7zu edits: %7zu changes; incremental: watcher %7.2f ms, sim %6.2f ms; full: watcher %7.2f ms, sim %6.2f ms%s\n",
+            mixed ? "any kind" : "obstacles", edits, changes,
+            (t1 - t0) * 0.001, (t2 - t1) * 0.001, (t4 - t3) * 0.001, (t5 - t4) * 0.001, same ? "" : "  MISMATCH");
+    }
+    return ok ? 0 : 1;
+}
+
+// --bvh-bench: obstacle fields from 100 to --max obstacles at a fixed
+// density; build time, then collision boxes, swept circles and rays through
+// the BVH against the grid and a linear scan (which also checks the answers)
+int runBvhBench(int argc, char** argv) {
+    int maxCount = 1000000, queries = 100000;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--max") && more) maxCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queries") && more) queries = atoi(argv[++i]);
+    }
+    queries = (std::max)(1, queries);
+
+    uint32_t rng = 777u;
+    auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng; };
+    auto unit = [&next]() { return (next() >> 8) * (1.0f / 16777216.0f); };
+    auto ms = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    for (int count = 100; count <= maxCount; count *= 10) {
+        GameState g;
+        g.worldW = sqrtf(count * 20000.0f); g.worldH = g.worldW * 0.5f; // ~10000 px^2 per obstacle
+        for (int i = 0; i < count; i++)
+            g.obstacles.add({ { unit() * g.worldW, GAME_Y0 + unit() * g.worldH }, 10.0f + 30.0f * unit() });
+        printf("%d obstacles in %.0fx%.0f px\n", count, g.worldW, g.worldH);
+
+        // the linear scan answers fewer queries on big levels; its costs are per query anyway
+        int linearQ = (int)(std::min)((long long)queries, 2000000000LL / count / 10 + 1);
+        std::vector<Vec2> from(queries), to(queries), rayTo(queries);
+        for (int q = 0; q < queries; q++) {
+            from[q] = { unit() * g.worldW, GAME_Y0 + unit() * g.worldH };
+            float a = unit() * 6.2831853f, len = 200.0f * unit();
+            to[q] = { from[q].x + cosf(a) * len, from[q].y + sinf(a) * len };
+            float far = 0.25f * (g.worldW + g.worldH) * unit();
+            rayTo[q] = { from[q].x + cosf(a) * far, from[q].y + sinf(a) * far };
+        }
+        auto linearSweep = [&](Vec2 a, Vec2 b, float r, float& tHit, uint32_t& hit) {
+            float dx = b.x - a.x, dy = b.y - a.y, dd = dx * dx + dy * dy;
+            bool found = false;
+            tHit = 1.0f;
+            for (size_t i = 0; i < g.obstacles.size(); i++) {
+                const Obstacle& ob = g.obstacles[i];
+                float mx = a.x - ob.p.x, my = a.y - ob.p.y, rad = r + ob.r;
+                float c = mx * mx + my * my - rad * rad, t;
+                if (c <= 0.0f) t = 0.0f;
+                else {
+                    float bb = mx * dx + my * dy, disc = bb * bb - dd * c;
+                    if (bb >= 0.0f || disc < 0.0f) continue;
+                    t = (-bb - sqrtf(disc)) / dd;
+                }
+                if (t < tHit || (!found && t <= tHit)) { tHit = t; hit = (uint32_t)i; found = true; }
+            }
+            return found;
+        };
+
+        // collision boxes: player-sized, hits counted with the exact circle test
+        double collideNs[INDEX_KIND_COUNT + 1];
+        long long hits[INDEX_KIND_COUNT + 1] = {};
+        for (int kind = 0; kind <= INDEX_KIND_COUNT; kind++) {
+            int n = kind == INDEX_KIND_COUNT ? linearQ : queries;
+            auto t0 = std::chrono::steady_clock::now();
+            if (kind < INDEX_KIND_COUNT) {
+                g.index.obstacles.build((IndexKind)kind, g.obstacles, 0, g.obstacles.size(), g.worldW, g.worldH);
+                printf("  build %-16s %9.2f ms\n", indexKindNames[kind], ms(t0));
+            }
+            auto q0 = std::chrono::steady_clock::now();
+            for (int q = 0; q < n; q++) {
+                Vec2 p = from[q];
+                float m = playerRadius;
+                auto test = [&](uint32_t i) { hits[kind] += dist(p, g.obstacles[i].p) <= playerRadius + g.obstacles[i].r; };
+                if (kind < INDEX_KIND_COUNT) g.index.obstacles.query(p.x - m, p.y - m, p.x + m, p.y + m, test);
+                else for (size_t i = 0; i < g.obstacles.size(); i++) test((uint32_t)i);
+            }
+            collideNs[kind] = ms(q0) * 1e6 / n;
+        }
+        const Bvh& tree = g.index.solid(); // the BVH kind was built last
+        printf("  BVH: %zu nodes, depth %d, %.1f MB\n", tree.nodes.size(), tree.depth,
+            (tree.nodes.size() * sizeof(Bvh::Node) + tree.items.size() * sizeof(Bvh::Item)) / 1048576.0);
+        printf("  collide   ");
+        for (int kind = 0; kind < INDEX_KIND_COUNT; kind++) printf(" %s %.0f ns", indexKindNames[kind], collideNs[kind]);
+        printf("  linear %.0f ns%s\n", collideNs[INDEX_KIND_COUNT],
+            hits[INDEX_BVH] == hits[INDEX_GRID] && hits[INDEX_BVH] == hits[INDEX_SWEEP] ? "" : "  HITS DIFFER");
+
+        // swept player circles and rays: nearest hit, plus the any-hit line-of-sight test for rays
+        int mismatches = 0;
+        for (int ray = 0; ray < 2; ray++) {
+            const std::vector<Vec2>& end = ray ? rayTo : to;
+            float r = ray ? 0.0f : playerRadius;
+            long long found = 0, visible = 0;
+            auto q0 = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; q++) {
+                float t; uint32_t hit;
+                found += tree.sweep(from[q], end[q], r, t, hit);
+            }
+            double treeNs = ms(q0) * 1e6 / queries;
+            q0 = std::chrono::steady_clock::now();
+            for (int q = 0; q < queries; q++) visible += tree.lineOfSight(from[q], end[q], r);
+            double sightNs = ms(q0) * 1e6 / queries;
+            q0 = std::chrono::steady_clock::now();
+            long long linearFound = 0;
+            for (int q = 0; q < linearQ; q++) {
+                float t; uint32_t hit = 0;
+                linearFound += linearSweep(from[q], end[q], r, t, hit);
+            }
+            double linearNs = ms(q0) * 1e6 / linearQ;
+            for (int q = 0; q < linearQ && q < 2000; q++) {
+                float t0, t1; uint32_t h0 = 0, h1 = 0;
+                bool a = tree.sweep(from[q], end[q], r, t0, h0), b = linearSweep(from[q], end[q], r, t1, h1);
+                mismatches += a != b || (a && fabsf(t0 - t1) > 1e-5f);
+            }
+            if (found + visible != queries) mismatches++;
+            printf("  %-9s  BVH %6.0f ns  line of sight %6.0f ns  linear %10.0f ns  (%.1f%% hit)\n",
+                ray ? "ray" : "swept", treeNs, sightNs, linearNs, 100.0 * found / queries);
+        }
+        if (mismatches) printf("  %d QUERIES DIFFER FROM THE LINEAR SCAN\n", mismatches);
+    }
+    return 0;
+}
+
+// --pickup-bench: nearest-1, nearest-8, radius and box queries over the
+// pickups of a uniform level against a linear scan, with none, half and
+// 90% of them taken; each step is timed with the tombstones still in the
+// tree and again after compacting them
+int runPickupBench(int argc, char** argv) {
+    int count = 100000, queries = 100000;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--count") && more) count = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--queries") && more) queries = atoi(argv[++i]);
+    }
+    count = (std::max)(1, count);
+    queries = (std::max)(1, queries);
+
+    uint32_t rng = 4242u;
+    auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5; return rng; };
+    auto unit = [&next]() { return (next() >> 8) * (1.0f / 16777216.0f); };
+    auto since = [](std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    GameState g;
+    g.worldW = sqrtf(count * 10000.0f); g.worldH = g.worldW * 0.5f; // ~5000 px^2 per pickup
+    for (int i = 0; i < count; i++) {
+        Vec2 p = { unit() * g.worldW, GAME_Y0 + unit() * g.worldH };
+        if (next() % 100 < 85) g.collectibles.add({ p, collectibleRadius, 0u, 0.0f });
+        else g.powerups.add({ p, powerUpRadius, 1 + (int)(next() % (PU_TYPE_END - 1)), 0u, 0.0f });
+    }
+    groupPowerUps(g);
+    indexLevel(g);
+    PickupIndex& ix = g.index.pickups;
+    auto b0 = std::chrono::steady_clock::now();
+    ix.build(g);
+    printf("%d pickups in %.0fx%.0f px: tree of %zu nodes built in %.2f ms\n",
+        count, g.worldW, g.worldH, ix.nodes.size(), since(b0) * 1e-6);
+
+    std::vector<Vec2> at(queries);
+    for (auto& q : at) q = { unit() * g.worldW, GAME_Y0 + unit() * g.worldH };
+    // the linear scan the tree replaces, with the same order of ties
+    auto linearNearest = [&](Vec2 p, int k, PickupHit* out) {
+        int found = 0;
+        auto offer = [&](Vec2 c, uint32_t index, int kind) {
+            float dx = c.x - p.x, dy = c.y - p.y, d2 = dx * dx + dy * dy;
+            int j = found < k ? found++ : k;
+            if (j == k && !(d2 < out[k - 1].d2 || (d2 == out[k - 1].d2 && kind < out[k - 1].kind))) return;
+            if (j == k) j = k - 1;
+            while (j > 0 && (d2 < out[j - 1].d2 || (d2 == out[j - 1].d2 && (kind < out[j - 1].kind || (kind == out[j - 1].kind && index < out[j - 1].index))))) { out[j] = out[j - 1]; j--; }
+            out[j] = { c, d2, index, kind };
+        };
+        for (size_t i = 0; i < g.collectibles.size(); i++) if (isLive(g, g.collectibles[i])) offer(g.collectibles[i].p, (uint32_t)i, 0);
+        for (size_t i = 0; i < g.powerups.size(); i++) if (isLive(g, g.powerups[i])) offer(g.powerups[i].p, (uint32_t)i, g.powerups[i].type);
+        return found;
+    };
+    int linearQ = (std::min)(queries, (int)(200000000LL / count) + 1);
+
+    // pickups are taken in random order
+    std::vector<uint32_t> order(g.collectibles.size() + g.powerups.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (uint32_t)i;
+    for (size_t i = order.size(); i > 1; i--) std::swap(order[i - 1], order[next() % i]);
+    size_t takenSoFar = 0;
+    ix.autoCompact = false;
+
+    const float percents[] = { 0.0f, 0.5f, 0.9f };
+    for (float pct : percents) {
+        size_t want = (size_t)(pct * order.size()), from = takenSoFar;
+        auto t0 = std::chrono::steady_clock::now();
+        for (; takenSoFar < want; takenSoFar++) {
+            uint32_t k = order[takenSoFar];
+            bool power = k >= g.collectibles.size();
+            uint32_t i = power ? k - (uint32_t)g.collectibles.size() : k;
+            if (power) g.powerups[i].takenRound = g.round;
+            else g.collectibles[i].takenRound = g.round;
+            ix.taken(g, power ? g.powerups[i].type : 0, i);
+        }
+        double takeNs = want > from ? since(t0) / (want - from) : 0.0;
+        printf("%.0f%% taken (take %.0f ns each)\n", pct * 100.0f, takeNs);
+
+        for (int pass = 0; pass < 2; pass++) {
+            if (pass) {
+                auto c0 = std::chrono::steady_clock::now();
+                ix.compact(g);
+                printf("  compacted in %.2f ms\n", since(c0) * 1e-6);
+            }
+            PickupHit buf[64];
+            long long n1 = 0, n8 = 0, nr = 0, nb = 0;
+            auto q0 = std::chrono::steady_clock::now();
+            for (const Vec2& p : at) n1 += ix.nearest(g, p, 1, buf);
+            double knn1 = since(q0) / queries;
+            q0 = std::chrono::steady_clock::now();
+            for (const Vec2& p : at) n8 += ix.nearest(g, p, 8, buf);
+            double knn8 = since(q0) / queries;
+            q0 = std::chrono::steady_clock::now();
+            for (const Vec2& p : at) nr += ix.radius(g, p, 150.0f, buf, 64);
+            double rad = since(q0) / queries;
+            q0 = std::chrono::steady_clock::now();
+            for (const Vec2& p : at) nb += ix.box(g, p.x - 150.0f, p.y - 150.0f, p.x + 150.0f, p.y + 150.0f, buf, 64);
+            double box = since(q0) / queries;
+            printf("  %-11s nearest-1 %5.0f ns  nearest-8 %5.0f ns  radius 150 %5.0f ns (%.1f)  box 300 %5.0f ns (%.1f)\n",
+                pass ? "compacted" : "tombstones", knn1, knn8, rad, (double)nr / queries, box, (double)nb / queries);
+        }
+
+        PickupHit mine[8], ref[8];
+        int mismatches = 0;
+        auto q0 = std::chrono::steady_clock::now();
+        for (int q = 0; q < linearQ; q++) linearNearest(at[q], 8, ref);
+        double linear = since(q0) / linearQ;
+        for (int q = 0; q < linearQ && q < 2000; q++) {
+            int a = ix.nearest(g, at[q], 8, mine), b = linearNearest(at[q], 8, ref);
+            bool same = a == b;
+            for (int j = 0; same && j < a; j++) same = mine[j].index == ref[j].index && mine[j].kind == ref[j].kind;
+            mismatches += !same;
+        }
+        printf("  linear nearest-8 %.0f ns%s\n", linear, mismatches ? "  RESULTS DIFFER" : "");
+    }
+    // a new round revives everything in O(1); the leaves are recounted by
+    // the queries that reach them, and pickups taken before that are left
+    // to those recounts
+    auto r0 = std::chrono::steady_clock::now();
+    resetRound(g);
+    printf("New round: resetRound %.3f ms\n", since(r0) * 1e-6);
+    for (size_t i = 0; i < order.size() / 10; i++) {
+        uint32_t k = order[i];
+        bool power = k >= g.collectibles.size();
+        uint32_t j = power ? k - (uint32_t)g.collectibles.size() : k;
+        if (power) g.powerups[j].takenRound = g.round;
+        else g.collectibles[j].takenRound = g.round;
+        ix.taken(g, power ? g.powerups[j].type : 0, j);
+    }
+    PickupHit mine[8], ref[8];
+    for (int pass = 0; pass < 2; pass++) {
+        long long n8 = 0;
+        auto q0 = std::chrono::steady_clock::now();
+        for (const Vec2& p : at) n8 += ix.nearest(g, p, 8, mine);
+        double knn8 = since(q0) / queries;
+        int mismatches = 0;
+        for (int q = 0; q < linearQ && q < 2000; q++) {
+            int a = ix.nearest(g, at[q], 8, mine), b = linearNearest(at[q], 8, ref);
+            bool same = a == b;
+            for (int j = 0; same && j < a; j++) same = mine[j].index == ref[j].index && mine[j].kind == ref[j].kind;
+            mismatches += !same;
+        }
+        printf("  10%% taken, %s nearest-8 %5.0f ns%s\n", pass ? "recounted " : "first sweep", knn8, mismatches ? "  RESULTS DIFFER" : "");
+    }
+    return 0;
+}
+
+// --render-check: draws the same screen with both renderers, compares the
+// pixels and times frames of 1000 up to --count entities each way. Needs a
+// GL context; on machines without a GPU run it under Mesa's llvmpipe:
+//   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./SpaceExplorer --render-check
+// or, with no display at all, on a surfaceless EGL context:
+//   LIBGL_ALWAYS_SOFTWARE=1 ./SpaceExplorer --render-check --egl
+// renderCheck() only needs a current context with a WIN_W x WIN_H target.
+int renderCheck(const char* levelPath, int maxCount, int frames) {
+    printf("GL: %s / %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+    if (!initInstancedRenderer(instancedRenderer)) return 1;
+    ViewRect v = { 0.0f, (float)GAME_Y0, (float)WIN_W, (float)GAME_Y1 };
+    const int W = WIN_W, H = GAME_Y1 - GAME_Y0;
+    // returns the ms spent issuing the draw, before the driver finishes it
+    auto draw = [&](RendererKind kind, const GameState& g, float animSec) {
+        glViewport(0, GAME_Y0, W, H);
+        glMatrixMode(GL_PROJECTION); glLoadIdentity(); glOrtho(v.x0, v.x1, v.y0, v.y1, -1, 1);
+        glMatrixMode(GL_MODELVIEW); glLoadIdentity();
+        glClearColor(0.02f, 0.02f, 0.05f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glFinish();
+        renderer = kind;
+        auto t0 = std::chrono::steady_clock::now();
+        if (kind == RENDER_LEGACY) {
+            queueCollectibleGlows(blendQueue, g);
+            blendQueue.flush(glState, PASS_GLOW);
+        }
+        drawEntities(g, v, animSec);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        glFinish();
+        glState.endFrame();
+        return ms;
+    };
+    uint32_t rng = 99u;
+    auto unit = [&rng]() { return (xorshift32(rng) >> 8) * (1.0f / 16777216.0f); };
+    // one screen of entities at the editor's sizes, overlapping freely at high counts
+    auto fill = [&](GameState& g, int count) {
+        g.obstacles.clear(); g.collectibles.clear(); g.powerups.clear();
+        for (int i = 0; i < count; i++) {
+            Vec2 p = { 30.0f + unit() * (W - 60), GAME_Y0 + 30.0f + unit() * (H - 60) };
+            uint32_t k = xorshift32(rng) % 100;
+            if (k < 30) g.obstacles.add({ p, obstacleRadius });
+            else if (k < 85) g.collectibles.add({ p, collectibleRadius, 0u, 0.0f });
+            else g.powerups.add({ p, powerUpRadius, 1 + (int)(xorshift32(rng) % (PU_TYPE_END - 1)), 0u, unit() * 6.2831853f });
+        }
+        groupPowerUps(g);
+    };
+
+    // same picture: pixels whose colour differs by more than a quarter in any channel
+    GameState g;
+    if (!levelPath || !loadLevel(g, levelPath)) fill(g, 150);
+    std::vector<uint8_t> legacy((size_t)W * H * 4), instanced((size_t)W * H * 4);
+    bool ok = true;
+    const float times[] = { 0.0f, 1.3f };
+    for (float t : times) {
+        draw(RENDER_LEGACY, g, t);
+        glReadPixels(0, GAME_Y0, W, H, GL_RGBA, GL_UNSIGNED_BYTE, legacy.data());
+        draw(RENDER_INSTANCED, g, t);
+        glReadPixels(0, GAME_Y0, W, H, GL_RGBA, GL_UNSIGNED_BYTE, instanced.data());
+        size_t differ = 0, drawn = 0;
+        for (size_t i = 0; i < legacy.size(); i += 4) {
+            int d = 0;
+            for (int c = 0; c < 3; c++) d = (std::max)(d, abs((int)legacy[i + c] - (int)instanced[i + c]));
+            differ += d > 64;
+            drawn += legacy[i] > 20 || legacy[i + 1] > 20 || legacy[i + 2] > 40; // not background
+        }
+        double pct = 100.0 * differ / (std::max)((size_t)1, drawn);
+        printf("Image at t=%.1f s: %zu of %zu drawn pixels differ (%.2f%%)\n", t, differ, drawn, pct);
+        ok &= pct < 5.0; // about 4% differ: outlines are shapes behind the body, not 1 px lines
+    }
+
+    // frame cost as the entity count grows
+    for (int count = 1000; count <= maxCount; count *= 10) {
+        fill(g, count);
+        double ms[2], submit[2] = { 0.0, 0.0 };
+        uint32_t changes[2], blended = 0;
+        for (int kind = 0; kind < 2; kind++) {
+            draw((RendererKind)kind, g, 0.0f); // warm-up (buffer growth, shader first use)
+            changes[kind] = glState.lastChanges;
+            if (kind == RENDER_LEGACY) blended = glState.lastBlended;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; f++) submit[kind] += draw((RendererKind)kind, g, f / 60.0f);
+            ms[kind] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / frames;
+            submit[kind] /= frames;
+        }
+        printf("%7d entities: legacy %8.2f ms/frame (submit %7.2f)  instanced %8.2f ms/frame (submit %6.2f; %zu instances, %d draw calls)\n",
+            count, ms[0], submit[0], ms[1], submit[1], instancedRenderer.instances, instancedRenderer.drawCalls);
+        printf("%7s  blend state changes: legacy %u, instanced %u; %u glows blended each on its own would take %u\n",
+            "", changes[0], changes[1], blended, blended * 3);
+    }
+    renderer = RENDER_LEGACY;
+    printf("%s\n", ok ? "Renderers agree" : "RENDERERS DIFFER");
+    return ok ? 0 : 1;
+}
+
+#ifndef _WIN32
+// a compatibility 3.3 context with no window: Mesa's surfaceless EGL
+// platform, drawing into a WIN_W x WIN_H renderbuffer. EGL is loaded at
+// run time like ALSA, so the build needs neither its headers nor -lEGL.
+int renderCheckEgl(const char* levelPath, int maxCount, int frames) {
+    void* lib = dlopen("libEGL.so.1", RTLD_NOW);
+    if (!lib) { printf("Render check: no libEGL.so.1\n"); return 1; }
+    typedef void* (*ProcFn)(const char*);
+    typedef void* (*DisplayFn)(unsigned, void*, const int32_t*);
+    typedef unsigned (*InitFn)(void*, int32_t*, int32_t*);
+    typedef unsigned (*ChooseFn)(void*, const int32_t*, void**, int32_t, int32_t*);
+    typedef unsigned (*BindApiFn)(unsigned);
+    typedef void* (*ContextFn)(void*, void*, void*, const int32_t*);
+    typedef unsigned (*CurrentFn)(void*, void*, void*, void*);
+    const int32_t NONE = 0x3038, SURFACE_TYPE = 0x3033, PBUFFER_BIT = 0x0001, RENDERABLE_TYPE = 0x3040, OPENGL_BIT = 0x0008;
+    const int32_t MAJOR = 0x3098, MINOR = 0x30FB, PROFILE = 0x30FD, COMPATIBILITY = 0x0002;
+    const unsigned PLATFORM_SURFACELESS = 0x31DD, OPENGL_API = 0x30A2;
+    ProcFn proc = (ProcFn)dlsym(lib, "eglGetProcAddress");
+    DisplayFn display = proc ? (DisplayFn)proc("eglGetPlatformDisplayEXT") : NULL;
+    InitFn init = (InitFn)dlsym(lib, "eglInitialize");
+    ChooseFn choose = (ChooseFn)dlsym(lib, "eglChooseConfig");
+    BindApiFn bindApi = (BindApiFn)dlsym(lib, "eglBindAPI");
+    ContextFn context = (ContextFn)dlsym(lib, "eglCreateContext");
+    CurrentFn current = (CurrentFn)dlsym(lib, "eglMakeCurrent");
+    void* dpy = display && init && choose && bindApi && context && current ? display(PLATFORM_SURFACELESS, NULL, NULL) : NULL;
+    int32_t major = 0, minor = 0, configs = 0;
+    const int32_t want[] = { SURFACE_TYPE, PBUFFER_BIT, RENDERABLE_TYPE, OPENGL_BIT, NONE };
+    const int32_t version[] = { MAJOR, 3, MINOR, 3, PROFILE, COMPATIBILITY, NONE };
+    void* config = NULL;
+    void* ctx = NULL;
+    if (!dpy || !init(dpy, &major, &minor) || !choose(dpy, want, &config, 1, &configs) || !configs || !bindApi(OPENGL_API) ||
+        !(ctx = context(dpy, config, NULL, version)) || !current(dpy, NULL, NULL, ctx)) {
+        printf("Render check: no surfaceless EGL context with GL 3.3\n");
+        return 1;
+    }
+    eglProc = proc;
+    typedef void (*GenFn)(GLsizei, GLuint*);
+    typedef void (*BindFn)(GLenum, GLuint);
+    typedef void (*StorageFn)(GLenum, GLenum, GLsizei, GLsizei);
+    typedef void (*AttachFn)(GLenum, GLenum, GLenum, GLuint);
+    const GLenum FRAMEBUFFER = 0x8D40, RENDERBUFFER = 0x8D41, COLOR_ATTACHMENT0 = 0x8CE0;
+    GenFn genFramebuffers = (GenFn)proc("glGenFramebuffers"), genRenderbuffers = (GenFn)proc("glGenRenderbuffers");
+    BindFn bindFramebuffer = (BindFn)proc("glBindFramebuffer"), bindRenderbuffer = (BindFn)proc("glBindRenderbuffer");
+    StorageFn storage = (StorageFn)proc("glRenderbufferStorage");
+    AttachFn attach = (AttachFn)proc("glFramebufferRenderbuffer");
+    if (!genFramebuffers || !genRenderbuffers || !bindFramebuffer || !bindRenderbuffer || !storage || !attach) return 1;
+    GLuint fb = 0, rb = 0;
+    genFramebuffers(1, &fb); bindFramebuffer(FRAMEBUFFER, fb);
+    genRenderbuffers(1, &rb); bindRenderbuffer(RENDERBUFFER, rb);
+    storage(RENDERBUFFER, GL_RGBA8, WIN_W, WIN_H);
+    attach(FRAMEBUFFER, COLOR_ATTACHMENT0, RENDERBUFFER, rb);
+    printf("Context: surfaceless EGL %d.%d\n", major, minor);
+    // the driver stays loaded until exit
+    return renderCheck(levelPath, maxCount, frames);
+}
+#endif
+
+int runRenderCheck(int argc, char** argv) {
+    const char* levelPath = NULL;
+    int maxCount = 100000, frames = 20;
+    bool egl = false;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--render-check") && more && argv[i + 1][0] != '-') levelPath = argv[++i];
+        else if (!strcmp(argv[i], "--count") && more) maxCount = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && more) frames = (std::max)(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--egl")) egl = true;
+    }
+#ifndef _WIN32
+    // no display to open a window on: the same check on EGL
+    if (egl || !getenv("DISPLAY")) return renderCheckEgl(levelPath, maxCount, frames);
+#else
+    (void)egl;
+#endif
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+    glutInitWindowSize(WIN_W, WIN_H);
+    glutCreateWindow("Space Explorer - render check");
+    glReadBuffer(GL_BACK);
+    return renderCheck(levelPath, maxCount, frames);
+}
+
+// --pack-assets [out.pak] [--store]: the build step for the archive. WAVs
+// other than the streamed music track are compressed when that saves a
+// tenth; the music stays stored so it can be read in place.
+int packAssets(const char* out, bool compress, bool verbose) {
+    std::vector<const char*> names = { musicPath };
+    for (int i = 0; i < SND_COUNT; i++) names.push_back(soundDefs[i].file);
+    std::vector<PakEntry> index;
+    std::vector<std::vector<uint8_t>> blobs, raws;
+    for (const char* name : names) {
+        FILE* f = fopen(name, "rb");
+        if (!f) { if (verbose) printf("  %-16s not found, skipped\n", name); continue; }
+        std::vector<uint8_t> raw;
+        uint8_t buf[65536];
+        for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) raw.insert(raw.end(), buf, buf + n);
+        fclose(f);
+        PakEntry e = {};
+        strncpy(e.name, name, sizeof(e.name) - 1);
+        e.rawSize = (uint32_t)raw.size();
+        e.crc = crc32(raw.data(), raw.size());
+        std::vector<uint8_t> packed;
+        size_t len = strlen(name);
+        if (compress && strcmp(name, musicPath) && len > 4 && !strcmp(name + len - 4, ".wav")) {
+            pcm16Encode(raw.data(), raw.size(), packed);
+            if (packed.size() < raw.size() * 9 / 10) e.method = PAK_PCM16;
+        }
+        blobs.push_back(e.method == PAK_PCM16 ? std::move(packed) : raw);
+        e.size = (uint32_t)blobs.back().size();
+        index.push_back(e);
+        raws.push_back(std::move(raw));
+    }
+    auto align = [](uint64_t at) { return (at + PAK_ALIGN - 1) / PAK_ALIGN * PAK_ALIGN; };
+    uint64_t at = align(sizeof(PakHeader) + index.size() * sizeof(PakEntry));
+    for (PakEntry& e : index) { e.offset = at; at = align(at + e.size); }
+
+    FILE* f = fopen(out, "wb");
+    if (!f) { fprintf(stderr, "Cannot write %s\n", out); return 1; }
+    PakHeader h = { PAK_MAGIC, PAK_VERSION, (uint32_t)index.size(), 0 };
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(index.data(), sizeof(PakEntry), index.size(), f);
+    static const uint8_t zeros[PAK_ALIGN] = {};
+    for (size_t i = 0; i < index.size(); i++) {
+        fwrite(zeros, 1, (size_t)(index[i].offset - ftell(f)), f);
+        fwrite(blobs[i].data(), 1, blobs[i].size(), f);
+    }
+    fwrite(zeros, 1, (size_t)(at - ftell(f)), f);
+    fclose(f);
+
+    // read it back through the loader
+    static AssetArchive check;
+    bool ok = check.open(out);
+    uint64_t raw = 0, stored = 0;
+    for (size_t i = 0; ok && i < index.size(); i++) {
+        size_t n = 0;
+        const uint8_t* data = check.get(index[i].name, n);
+        ok = data && n == raws[i].size() && !memcmp(data, raws[i].data(), n);
+        raw += index[i].rawSize; stored += index[i].size;
+        if (verbose) printf("  %-16s %8u -> %8u bytes  %-6s crc %08x\n", index[i].name, index[i].rawSize, index[i].size,
+            index[i].method == PAK_PCM16 ? "pcm16" : "stored", index[i].crc);
+    }
+    check.close();
+    if (verbose) printf("%s: %zu entries, %llu bytes of assets in %llu (%llu with page alignment)%s\n", out, index.size(),
+        (unsigned long long)raw, (unsigned long long)stored, (unsigned long long)at, ok ? "" : "; READ-BACK FAILED");
+    return ok ? 0 : 1;
+}
+
+int runPackAssets(int argc, char** argv) {
+    const char* out = assetArchivePath;
+    bool compress = true;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--pack-assets") && i + 1 < argc && argv[i + 1][0] != '-') out = argv[++i];
+        else if (!strcmp(argv[i], "--store")) compress = false;
+    }
+    return packAssets(out, compress, true);
+}
+
+// --asset-bench: getting the sounds ready from loose files, from a stored
+// archive and from a compressed one. Each run starts with the files
+// dropped from the page cache and runs in its own process, so the times
+// are cold and the memory is its own (both Linux only).
+int runAssetBench(int, char**) {
+    const char* paks[] = { "bench-stored.pak", "bench-pcm16.pak" };
+#ifndef _WIN32
+    // packing in a child too keeps the parent's heap, which every run inherits, small
+    pid_t packer = fork();
+    if (!packer) _exit(packAssets(paks[0], false, false) || packAssets(paks[1], true, false));
+    int status = 1;
+    waitpid(packer, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) return 1;
+#else
+    if (packAssets(paks[0], false, false) || packAssets(paks[1], true, false)) return 1;
+#endif
+    auto evict = [](const char* path) {
+#ifndef _WIN32
+        int fd = ::open(path, O_RDONLY);
+        if (fd >= 0) { fdatasync(fd); posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); ::close(fd); }
+#endif
+    };
+    // resident KB: anonymous (heap, decoded data) and file-backed (mapped pages)
+    auto resident = [](long& anon, long& file) {
+        anon = file = 0;
+        FILE* f = fopen("/proc/self/status", "r");
+        if (!f) return;
+        char line[128];
+        while (fgets(line, sizeof(line), f)) {
+            sscanf(line, "RssAnon: %ld", &anon);
+            sscanf(line, "RssFile: %ld", &file);
+        }
+        fclose(f);
+    };
+    printf("%-14s %8s %8s %8s %7s %11s %11s\n", "source", "size KB", "open ms", "ready ms", "majflt", "heap KB", "mapped KB");
+    for (int v = 0; v < 3; v++) {
+        const char* pak = v ? paks[v - 1] : NULL;
+        evict(musicPath);
+        for (int i = 0; i < SND_COUNT; i++) evict(soundDefs[i].file);
+        if (pak) evict(pak);
+#ifndef _WIN32
+        fflush(stdout);
+        pid_t child = fork();
+        if (child) { waitpid(child, NULL, 0); continue; }
+        struct rusage r0, r1;
+        getrusage(RUSAGE_SELF, &r0);
+#endif
+        long priv0, shared0, priv1, shared1;
+        resident(priv0, shared0);
+        auto t0 = std::chrono::steady_clock::now();
+        size_t bytes = 0;
+        if (pak) { assets.open(pak); bytes = assets.size; }
+        double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        // the effects, and the music up to its first chunk
+        static AudioClip clips[SND_COUNT];
+        for (int i = 0; i < SND_COUNT; i++) {
+            loadClip(clips[i], soundDefs[i].file);
+            if (!pak) bytes += clips[i].frames * 4;
+        }
+        static MusicDecoder dec;
+        int16_t chunk[MUSIC_CHUNK * 2];
+        if (dec.open(musicPath, true)) {
+            dec.fill(chunk, MUSIC_CHUNK);
+            if (!pak) bytes += (size_t)dec.wav.frames * dec.wav.channels * 2;
+        }
+        double readyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        resident(priv1, shared1);
+        long majflt = 0;
+#ifndef _WIN32
+        getrusage(RUSAGE_SELF, &r1);
+        majflt = r1.ru_majflt - r0.ru_majflt;
+#endif
+        printf("%-14s %8zu %8.2f %8.2f %7ld %11ld %11ld\n", pak ? (v == 1 ? "stored pak" : "pcm16 pak") : "loose files",
+            bytes / 1024, openMs, readyMs, majflt, priv1 - priv0, shared1 - shared0);
+        if (pak && assets.decodes) printf("%-14s %u entries decompressed and checked in %.2f ms\n", "", assets.decodes, assets.decodeMs);
+#ifndef _WIN32
+        fflush(stdout);
+        _exit(0);
+#endif
+        assets.close();
+    }
+    remove(paks[0]);
+    remove(paks[1]);
+    return 0;
+}
+
+// --audio-check: streams a WAV through the music path with no device and
+// reports the time to the first sample, whether the loop is seamless (the
+// mix must match the track decoded straight through, around the loop
+// point and on), the fade-out length and what the mixer costs
+int runAudioCheck(int argc, char** argv) {
+    const char* path = NULL;
+    float seconds = 0.0f;
+    for (int i = 1; i < argc; i++) {
+        bool more = i + 1 < argc;
+        if (!strcmp(argv[i], "--audio-check") && more && argv[i + 1][0] != '-') path = argv[++i];
+        else if (!strcmp(argv[i], "--seconds") && more) seconds = (float)atof(argv[++i]);
+    }
+    static MusicStream ms;
+    assets.open(assetArchivePath); // the track comes from the archive when it's there
+    if (!path) {
+        AssetFile f;
+        path = f.open(musicPath) ? musicPath : "win.wav";
+        f.close();
+    }
+    if (!musicOpen(ms, path, true)) { fprintf(stderr, "Cannot stream %s (16-bit PCM WAV only)\n", path); return 1; }
+    const WavStream& wav = ms.dec.wav;
+    uint64_t trackFrames = (uint64_t)wav.frames * AUDIO_RATE / wav.rate;
+    printf("%s: %d Hz, %d channel(s), %.2f s\n", path, wav.rate, wav.channels, (double)wav.frames / wav.rate);
+    printf("Memory: %zu KB ring + %zu KB chunk, against %.0f KB for the track decoded whole\n",
+        ms.ring.size() * sizeof(int16_t) / 1024, sizeof(ms.dec.buf) / 1024, trackFrames * 4 / 1024.0);
+
+    float mix[AUDIO_PERIOD * 2];
+    double mixUs = 0.0;
+    uint64_t periods = 0;
+    // a period once the decoder has one ready, so nothing is mixed short
+    auto mixReady = [&]() {
+        for (;;) {
+            uint64_t rd = (std::max)(ms.consumed.load(), ms.flushTo.load());
+            if (!ms.restart.load() && ms.written.load() - rd >= (uint64_t)AUDIO_PERIOD) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        memset(mix, 0, sizeof(mix));
+        long long t0 = nowUs();
+        musicMix(ms, mix, AUDIO_PERIOD);
+        mixUs += nowUs() - t0;
+        periods++;
+    };
+    auto start = [&](float rampMs) {
+        musicPlay(ms, 1.0f, rampMs);
+        musicMix(ms, mix, 0); // take the command, as the next device period would
+        mixReady();
+        return ms.startupMs.load();
+    };
+
+    printf("Startup: %.2f ms to the first sample (the game adds up to a %.1f ms period and the device buffer)\n",
+        start(0.0f), 1000.0f * AUDIO_PERIOD / AUDIO_RATE);
+
+    // the stream against a decoder read straight through, past the loop point
+    MusicDecoder ref;
+    ref.open(path, true);
+    int16_t want[AUDIO_PERIOD * 2], got[AUDIO_PERIOD * 2];
+    uint64_t total = seconds > 0.0f ? (uint64_t)(seconds * AUDIO_RATE) : trackFrames + trackFrames / 2;
+    uint64_t firstBad = UINT64_MAX, frames = 0;
+    long long t0 = nowUs();
+    for (bool first = true; frames < total; first = false) {
+        if (!first) mixReady();
+        audioToPcm(mix, got, AUDIO_PERIOD * 2);
+        ref.fill(want, AUDIO_PERIOD);
+        for (int i = 0; i < AUDIO_PERIOD * 2 && firstBad == UINT64_MAX; i++)
+            if (got[i] != want[i]) firstBad = frames + i / 2;
+        frames += AUDIO_PERIOD;
+    }
+    double wallSec = (nowUs() - t0) * 1e-6;
+    if (firstBad == UINT64_MAX) printf("Loop: seamless, %llu frames (%.2f loops) match the track\n", (unsigned long long)frames, (double)frames / trackFrames);
+    else printf("Loop: MISMATCH at frame %llu (the track is %llu frames)\n", (unsigned long long)firstBad, (unsigned long long)trackFrames);
+    printf("Decode: %.0fx real time\n", frames / (double)AUDIO_RATE / wallSec);
+
+    // fade out: the gain falls every period and reaches silence on time
+    musicStop(ms, musicFadeOutMs);
+    uint64_t fadeFrames = 0;
+    bool monotonic = true;
+    float last = ms.gain;
+    while (ms.gain > 0.0f || ms.goal > 0.0f) {
+        mixReady();
+        fadeFrames += AUDIO_PERIOD;
+        monotonic &= ms.gain <= last;
+        last = ms.gain;
+    }
+    printf("Fade out: %.0f ms asked, silent after %.0f ms%s\n", musicFadeOutMs, fadeFrames * 1000.0 / AUDIO_RATE,
+        monotonic ? "" : " (NOT MONOTONIC)");
+    printf("Restart from silence: %.2f ms to the first sample\n", start(musicFadeInMs));
+    printf("Mixer: %.2f us a period of %.1f ms; %llu underrun frames\n", mixUs / periods, 1000.0f * AUDIO_PERIOD / AUDIO_RATE,
+        (unsigned long long)ms.underruns.load());
+    musicClose(ms);
+    return firstBad == UINT64_MAX && monotonic ? 0 : 1;
+}
+
+// --voice-bench: bursts of pickups (with hits and round ends) fired each
+// sim tick on a simulated clock, mixed period by period. Shows the voice
+// count and the mixer's cost staying flat as the burst grows, and every
+// win/lose getting a voice.
+int runVoiceBench(int argc, char** argv) {
+    int ticks = 2400;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (!strcmp(argv[i], "--ticks")) ticks = (std::max)(1, atoi(argv[i + 1]));
+        else if (!strcmp(argv[i], "--voices")) audioVoices = atoi(argv[i + 1]);
+    }
+    audioVoices = (std::max)(1, (std::min)(audioVoices, MAX_VOICES));
+    static SoundMixer sm;
+    assets.open(assetArchivePath);
+    for (int i = 0; i < SND_COUNT; i++)
+        if (!loadClip(sm.clips[i], soundDefs[i].file)) { fprintf(stderr, "Cannot load %s\n", soundDefs[i].file); return 1; }
+    printf("%d voices, %d ticks (%.0f s) per row; caps: hit %d, collect %d, win/lose %d\n", audioVoices, ticks,
+        (double)ticks / SIM_HZ, soundDefs[SND_HIT].maxInstances, soundDefs[SND_COLLECT].maxInstances, soundDefs[SND_WIN].maxInstances);
+    printf("%7s %9s %7s %9s %7s %7s %7s %5s %15s %9s\n", "burst", "triggers", "played", "coalesced", "capped", "stolen", "dropped",
+        "peak", "mix us avg/max", "win+lose");
+    uint32_t rng = 7u;
+    float mix[AUDIO_PERIOD * 2];
+    const int bursts[] = { 1, 10, 100, 1000 };
+    for (int burst : bursts) {
+        for (Voice& v : sm.voices) v.on = false;
+        for (long long& t : sm.lastUs) t = -1000000000LL; // long before the first tick
+        sm.played = sm.coalesced = sm.capped = sm.stolen = sm.dropped = 0;
+        for (auto& c : sm.playedBy) c = 0;
+        sm.peak = 0;
+        unsigned long long triggers = 0, ends = 0;
+        double mixUs = 0.0, mixMax = 0.0;
+        uint64_t periods = 0, due = 0; // frames the clock has reached
+        for (int t = 0; t < ticks; t++) {
+            long long now = (long long)t * 1000000 / SIM_HZ;
+            for (int b = 0; b < burst; b++, triggers++)
+                playSound(sm, xorshift32(rng) % 8 ? SND_COLLECT : SND_HIT, now);
+            if (t % (SIM_HZ * 2) == SIM_HZ) { playSound(sm, t % (SIM_HZ * 4) == SIM_HZ ? SND_WIN : SND_LOSE, now); triggers++; ends++; }
+            for (due += AUDIO_RATE / SIM_HZ; periods * AUDIO_PERIOD < due; periods++) {
+                memset(mix, 0, sizeof(mix));
+                long long t0 = nowUs();
+                sfxMix(sm, mix, AUDIO_PERIOD);
+                double us = (double)(nowUs() - t0);
+                mixUs += us;
+                mixMax = (std::max)(mixMax, us);
+            }
+        }
+        char cost[32];
+        sprintf(cost, "%.1f/%.0f", mixUs / periods, mixMax);
+        printf("%7d %9llu %7llu %9llu %7llu %7llu %7llu %5d %15s %4llu/%llu\n", burst, triggers, sm.played.load(), sm.coalesced.load(),
+            sm.capped.load(), sm.stolen.load(), sm.dropped.load(), sm.peak.load(), cost,
+            sm.playedBy[SND_WIN].load() + sm.playedBy[SND_LOSE].load(), ends);
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
+    startup.mark("main");
+    // headless modes run before GLUT so they work without a display
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "--batch")) return runBatch(argc, argv);
+        else if (!strcmp(argv[i], "--gen-level")) return runGenerate(argc, argv);
+        else if (!strcmp(argv[i], "--alloc-check")) return runAllocCheck(argc, argv);
+        else if (!strcmp(argv[i], "--particle-bench")) return runParticleBench(argc, argv);
+        else if (!strcmp(argv[i], "--input-latency")) return runInputLatency(argc, argv);
+        else if (!strcmp(argv[i], "--event-bench")) return runEventBench(argc, argv);
+        else if (!strcmp(argv[i], "--timer-bench")) return runTimerBench(argc, argv);
+        else if (!strcmp(argv[i], "--view-bench")) return runViewBench(argc, argv);
+        else if (!strcmp(argv[i], "--rewind-bench")) return runRewindBench(argc, argv);
+        else if (!strcmp(argv[i], "--sim-hash")) return runSimHash(argc, argv);
+        else if (!strcmp(argv[i], "--index-bench")) return runIndexBench(argc, argv);
+        else if (!strcmp(argv[i], "--paint-bench")) return runPaintBench(argc, argv);
+        else if (!strcmp(argv[i], "--reload-bench")) return runReloadBench(argc, argv);
+        else if (!strcmp(argv[i], "--bvh-bench")) return runBvhBench(argc, argv);
+        else if (!strcmp(argv[i], "--pickup-bench")) return runPickupBench(argc, argv);
+        else if (!strcmp(argv[i], "--render-check")) return runRenderCheck(argc, argv);
+        else if (!strcmp(argv[i], "--audio-check")) return runAudioCheck(argc, argv);
+        else if (!strcmp(argv[i], "--voice-bench")) return runVoiceBench(argc, argv);
+        else if (!strcmp(argv[i], "--pack-assets")) return runPackAssets(argc, argv);
+        else if (!strcmp(argv[i], "--asset-bench")) return runAssetBench(argc, argv);
+
     srand((unsigned)time(NULL));
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
     glutInitWindowSize(WIN_W, WIN_H);
     glutCreateWindow("Space Explorer - Final");
+    startup.mark("window");
+
+    // instanced unless asked for legacy or the context cannot do it
+    bool wantInstanced = true;
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], "--renderer")) wantInstanced = strcmp(argv[i + 1], "legacy") != 0;
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], "--voices")) audioVoices = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--level")) levelPath = argv[i + 1];
+    // audio device, music and effects come up on their own thread
+    startAudioAsync();
+    atexit(stopAudio);
+    if (wantInstanced && initInstancedRenderer(instancedRenderer)) renderer = RENDER_INSTANCED;
+    printf("Renderer: %s\n", renderer == RENDER_INSTANCED ? "instanced (OpenGL 3.3)" : "legacy (immediate mode)");
+    startup.mark("renderer");
 
     initGame();
+    startup.mark("game state");
+    // --level / --watch: read and index it in the background like an 'L' press
+    bool loadAtStart = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--watch")) levelWatched = true;
+        if (!strcmp(argv[i], "--watch") || (!strcmp(argv[i], "--level") && i + 1 < argc)) loadAtStart = true;
+    }
+    // the sim owns `game` from here on; GLUT callbacks only send it commands
+    startSimThread();
+    atexit(stopSimThread);
+    startup.mark("sim thread");
+    if (loadAtStart) simCommands.push({ SimCommand::KEY, 'L', { 0.0f, 0.0f }, nowUs() });
+    if (levelWatched) {
+        startLevelWatch();
+        atexit(stopLevelWatch);
+    }
 
     glutDisplayFunc(displayWrapper);
     glutIdleFunc(idleWrapper);
@@ -782,6 +7660,7 @@ int main(int argc, char** argv) {
     glutSpecialFunc(specialDown);
     glutSpecialUpFunc(specialUp);
     glutMouseFunc(mouseClick);
+    glutMotionFunc(mouseDrag);
 
     glutMainLoop();
     return 0;